@@ -0,0 +1,361 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// for memfd_create
+#define _GNU_SOURCE
+
+#include "./daemon.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../utils/fasttime.h"
+#include "./thread_pool.h"
+#include "./view.h"
+
+// connections waiting to be accepted
+#define LISTEN_BACKLOG 64
+
+// microseconds to wait before accepting again when out of descriptors or
+// memory, so that running out does not spin
+#define ACCEPT_BACKOFF_USEC 100000
+
+// The matrix a connection worked on last. Clients that send the same
+// shared memory job after job find it already mapped and faulted in
+static struct mapping_s {
+  dev_t dev;
+  ino_t ino;
+  size_t size;
+  uint8_t *map;
+} empty_mapping;
+
+// connections being served, which a daemon with a connection limit waits
+// for before it returns
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+  size_t active;
+} connections = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0};
+
+// Receives a job and the descriptor that comes with it, -1 if none did.
+//
+// Returns `false` once the client has hung up
+static bool receive_job(const int sock, struct rotate_job_s *job, int *fd) {
+  struct iovec iov = {job, sizeof(*job)};
+  union {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct msghdr msg = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control.buffer,
+      .msg_controllen = sizeof(control.buffer),
+  };
+
+  *fd = -1;
+  const ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  if (n <= 0) {
+    return false;
+  }
+
+  const struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS) {
+    memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+  }
+
+  // A short job is answered like a bad one
+  if (n != sizeof(*job)) {
+    job->N = 0;
+  }
+  return true;
+}
+
+// Maps the `size` bytes of matrix behind `fd` into `mapping`, unless it
+// holds them already. The memory must be sealed against shrinking, since a
+// client that truncated it mid-transform would bring the daemon down with
+// SIGBUS.
+//
+// Returns 0 on success and an errno value otherwise
+static int map_job(const int fd, const size_t size,
+                   struct mapping_s *mapping) {
+  const int seals = fcntl(fd, F_GET_SEALS);
+  if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+    return EINVAL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st)) {
+    return errno;
+  }
+  if ((uint64_t)st.st_size < size) {
+    return EINVAL;
+  }
+
+  if (mapping->map && mapping->dev == st.st_dev && mapping->ino == st.st_ino &&
+      mapping->size == size) {
+    return 0;
+  }
+
+  if (mapping->map) {
+    munmap(mapping->map, mapping->size);
+    *mapping = empty_mapping;
+  }
+
+  // Faulting the pages in up front keeps the faults out of the transform
+  uint8_t *map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, 0);
+  if (map == MAP_FAILED) {
+    return errno;
+  }
+
+  *mapping = (struct mapping_s){st.st_dev, st.st_ino, size, map};
+  return 0;
+}
+
+// Serves the jobs of one connection until the client hangs up
+static void *serve_connection(void *arg) {
+  const int sock = (int)(size_t)arg;
+  struct mapping_s mapping = empty_mapping;
+
+  struct rotate_job_s job;
+  int fd;
+  while (receive_job(sock, &job, &fd)) {
+    const fasttime_t start = gettime();
+    const bits_t N = job.N;
+    struct rotate_reply_s reply = {.status = 0};
+
+    if (fd < 0 || N == 0 || N > UINT32_MAX ||
+        job.orientation >= NORIENTATIONS) {
+      reply.status = EINVAL;
+    } else {
+      reply.status = map_job(fd, N * bits_to_bytes(N), &mapping);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+
+    if (!reply.status) {
+      const fasttime_t transform_start = gettime();
+      if (job.orientation == ORIENT_ROTATE_CW) {
+        rotate_bit_matrix(mapping.map, N);
+      } else {
+        struct bit_view_s view =
+            make_bit_view(mapping.map, N, job.orientation);
+        bit_view_materialize(&view);
+      }
+      reply.transform_nsec = tdiff_nsec(transform_start, gettime());
+    }
+
+    reply.job_nsec = tdiff_nsec(start, gettime());
+    if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+      break;
+    }
+  }
+
+  if (mapping.map) {
+    munmap(mapping.map, mapping.size);
+  }
+  close(sock);
+
+  pthread_mutex_lock(&connections.lock);
+  connections.active--;
+  pthread_cond_broadcast(&connections.done);
+  pthread_mutex_unlock(&connections.lock);
+
+  return NULL;
+}
+
+// Gives the worker threads something to do, so they are running before the
+// first job comes
+static void warm_up(void *arg, size_t begin, size_t end) {
+  (void)arg;
+  (void)begin;
+  (void)end;
+}
+
+bool run_rotate_daemon(const char *socket_path, const size_t max_connections) {
+  // Sanity check the input
+  assert(socket_path);
+
+  // Only a stale socket is replaced, never a file the path might name by
+  // mistake
+  struct stat st;
+  if (!lstat(socket_path, &st) && !S_ISSOCK(st.st_mode)) {
+    printf("Error: %s exists and is not a socket\n", socket_path);
+    return false;
+  }
+
+  // The socket is bound under a name of its own and only moved to
+  // `socket_path` once it is listening, so a client that finds the path can
+  // connect
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s.%d", socket_path,
+               (int)getpid()) >= (int)sizeof(addr.sun_path)) {
+    printf("Error: Socket path %s is too long\n", socket_path);
+    return false;
+  }
+
+  const int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  unlink(addr.sun_path);
+  if (listener < 0 ||
+      bind(listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(listener, LISTEN_BACKLOG) || rename(addr.sun_path, socket_path)) {
+    perror("Error setting up daemon socket");
+    if (listener >= 0) {
+      close(listener);
+      unlink(addr.sun_path);
+    }
+    return false;
+  }
+
+  parallel_for(get_num_threads(), warm_up, NULL);
+
+  bool result = true;
+  for (size_t served = 0; !max_connections || served < max_connections;) {
+    const int sock = accept(listener, NULL, NULL);
+    if (sock < 0) {
+      const int error = errno;
+      if (error == EINTR || error == ECONNABORTED) {
+        continue;
+      }
+
+      perror("Error accepting daemon connection");
+      if (error == EMFILE || error == ENFILE || error == ENOBUFS ||
+          error == ENOMEM) {
+        // Connections being served will give some back
+        usleep(ACCEPT_BACKOFF_USEC);
+        continue;
+      }
+
+      result = false;
+      break;
+    }
+
+    pthread_mutex_lock(&connections.lock);
+    connections.active++;
+    pthread_mutex_unlock(&connections.lock);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, serve_connection,
+                       (void *)(size_t)sock)) {
+      // Serve it here rather than turn it away
+      serve_connection((void *)(size_t)sock);
+    } else {
+      pthread_detach(thread);
+    }
+    served++;
+  }
+
+  pthread_mutex_lock(&connections.lock);
+  while (connections.active) {
+    pthread_cond_wait(&connections.done, &connections.lock);
+  }
+  pthread_mutex_unlock(&connections.lock);
+
+  close(listener);
+  unlink(socket_path);
+
+  return result;
+}
+
+int connect_rotate_daemon(const char *socket_path) {
+  // Sanity check the input
+  assert(socket_path);
+
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    printf("Error: Socket path %s is too long\n", socket_path);
+    return -1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  const int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+    perror("Error connecting to daemon");
+    if (sock >= 0) {
+      close(sock);
+    }
+    return -1;
+  }
+
+  return sock;
+}
+
+int create_rotate_job_memory(const size_t size) {
+  const int fd =
+      memfd_create("snailspeed-job", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0 || ftruncate(fd, size) ||
+      fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK)) {
+    perror("Error creating job memory");
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+
+  return fd;
+}
+
+bool submit_rotate_job(const int sock, const int fd, const bits_t N,
+                       const enum orientation_e orientation,
+                       struct rotate_reply_s *reply) {
+  // Sanity check the input
+  assert(reply);
+
+  struct rotate_job_s job = {.N = N, .orientation = orientation};
+  struct iovec iov = {&job, sizeof(job)};
+  union {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(int))];
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct msghdr msg = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control.buffer,
+      .msg_controllen = sizeof(control.buffer),
+  };
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  if (sendmsg(sock, &msg, MSG_NOSIGNAL) != sizeof(job) ||
+      recv(sock, reply, sizeof(*reply), 0) != sizeof(*reply)) {
+    perror("Error talking to daemon");
+    return false;
+  }
+
+  return reply->status == 0;
+}
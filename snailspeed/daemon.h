@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "../utils/utils.h"
+#include "./rotate.h"
+
+// A rotation daemon takes jobs over a Unix domain socket. Each job is one
+// `struct rotate_job_s` carrying, as SCM_RIGHTS ancillary data, a file
+// descriptor of shared memory that holds the `N` by `N` bit matrix with
+// rows of `bits_to_bytes(N)` bytes. The memory must be a memfd sealed with
+// F_SEAL_SHRINK, as `create_rotate_job_memory` makes it; any other
+// descriptor is turned away with EINVAL. The daemon transforms the
+// matrix in place in that memory and answers with a `struct rotate_reply_s`.
+// A connection takes any number of jobs, one at a time, and keeps the last
+// matrix mapped, so a client that reuses its memory skips the mapping.
+
+// a job, sent with the descriptor of its matrix
+struct rotate_job_s {
+  uint64_t N;
+  uint32_t orientation;
+  uint32_t reserved;
+};
+
+// the answer to a job. `status` is 0 on success and an errno value
+// otherwise. The times are in nanoseconds, for the transform alone and from
+// the job arriving to the reply being sent
+struct rotate_reply_s {
+  int32_t status;
+  uint32_t reserved;
+  uint64_t transform_nsec;
+  uint64_t job_nsec;
+};
+
+// Listens on the Unix domain socket `socket_path`, which appears once the
+// daemon is ready for connections. A stale socket there is replaced, but
+// any other file is left alone and the daemon refuses to start. It serves each
+// connection on a thread of its own. Transforms run on the
+// SNAILSPEED_THREADS pool, started before the first job, whenever it is not
+// busy with another connection. Returns once `max_connections` connections
+// have come and gone, or never if it is 0. Running out of descriptors or
+// memory pauses accepting for a moment; any other accept error stops the
+// daemon once its connections are done.
+//
+// Returns `false` if the socket could not be set up or accepting failed
+bool run_rotate_daemon(const char *socket_path, const size_t max_connections);
+
+// Connects to the rotation daemon listening on `socket_path`.
+//
+// Returns the connected socket, or -1 if there was an error
+int connect_rotate_daemon(const char *socket_path);
+
+// Creates shared memory of `size` bytes to hold a job's matrix, filled
+// with zeros and sealed so that it cannot shrink.
+//
+// Returns its descriptor, or -1 if there was an error
+int create_rotate_job_memory(const size_t size);
+
+// Has the daemon behind `sock` apply `orientation` to the `N` by `N` bit
+// matrix in the shared memory `fd`, and waits for its `reply`.
+//
+// Returns `true` if the job was done
+bool submit_rotate_job(const int sock, const int fd, const bits_t N,
+                       const enum orientation_e orientation,
+                       struct rotate_reply_s *reply);
+
+#endif  // DAEMON_H
@@ -0,0 +1,308 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./morton.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+#include "./thread_pool.h"
+#include "./transpose.h"
+
+// levels of quadrant recursion unrolled into separate `parallel_for`
+// indices, giving up to 4^3 independent pieces of work
+#define PARALLEL_LEVELS 3
+
+// everything a worker needs to convert or rotate its share of the tiles
+struct morton_s {
+  const ROW_TYPE *src;
+  ROW_TYPE *dst;
+  // tiles per side
+  bits_t size;
+
+  // the quadrant side of the pieces handed to workers, and how many
+  // levels above them were unrolled
+  bits_t piece_size;
+  int levels;
+
+  transpose_fn_t transpose;
+};
+
+// Spreads the low 32 bits of `x` to the even bits of the result
+static inline uint64_t spread_bits(uint64_t x) {
+  x &= 0xFFFFFFFF;
+  x = (x | (x << 16)) & 0x0000FFFF0000FFFF;
+  x = (x | (x << 8)) & 0x00FF00FF00FF00FF;
+  x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0F;
+  x = (x | (x << 2)) & 0x3333333333333333;
+  x = (x | (x << 1)) & 0x5555555555555555;
+  return x;
+}
+
+// Returns the first word of the tile in tile row `i`, tile column `j`. The
+// column supplies the even bits of the Morton index, so the quadrants of
+// every square come top left, top right, bottom left, bottom right
+static inline size_t morton_offset(const bits_t i, const bits_t j) {
+  return ((spread_bits(i) << 1) | spread_bits(j)) << LOG_BASE;
+}
+
+// Moves 4 rows of 4 words between a row-major matrix and 4 tiles, as a
+// 4x4 transpose of 64-bit words: word m of `in[r]` becomes word r of
+// `out[m]`
+__attribute__((target("avx2"))) static inline void transpose_4x4(
+    const ROW_TYPE *in[4], ROW_TYPE *out[4]) {
+  const __m256i r0 = _mm256_loadu_si256((const __m256i *)in[0]);
+  const __m256i r1 = _mm256_loadu_si256((const __m256i *)in[1]);
+  const __m256i r2 = _mm256_loadu_si256((const __m256i *)in[2]);
+  const __m256i r3 = _mm256_loadu_si256((const __m256i *)in[3]);
+
+  const __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+  const __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+  const __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+  const __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+
+  _mm256_storeu_si256((__m256i *)out[0], _mm256_permute2x128_si256(t0, t2, 0x20));
+  _mm256_storeu_si256((__m256i *)out[1], _mm256_permute2x128_si256(t1, t3, 0x20));
+  _mm256_storeu_si256((__m256i *)out[2], _mm256_permute2x128_si256(t0, t2, 0x31));
+  _mm256_storeu_si256((__m256i *)out[3], _mm256_permute2x128_si256(t1, t3, 0x31));
+}
+
+// Copies the tile rows numbered [`begin`, `end`) from row-major `src` to
+// Morton-ordered `dst`. Each 4 rows of 4 neighbouring tiles are moved with
+// one 4x4 transpose of words
+__attribute__((target("avx2"))) static void gather_morton_rows_avx2(
+    void *arg, size_t begin, size_t end) {
+  const struct morton_s *morton = arg;
+  const bits_t size = morton->size;
+
+  for (size_t i = begin; i < end; i++) {
+    for (bits_t j = 0; j < size; j += 4) {
+      ROW_TYPE *tiles[4];
+      for (int m = 0; m < 4; m++) {
+        tiles[m] = morton->dst + morton_offset(i, j + m);
+      }
+      for (int k = 0; k < BASE; k += 4) {
+        const ROW_TYPE *row = morton->src + ((i << LOG_BASE) + k) * size + j;
+        const ROW_TYPE *in[4] = {row, row + size, row + 2 * size,
+                                 row + 3 * size};
+        ROW_TYPE *out[4] = {tiles[0] + k, tiles[1] + k, tiles[2] + k,
+                            tiles[3] + k};
+        transpose_4x4(in, out);
+      }
+    }
+  }
+}
+
+// The inverse of `gather_morton_rows_avx2`
+__attribute__((target("avx2"))) static void scatter_morton_rows_avx2(
+    void *arg, size_t begin, size_t end) {
+  const struct morton_s *morton = arg;
+  const bits_t size = morton->size;
+
+  for (size_t i = begin; i < end; i++) {
+    for (bits_t j = 0; j < size; j += 4) {
+      const ROW_TYPE *tiles[4];
+      for (int m = 0; m < 4; m++) {
+        tiles[m] = morton->src + morton_offset(i, j + m);
+      }
+      for (int k = 0; k < BASE; k += 4) {
+        ROW_TYPE *row = morton->dst + ((i << LOG_BASE) + k) * size + j;
+        const ROW_TYPE *in[4] = {tiles[0] + k, tiles[1] + k, tiles[2] + k,
+                                 tiles[3] + k};
+        ROW_TYPE *out[4] = {row, row + size, row + 2 * size, row + 3 * size};
+        transpose_4x4(in, out);
+      }
+    }
+  }
+}
+
+// Portable conversions, one word at a time
+static void gather_morton_rows(void *arg, size_t begin, size_t end) {
+  const struct morton_s *morton = arg;
+  const bits_t size = morton->size;
+
+  for (size_t i = begin; i < end; i++) {
+    for (int k = 0; k < BASE; ++k) {
+      const ROW_TYPE *row = morton->src + ((i << LOG_BASE) + k) * size;
+      for (bits_t j = 0; j < size; j++) {
+        morton->dst[morton_offset(i, j) + k] = row[j];
+      }
+    }
+  }
+}
+
+static void scatter_morton_rows(void *arg, size_t begin, size_t end) {
+  const struct morton_s *morton = arg;
+  const bits_t size = morton->size;
+
+  for (size_t i = begin; i < end; i++) {
+    for (int k = 0; k < BASE; ++k) {
+      ROW_TYPE *row = morton->dst + ((i << LOG_BASE) + k) * size;
+      for (bits_t j = 0; j < size; j++) {
+        row[j] = morton->src[morton_offset(i, j) + k];
+      }
+    }
+  }
+}
+
+// Returns whether `N` can be stored in Morton order
+static bool is_morton_size(const bits_t N) {
+  const bits_t size = N >> LOG_BASE;
+  return !(N % BASE) && size && !(size & (size - 1));
+}
+
+// Returns whether the vector conversions apply: they move 4 tiles at a time
+static bool use_avx2_conversion(const bits_t size) {
+  return size >= 4 && __builtin_cpu_supports("avx2");
+}
+
+void bit_matrix_to_morton(const uint8_t *src, uint8_t *tiles, const bits_t N) {
+  // Sanity check the input
+  assert(src && tiles);
+  assert(is_morton_size(N));
+
+  struct morton_s morton = {
+      .src = (const ROW_TYPE *)src,
+      .dst = (ROW_TYPE *)tiles,
+      .size = N >> LOG_BASE,
+  };
+  parallel_for(morton.size,
+               use_avx2_conversion(morton.size) ? gather_morton_rows_avx2
+                                                : gather_morton_rows,
+               &morton);
+}
+
+void morton_to_bit_matrix(const uint8_t *tiles, uint8_t *dst, const bits_t N) {
+  // Sanity check the input
+  assert(tiles && dst);
+  assert(is_morton_size(N));
+
+  struct morton_s morton = {
+      .src = (const ROW_TYPE *)tiles,
+      .dst = (ROW_TYPE *)dst,
+      .size = N >> LOG_BASE,
+  };
+  parallel_for(morton.size,
+               use_avx2_conversion(morton.size) ? scatter_morton_rows_avx2
+                                                : scatter_morton_rows,
+               &morton);
+}
+
+// Morton indices of the quadrants of a square in clockwise order: top left,
+// top right, bottom right, bottom left
+static const int clockwise_quadrants[4] = {0, 1, 3, 2};
+
+// Narrows the four `n` by `n` squares `squares`, whose contents move one
+// place along the array when rotated, to the four quadrants numbered `c`
+// that do the same. Rotating clockwise carries quadrant clockwise_quadrants[c]
+// of square q to quadrant clockwise_quadrants[c + 1] of square q + 1
+static inline void narrow_squares(ROW_TYPE *squares[4], const bits_t n,
+                                  const int c) {
+  const size_t quadrant_words = (n / 2) * (n / 2) << LOG_BASE;
+  for (int q = 0; q < 4; q++) {
+    squares[q] += clockwise_quadrants[(c + q) % 4] * quadrant_words;
+  }
+}
+
+// Rotates square q of `squares` onto square q + 1, recursing on quadrants
+// until each square is a single tile
+static void rotate_squares(const struct morton_s *morton, ROW_TYPE *squares[4],
+                           const bits_t n) {
+  if (n == 1) {
+    ROW_TYPE last[BASE];
+
+    for (int q = 0; q < 4; q++) {
+      morton->transpose(squares[q]);
+    }
+
+    // tile q goes where tile q + 1 was, in reverse row order
+    memcpy(last, squares[3], sizeof(last));
+    for (int q = 3; q > 0; q--) {
+      for (int k = 0; k < BASE; ++k) {
+        squares[q][k] = squares[q - 1][LAST_BASE_INDEX - k];
+      }
+    }
+    for (int k = 0; k < BASE; ++k) {
+      squares[0][k] = last[LAST_BASE_INDEX - k];
+    }
+    return;
+  }
+
+  for (int c = 0; c < 4; c++) {
+    ROW_TYPE *quadrants[4] = {squares[0], squares[1], squares[2], squares[3]};
+    narrow_squares(quadrants, n, c);
+    rotate_squares(morton, quadrants, n / 2);
+  }
+}
+
+// Rotates the pieces numbered [`begin`, `end`). Piece p follows base-4
+// digit l of p at level l of the recursion below the whole matrix, whose
+// quadrants form the first 4-cycle
+static void rotate_morton_pieces(void *arg, size_t begin, size_t end) {
+  const struct morton_s *morton = arg;
+  const bits_t top = morton->size / 2;
+
+  for (size_t p = begin; p < end; p++) {
+    ROW_TYPE *squares[4] = {morton->dst, morton->dst, morton->dst,
+                            morton->dst};
+    narrow_squares(squares, morton->size, 0);
+
+    bits_t n = top;
+    size_t digits = p;
+    for (int l = 0; l < morton->levels; l++, n /= 2, digits /= 4) {
+      narrow_squares(squares, n, digits % 4);
+    }
+    rotate_squares(morton, squares, n);
+  }
+}
+
+void rotate_morton(uint8_t *tiles, const bits_t N) {
+  // Sanity check the input
+  assert(tiles);
+  assert(is_morton_size(N));
+
+  const bits_t size = N >> LOG_BASE;
+  struct morton_s morton = {
+      .dst = (ROW_TYPE *)tiles,
+      .size = size,
+      .transpose = get_transpose_fn(),
+  };
+
+  // a single tile is its own 4-cycle
+  if (size == 1) {
+    ROW_TYPE block[BASE];
+    morton.transpose(morton.dst);
+    memcpy(block, morton.dst, sizeof(block));
+    for (int k = 0; k < BASE; ++k) {
+      morton.dst[k] = block[LAST_BASE_INDEX - k];
+    }
+    return;
+  }
+
+  // unroll as many levels as there are below the first 4-cycle
+  size_t npieces = 1;
+  for (bits_t n = size / 2; n > 1 && morton.levels < PARALLEL_LEVELS; n /= 2) {
+    morton.levels++;
+    npieces *= 4;
+  }
+  parallel_for(npieces, rotate_morton_pieces, &morton);
+}
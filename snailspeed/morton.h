@@ -0,0 +1,48 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef MORTON_H
+#define MORTON_H
+
+#include "../utils/utils.h"
+
+// Morton (Z-order) tiled storage. An `N` by `N` bit matrix is cut into 64 by
+// 64 tiles of 512 contiguous bytes, like the tile-major layout, but the tiles
+// are ordered along a Z curve: every quadrant of every level is one
+// contiguous quarter of its parent. `N` / 64 must be a power of two
+
+// Copies the row-major `N` by `N` bit matrix `src`, as read by
+// `read_binary_bmp`, into the Morton-ordered buffer `tiles`. The buffers
+// must not overlap
+void bit_matrix_to_morton(const uint8_t *src, uint8_t *tiles, const bits_t N);
+
+// Copies the Morton-ordered `N` by `N` bit matrix `tiles` into the row-major
+// buffer `dst`, ready for `write_binary_bmp`. The buffers must not overlap
+void morton_to_bit_matrix(const uint8_t *tiles, uint8_t *dst, const bits_t N);
+
+// Rotates the Morton-ordered `N` by `N` bit matrix `tiles` clockwise 90
+// degrees in place. The quadrants that trade places are split recursively
+// down to single tiles, so every level of the cache sees a working set that
+// fits it without any tuning
+void rotate_morton(uint8_t *tiles, const bits_t N);
+
+#endif  // MORTON_H
@@ -0,0 +1,393 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./pipeline.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "../utils/fasttime.h"
+#include "../utils/libbmp.h"
+#include "./rotate.h"
+#include "./thread_pool.h"
+#include "./transpose.h"
+
+// threads per stage when nothing is set. Rotations spread over the
+// SNAILSPEED_THREADS pool themselves, so one worker keeps it busy
+#define DEFAULT_READERS 2
+#define DEFAULT_ROTATORS 1
+#define DEFAULT_WRITERS 2
+
+// set from SNAILSPEED_BATCH_READERS, SNAILSPEED_BATCH_ROTATORS and
+// SNAILSPEED_BATCH_WRITERS at startup
+static size_t nreaders = DEFAULT_READERS;
+static size_t nrotators = DEFAULT_ROTATORS;
+static size_t nwriters = DEFAULT_WRITERS;
+
+__attribute__((constructor)) static void read_pipeline_settings(void) {
+  const char *readers = getenv("SNAILSPEED_BATCH_READERS");
+  if (readers && atoi(readers) > 0) {
+    nreaders = atoi(readers);
+  }
+  const char *rotators = getenv("SNAILSPEED_BATCH_ROTATORS");
+  if (rotators && atoi(rotators) > 0) {
+    nrotators = atoi(rotators);
+  }
+  const char *writers = getenv("SNAILSPEED_BATCH_WRITERS");
+  if (writers && atoi(writers) > 0) {
+    nwriters = atoi(writers);
+  }
+}
+
+// One image on its way through the stages, with the buffers it keeps
+// between files
+struct slot_s {
+  size_t index;
+  int width;
+  int height;
+  int row_size;
+  struct color_table_s color_tables[2];
+
+  // the image as read, and the destination of rectangular rotations
+  uint8_t *pixels;
+  size_t capacity;
+  uint8_t *rotated;
+  size_t rotated_capacity;
+};
+
+// A bounded queue of slots between two stages. It holds every slot at once,
+// so pushes never wait, and pops wait until a slot comes or every producer
+// has left
+struct queue_s {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+
+  struct slot_s **slots;
+  size_t capacity;
+  size_t head;
+  size_t count;
+
+  // producers still running
+  size_t producers;
+};
+
+static void init_queue(struct queue_s *queue, const size_t capacity,
+                       const size_t producers) {
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->ready, NULL);
+  queue->slots = malloc(capacity * sizeof(*queue->slots));
+  if (!queue->slots) {
+    printf("Error: Run out of heap space!\n");
+    assert(false);
+  }
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->count = 0;
+  queue->producers = producers;
+}
+
+static void destroy_queue(struct queue_s *queue) {
+  free(queue->slots);
+  pthread_cond_destroy(&queue->ready);
+  pthread_mutex_destroy(&queue->lock);
+}
+
+static void push(struct queue_s *queue, struct slot_s *slot) {
+  pthread_mutex_lock(&queue->lock);
+  assert(queue->count < queue->capacity);
+  queue->slots[(queue->head + queue->count++) % queue->capacity] = slot;
+  pthread_cond_signal(&queue->ready);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+// Returns the oldest slot of `queue`, or NULL once it is empty for good
+static struct slot_s *pop(struct queue_s *queue) {
+  pthread_mutex_lock(&queue->lock);
+  while (!queue->count && queue->producers) {
+    pthread_cond_wait(&queue->ready, &queue->lock);
+  }
+
+  struct slot_s *slot = NULL;
+  if (queue->count) {
+    slot = queue->slots[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  return slot;
+}
+
+// Called by each producer of `queue` as it leaves
+static void leave(struct queue_s *queue) {
+  pthread_mutex_lock(&queue->lock);
+  if (!--queue->producers) {
+    pthread_cond_broadcast(&queue->ready);
+  }
+  pthread_mutex_unlock(&queue->lock);
+}
+
+// everything the stages share
+struct pipeline_s {
+  const char *const *fnames;
+  size_t count;
+  const char *output_dir;
+
+  // the next file for a reader to take
+  size_t next;
+
+  // free slots, read images and rotated images
+  struct queue_s free;
+  struct queue_s read;
+  struct queue_s rotated;
+
+  // files that failed, and bytes of pixels read
+  size_t nfailed;
+  uint64_t nbytes;
+};
+
+static void fail(struct pipeline_s *pipeline, struct slot_s *slot) {
+  __atomic_fetch_add(&pipeline->nfailed, 1, __ATOMIC_RELAXED);
+  push(&pipeline->free, slot);
+}
+
+// Gives up on a pipeline missing a whole stage: the files no reader has
+// taken fail, and readers waiting for a free slot stop waiting
+static void abandon(struct pipeline_s *pipeline) {
+  const size_t taken =
+      __atomic_exchange_n(&pipeline->next, pipeline->count, __ATOMIC_RELAXED);
+  if (taken < pipeline->count) {
+    __atomic_fetch_add(&pipeline->nfailed, pipeline->count - taken,
+                       __ATOMIC_RELAXED);
+  }
+  leave(&pipeline->free);
+}
+
+// Reads the next files into free slots until none are left
+static void *read_files(void *arg) {
+  struct pipeline_s *pipeline = arg;
+
+  for (;;) {
+    const size_t index =
+        __atomic_fetch_add(&pipeline->next, 1, __ATOMIC_RELAXED);
+    if (index >= pipeline->count) {
+      break;
+    }
+
+    // No slot comes back once the pipeline is abandoned
+    struct slot_s *slot = pop(&pipeline->free);
+    if (!slot) {
+      __atomic_fetch_add(&pipeline->nfailed, 1, __ATOMIC_RELAXED);
+      break;
+    }
+    slot->index = index;
+    if (!read_binary_bmp_into(pipeline->fnames[index], &slot->pixels,
+                              &slot->capacity, &slot->width, &slot->height,
+                              &slot->row_size, slot->color_tables)) {
+      fail(pipeline, slot);
+      continue;
+    }
+
+    __atomic_fetch_add(&pipeline->nbytes,
+                       (uint64_t)slot->height * slot->row_size,
+                       __ATOMIC_RELAXED);
+    push(&pipeline->read, slot);
+  }
+
+  leave(&pipeline->read);
+  return NULL;
+}
+
+// Rotates read images. Squares turn in place, rectangles into the second
+// buffer of their slot, which then swaps with the first
+static void *rotate_files(void *arg) {
+  struct pipeline_s *pipeline = arg;
+
+  struct slot_s *slot;
+  while ((slot = pop(&pipeline->read))) {
+    const bits_t width = slot->width;
+    const bits_t height = slot->height;
+
+    if (width == height) {
+      rotate_bit_matrix(slot->pixels, width);
+
+    } else if (width % BASE == 0 && height % BASE == 0) {
+      const size_t image_size = height * slot->row_size;
+      if (image_size > slot->rotated_capacity) {
+        free_bit_matrix(slot->rotated);
+        slot->rotated = alloc_bit_matrix(image_size);
+        slot->rotated_capacity = slot->rotated ? image_size : 0;
+        if (!slot->rotated) {
+          printf("Error: Run out of heap space!\n");
+          fail(pipeline, slot);
+          continue;
+        }
+      }
+      rotate_bit_matrix_rect(slot->pixels, slot->rotated, height, width);
+
+      uint8_t *pixels = slot->pixels;
+      const size_t capacity = slot->capacity;
+      slot->pixels = slot->rotated;
+      slot->capacity = slot->rotated_capacity;
+      slot->rotated = pixels;
+      slot->rotated_capacity = capacity;
+
+    } else {
+      printf("Error: Cannot rotate the %zux%zu image %s, whose sides are not "
+             "equal or multiples of %d\n", width, height,
+             pipeline->fnames[slot->index], BASE);
+      fail(pipeline, slot);
+      continue;
+    }
+
+    push(&pipeline->rotated, slot);
+  }
+
+  leave(&pipeline->rotated);
+  return NULL;
+}
+
+// Writes rotated images to `output_dir`, under the name of their input
+static void *write_files(void *arg) {
+  struct pipeline_s *pipeline = arg;
+  char *output_fname = NULL;
+  size_t output_capacity = 0;
+
+  struct slot_s *slot;
+  while ((slot = pop(&pipeline->rotated))) {
+    const char *fname = pipeline->fnames[slot->index];
+    const char *base = strrchr(fname, '/') ? strrchr(fname, '/') + 1 : fname;
+
+    const size_t length = strlen(pipeline->output_dir) + 1 + strlen(base) + 1;
+    if (length > output_capacity) {
+      free(output_fname);
+      output_fname = malloc(length);
+      output_capacity = length;
+      if (!output_fname) {
+        printf("Error: Run out of heap space!\n");
+        assert(false);
+      }
+    }
+    snprintf(output_fname, length, "%s/%s", pipeline->output_dir, base);
+
+    // The rotation swaps the sides
+    if (write_binary_bmp_rect(output_fname, slot->pixels, slot->color_tables,
+                              slot->height, slot->width, parallel_for)) {
+      push(&pipeline->free, slot);
+    } else {
+      fail(pipeline, slot);
+    }
+  }
+
+  free(output_fname);
+  return NULL;
+}
+
+bool rotate_bmp_files(const char *const *fnames, const size_t count,
+                      const char *output_dir, struct pipeline_stats_s *stats) {
+  // Sanity check the input
+  assert(fnames);
+  assert(output_dir);
+  assert(stats);
+
+  // Enough slots for every thread to hold one with one more waiting in
+  // front of each stage
+  const size_t nslots = nreaders + nrotators + nwriters + 3;
+  struct slot_s *slots = calloc(nslots, sizeof(*slots));
+  if (!slots) {
+    printf("Error: Run out of heap space!\n");
+    assert(false);
+  }
+
+  struct pipeline_s pipeline = {
+      .fnames = fnames,
+      .count = count,
+      .output_dir = output_dir,
+  };
+  // Every slot comes back to `free`, so readers always wait for one
+  init_queue(&pipeline.free, nslots, 1);
+  init_queue(&pipeline.read, nslots, nreaders);
+  init_queue(&pipeline.rotated, nslots, nrotators);
+  for (size_t s = 0; s < nslots; s++) {
+    push(&pipeline.free, &slots[s]);
+  }
+
+  const size_t nthreads = nreaders + nrotators + nwriters;
+  pthread_t *threads = malloc(nthreads * sizeof(*threads));
+  bool *started = malloc(nthreads * sizeof(*started));
+  if (!threads || !started) {
+    printf("Error: Run out of heap space!\n");
+    assert(false);
+  }
+
+  // A thread that does not start leaves its stage's queue at once, and a
+  // stage left with no threads at all means the files cannot get through
+  const fasttime_t start = gettime();
+  size_t running[3] = {0, 0, 0};
+  for (size_t t = 0; t < nthreads; t++) {
+    const int stage = t < nreaders ? 0 : t < nreaders + nrotators ? 1 : 2;
+    void *(*stage_fn)(void *) = stage == 0   ? read_files
+                                : stage == 1 ? rotate_files
+                                             : write_files;
+    const int error = pthread_create(&threads[t], NULL, stage_fn, &pipeline);
+    started[t] = !error;
+    if (error) {
+      printf("Error: Cannot start a pipeline thread: %s\n", strerror(error));
+      if (stage == 0) {
+        leave(&pipeline.read);
+      } else if (stage == 1) {
+        leave(&pipeline.rotated);
+      }
+      continue;
+    }
+    running[stage]++;
+  }
+  if (!running[0] || !running[1] || !running[2]) {
+    abandon(&pipeline);
+  }
+  for (size_t t = 0; t < nthreads; t++) {
+    if (started[t]) {
+      pthread_join(threads[t], NULL);
+    }
+  }
+
+  // Images stranded in front of a stage that never ran failed too
+  pipeline.nfailed += pipeline.read.count + pipeline.rotated.count;
+
+  stats->nfiles = count;
+  stats->nfailed = pipeline.nfailed;
+  stats->nbytes = pipeline.nbytes;
+  stats->seconds = tdiff_sec(start, gettime());
+
+  for (size_t s = 0; s < nslots; s++) {
+    free_bit_matrix(slots[s].pixels);
+    free_bit_matrix(slots[s].rotated);
+  }
+  free(slots);
+  free(threads);
+  free(started);
+  destroy_queue(&pipeline.free);
+  destroy_queue(&pipeline.read);
+  destroy_queue(&pipeline.rotated);
+
+  return pipeline.nfailed == 0;
+}
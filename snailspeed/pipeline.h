@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "../utils/utils.h"
+
+// What a batch of files took
+struct pipeline_stats_s {
+  size_t nfiles;
+  size_t nfailed;
+
+  // bytes of pixels read, and the wall time of the whole batch
+  uint64_t nbytes;
+  double seconds;
+};
+
+// Rotates each of the `count` binary BMPs `fnames` clockwise 90 degrees into
+// a file of the same name in `output_dir`. Reader threads, rotation workers
+// and writer threads run side by side, handing images on through bounded
+// queues, so the disks and the CPUs are busy at once. A fixed set of image
+// buffers goes round the stages and is only grown, never freed, between
+// files. Square images of any size work, as do rectangles whose sides are
+// multiples of 64. The stage sizes come from SNAILSPEED_BATCH_READERS,
+// SNAILSPEED_BATCH_ROTATORS and SNAILSPEED_BATCH_WRITERS.
+//
+// Returns `true` if every file was rotated
+bool rotate_bmp_files(const char *const *fnames, const size_t count,
+                      const char *output_dir, struct pipeline_stats_s *stats);
+
+#endif  // PIPELINE_H
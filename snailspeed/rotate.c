@@ -20,67 +20,140 @@
  * IN THE SOFTWARE.
  **/
 
-#include "../utils/utils.h"
-
-#define BASE 64
-#define LAST_BASE_INDEX BASE - 1
-#define LOG_BASE 6
-
-#define ROW_TYPE uint64_t
-
-#define SWAP_WITHIN_BYTES(row_1, row_2, shift, mask)\
- do {\
-   ROW_TYPE temp = ((row_1) ^ ((row_2) >> (shift))) & (mask);\
-    (row_1) = (row_1) ^ (temp);\
-     (row_2) = (row_2) ^ ((temp) << (shift));\
- } while(0)
-
-#define SWAP_BYTES(row_1, row_2, shift, mask)\
- do {\
- ROW_TYPE temp = ((row_1) ^ ((row_2) << (shift))) & (mask);\
-  (row_1) = (row_1) ^ (temp);\
-   (row_2) = (row_2) ^ ((temp) >> (shift));\
-   } while(0)
-
-static void transpose_64(uint64_t *img) {
-  // Transposes the 64x64 bit image by transposing submatrices of the image inward
- 
-  ROW_TYPE mask = 0xFFFFFFFF00000000;
-
-  int shift = BASE >> 1, k, index_for_swap;
-  
-  // Handles the swaps for >= 8 bits (1 byte), to account for little endianness of machine
-  while (shift != 4) {
-    for (k = 0; k < BASE; k += shift<<1) {
-      for (index_for_swap = k; index_for_swap < shift + k; index_for_swap++) {
-        SWAP_BYTES(*(img + (index_for_swap + shift)), *(img + index_for_swap), shift, mask);
-      } 
-    }
-    shift >>= 1;
-    mask ^= mask >> shift;
+#include "./rotate.h"
+
+#include <string.h>
+
+#include "./thread_pool.h"
+#include "./transpose.h"
+
+// blocks per super-tile side. 8 words of a row fill a 64-byte cache line
+#define SUPER_TILE 8
+
+// how many 4-cycles ahead to prefetch when nothing is set. Off by default
+// since it has to be tuned to the machine's memory latency
+#define DEFAULT_PREFETCH_DISTANCE 0
+
+// set from SNAILSPEED_SUPERTILE at startup and by `set_super_tiles`. Only
+// touched atomically, since rotations may run on many threads
+static bool use_super_tiles = false;
+
+// set from SNAILSPEED_PREFETCH at startup and by `set_prefetch_distance`;
+// 0 turns prefetching off. Only touched atomically
+static size_t prefetch_distance = DEFAULT_PREFETCH_DISTANCE;
+
+__attribute__((constructor)) static void read_rotate_settings(void) {
+  const char* super_tiles = getenv("SNAILSPEED_SUPERTILE");
+  use_super_tiles = super_tiles && strcmp(super_tiles, "0");
+
+  const char* distance = getenv("SNAILSPEED_PREFETCH");
+  if (distance) {
+    prefetch_distance = atoi(distance) > 0 ? atoi(distance) : 0;
   }
+}
 
-  mask >>= shift;
-  // Swaps within single bytes, where endianness does not matter
-  while (shift != 0) {
-    for (k = 0; k < BASE; k += shift<<1) {
-       for (index_for_swap = k; index_for_swap < shift + k; index_for_swap++) {
-        SWAP_WITHIN_BYTES(*(img + (index_for_swap + shift)), *(img + index_for_swap), shift, mask);
-      }
-    }
-    shift >>= 1;
-    mask ^= mask << shift;
+bool get_super_tiles(void) {
+  return __atomic_load_n(&use_super_tiles, __ATOMIC_RELAXED);
+}
+
+void set_super_tiles(const bool enabled) {
+  __atomic_store_n(&use_super_tiles, enabled, __ATOMIC_RELAXED);
+}
+
+size_t get_prefetch_distance(void) {
+  return __atomic_load_n(&prefetch_distance, __ATOMIC_RELAXED);
+}
+
+void set_prefetch_distance(const size_t distance) {
+  __atomic_store_n(&prefetch_distance, distance, __ATOMIC_RELAXED);
+}
+
+// everything a worker needs to rotate its share of the 4-cycles
+struct rotation_s {
+  ROW_TYPE* img_64;
+  bits_t N;
+  bits_t size;
+
+  // number of 4-cycles; the center block of an odd `size` comes after them
+  size_t ncycles;
+
+  // super-tiles along j of the top-left quadrant, and how many there are;
+  // the center block of an odd `size` comes after them
+  size_t super_tiles_per_row;
+  size_t nsuper_tiles;
+
+  // the kernel picked at startup for this machine
+  transpose_fn_t transpose;
+
+  // 4-cycles to prefetch ahead, read once per rotation
+  size_t prefetch_distance;
+};
+
+// Rotates the center block of an odd `size` in place
+static void rotate_center_block(const struct rotation_s* rotation) {
+  const bits_t size = rotation->size;
+  ROW_TYPE block_1[BASE];
+
+  ROW_TYPE column_index = size >> 1;
+  ROW_TYPE row_index = (size >> 1) << LOG_BASE;
+  ROW_TYPE* block_1_img_pointer = rotation->img_64 + row_index * size + column_index;
+
+  for(int k = 0; k < BASE; ++k) {
+    block_1[k] = *(block_1_img_pointer + size * k);
+  }
+  
+  rotation->transpose(block_1);
+
+  for(int k = 0; k < BASE; ++k) {
+    *(block_1_img_pointer + size * k) = block_1[LAST_BASE_INDEX - k];
   }
+}
+
+// Prefetches every row of the four blocks of 4-cycle `t` for writing. The
+// column-walking blocks 2 and 4 jump a whole block row at a time, which the
+// hardware prefetchers do not follow
+static inline void prefetch_cycle(const struct rotation_s* rotation, size_t t) {
+  ROW_TYPE* img_64 = rotation->img_64;
+  const bits_t N = rotation->N;
+  const bits_t size = rotation->size;
+  const bits_t i = t / (size / 2);
+  const bits_t j = t % (size / 2);
 
+  ROW_TYPE* block_1_img_pointer = img_64 + i * N + j;
+  ROW_TYPE* block_2_img_pointer = img_64 + j * N + size - 1 - i;
+  ROW_TYPE* block_3_img_pointer = img_64 + (size - 1 - i) * N + size - 1 - j;
+  ROW_TYPE* block_4_img_pointer = img_64 + (size - 1 - j) * N + i;
+
+  for(int k = 0; k < BASE; ++k) {
+    __builtin_prefetch(block_1_img_pointer + size * k, 1);
+    __builtin_prefetch(block_2_img_pointer + size * k, 1);
+    __builtin_prefetch(block_3_img_pointer + size * k, 1);
+    __builtin_prefetch(block_4_img_pointer + size * k, 1);
+  }
 }
 
-// Rotates a bit array clockwise 90 degrees.
+// Rotates the 4-cycles of blocks numbered [`begin`, `end`).
 //
-// The bit array is of `N` by `N` bits where N is a multiple of 64
-void rotate_bit_matrix(uint8_t* restrict img, const bits_t N) {
+// Cycle t starts at block row i = t / (size / 2) and block column
+// j = t % (size / 2) of the top-left quadrant, and every cycle touches a
+// disjoint quadruple of blocks, so ranges can run concurrently
+static void rotate_cycles(void* arg, size_t begin, size_t end) {
+  const struct rotation_s* rotation = arg;
+  ROW_TYPE* img_64 = rotation->img_64;
+  const bits_t N = rotation->N;
+  const bits_t size = rotation->size;
+  const bits_t half = size / 2;
+  const transpose_fn_t transpose = rotation->transpose;
+  const size_t prefetch_distance = rotation->prefetch_distance;
 
-  // just changing to pointer to achieve larger rows
-  ROW_TYPE* img_64 = (ROW_TYPE*) img;
+  // only real 4-cycles of this range are prefetched. The ones within
+  // `prefetch_distance` of `begin` are requested up front
+  const size_t prefetch_end = end < rotation->ncycles ? end : rotation->ncycles;
+  if (prefetch_distance) {
+    for (size_t t = begin + 1; t < begin + prefetch_distance && t < prefetch_end; t++) {
+      prefetch_cycle(rotation, t);
+    }
+  }
 
   // in these, we store BASExBASE blocks that need to be
   // rotated and cyclicly swapped
@@ -89,77 +162,168 @@ void rotate_bit_matrix(uint8_t* restrict img, const bits_t N) {
   ROW_TYPE block_3[BASE]; 
   ROW_TYPE block_4[BASE];
 
-  // each of these corresponds to a pointer to the first
-  // row of each of the blocks we want to rotate/swap
-  ROW_TYPE *block_1_img_pointer;
-  ROW_TYPE *block_2_img_pointer;
-  ROW_TYPE *block_3_img_pointer;
-  ROW_TYPE *block_4_img_pointer;
-  const bits_t size = N >> LOG_BASE;
-
-  // these are the pointers to reset the above ones
-  // after the second loop
-  ROW_TYPE* new_blocks_row_pointer_1 = img_64;
-  ROW_TYPE* new_blocks_row_pointer_2 = img_64 + size - 1;
-  ROW_TYPE* new_blocks_row_pointer_3 = img_64 + (N - BASE) * size + size - 1;
-  ROW_TYPE* new_blocks_row_pointer_4 = img_64 + (N - BASE) * size;
-
-  for(int i = 0; i < (size + 1) / 2; i++) { // looping through blocks of rows
-
-      block_1_img_pointer = new_blocks_row_pointer_1;
-      block_2_img_pointer = new_blocks_row_pointer_2;
-      block_3_img_pointer = new_blocks_row_pointer_3;
-      block_4_img_pointer = new_blocks_row_pointer_4;
-
-  // changing which row of block we are focusing on
-      new_blocks_row_pointer_1 += N;
-      new_blocks_row_pointer_2--;
-      new_blocks_row_pointer_3 -= N;
-      new_blocks_row_pointer_4++;
-
-    for(int j = 0; j < (size / 2); j++) {
-
-      for(int k = 0; k < BASE; ++k){ // filling up each block
-        block_1[k] = *(block_1_img_pointer + size * k);
-        block_2[k] = *(block_2_img_pointer + size * k);
-        block_3[k] = *(block_3_img_pointer + size * k);
-        block_4[k] = *(block_4_img_pointer + size * k);
-      }
-      
-      transpose_64(block_1);
-      transpose_64(block_2);
-      transpose_64(block_3);
-      transpose_64(block_4);
-
-      for(int k = 0; k < BASE; ++k) { 
-        // putting blocks back in reverse order after transpose to achieve rotation
-        *(block_2_img_pointer + size * k) = block_1[LAST_BASE_INDEX - k];
-        *(block_3_img_pointer + size * k) = block_2[LAST_BASE_INDEX - k];
-        *(block_4_img_pointer + size * k) = block_3[LAST_BASE_INDEX - k];
-        *(block_1_img_pointer + size * k) = block_4[LAST_BASE_INDEX - k];
-      }
-      
-      // changing which block in the block row we are focusing on
-      block_1_img_pointer += 1;
-      block_2_img_pointer += N;
-      block_3_img_pointer -= 1;
-      block_4_img_pointer -= N;
+  for (size_t t = begin; t < end; t++) {
+    if (t == rotation->ncycles) {
+      rotate_center_block(rotation);
+      continue;
     }
-  }
-  if(size & 1) {
-    ROW_TYPE column_index = size >> 1;
-    ROW_TYPE row_index = (size >> 1) << LOG_BASE;
-    block_1_img_pointer = img_64 + row_index * size + column_index;
 
-    for(int k = 0; k < BASE; ++k) {
+    const bits_t i = t / half;
+    const bits_t j = t % half;
+
+    // each of these corresponds to a pointer to the first
+    // row of each of the blocks we want to rotate/swap
+    ROW_TYPE* block_1_img_pointer = img_64 + i * N + j;
+    ROW_TYPE* block_2_img_pointer = img_64 + j * N + size - 1 - i;
+    ROW_TYPE* block_3_img_pointer = img_64 + (size - 1 - i) * N + size - 1 - j;
+    ROW_TYPE* block_4_img_pointer = img_64 + (size - 1 - j) * N + i;
+
+    for(int k = 0; k < BASE; ++k){ // filling up each block
       block_1[k] = *(block_1_img_pointer + size * k);
+      block_2[k] = *(block_2_img_pointer + size * k);
+      block_3[k] = *(block_3_img_pointer + size * k);
+      block_4[k] = *(block_4_img_pointer + size * k);
+    }
+
+    // the next quadruple streams in while this one is transposed
+    if (prefetch_distance && t + prefetch_distance < prefetch_end) {
+      prefetch_cycle(rotation, t + prefetch_distance);
     }
     
-    transpose_64(block_1);
+    transpose(block_1);
+    transpose(block_2);
+    transpose(block_3);
+    transpose(block_4);
+
+    for(int k = 0; k < BASE; ++k) { 
+      // putting blocks back in reverse order after transpose to achieve rotation
+      *(block_2_img_pointer + size * k) = block_1[LAST_BASE_INDEX - k];
+      *(block_3_img_pointer + size * k) = block_2[LAST_BASE_INDEX - k];
+      *(block_4_img_pointer + size * k) = block_3[LAST_BASE_INDEX - k];
+      *(block_1_img_pointer + size * k) = block_4[LAST_BASE_INDEX - k];
+    }
+  }
+}
+
+// Rotates the super-tiles numbered [`begin`, `end`).
+//
+// A super-tile is up to SUPER_TILE x SUPER_TILE 4-cycles of the top-left
+// quadrant. Every block row i of it is handled as one strip of up to
+// SUPER_TILE cycles, so the row-walking blocks 1 and 3 are read and written
+// a whole cache line at a time. The column-walking blocks 2 and 4 of
+// neighbouring i share cache lines instead, and those lines stay in cache
+// because the super-tile finishes its SUPER_TILE rows before moving on
+static void rotate_super_tiles(void* arg, size_t begin, size_t end) {
+  const struct rotation_s* rotation = arg;
+  ROW_TYPE* img_64 = rotation->img_64;
+  const bits_t N = rotation->N;
+  const bits_t size = rotation->size;
+  const bits_t half = size / 2;
+  const bits_t block_rows = (size + 1) / 2;
+  const transpose_fn_t transpose = rotation->transpose;
+
+  // one strip of blocks per quadrant
+  ROW_TYPE strip_1[SUPER_TILE][BASE];
+  ROW_TYPE strip_2[SUPER_TILE][BASE];
+  ROW_TYPE strip_3[SUPER_TILE][BASE];
+  ROW_TYPE strip_4[SUPER_TILE][BASE];
 
-    for(int k = 0; k < BASE; ++k) {
-      *(block_1_img_pointer + size * k) = block_1[LAST_BASE_INDEX - k];
+  for (size_t s = begin; s < end; s++) {
+    if (s == rotation->nsuper_tiles) {
+      rotate_center_block(rotation);
+      continue;
     }
+
+    const bits_t i_begin = (s / rotation->super_tiles_per_row) * SUPER_TILE;
+    const bits_t j_begin = (s % rotation->super_tiles_per_row) * SUPER_TILE;
+    const bits_t i_end = i_begin + SUPER_TILE < block_rows ? i_begin + SUPER_TILE : block_rows;
+    const bits_t width = j_begin + SUPER_TILE < half ? SUPER_TILE : half - j_begin;
+
+    for (bits_t i = i_begin; i < i_end; i++) {
+      // the first block of the strip in each quadrant. Strip 1 walks right,
+      // strip 2 down, strip 3 left and strip 4 up
+      ROW_TYPE* strip_1_img_pointer = img_64 + i * N + j_begin;
+      ROW_TYPE* strip_2_img_pointer = img_64 + j_begin * N + size - 1 - i;
+      ROW_TYPE* strip_3_img_pointer = img_64 + (size - 1 - i) * N + size - 1 - j_begin;
+      ROW_TYPE* strip_4_img_pointer = img_64 + (size - 1 - j_begin) * N + i;
+
+      for (int k = 0; k < BASE; ++k) { // whole lines of strips 1 and 3
+        for (bits_t jj = 0; jj < width; jj++) {
+          strip_1[jj][k] = *(strip_1_img_pointer + size * k + jj);
+          strip_3[jj][k] = *(strip_3_img_pointer + size * k - jj);
+        }
+      }
+      for (bits_t jj = 0; jj < width; jj++) {
+        for (int k = 0; k < BASE; ++k) {
+          strip_2[jj][k] = *(strip_2_img_pointer + jj * N + size * k);
+          strip_4[jj][k] = *(strip_4_img_pointer - jj * N + size * k);
+        }
+      }
+
+      for (bits_t jj = 0; jj < width; jj++) {
+        transpose(strip_1[jj]);
+        transpose(strip_2[jj]);
+        transpose(strip_3[jj]);
+        transpose(strip_4[jj]);
+      }
+
+      // putting blocks back in reverse order after transpose to achieve rotation
+      for (int k = 0; k < BASE; ++k) {
+        for (bits_t jj = 0; jj < width; jj++) {
+          *(strip_1_img_pointer + size * k + jj) = strip_4[jj][LAST_BASE_INDEX - k];
+          *(strip_3_img_pointer + size * k - jj) = strip_2[jj][LAST_BASE_INDEX - k];
+        }
+      }
+      for (bits_t jj = 0; jj < width; jj++) {
+        for (int k = 0; k < BASE; ++k) {
+          *(strip_2_img_pointer + jj * N + size * k) = strip_1[jj][LAST_BASE_INDEX - k];
+          *(strip_4_img_pointer - jj * N + size * k) = strip_3[jj][LAST_BASE_INDEX - k];
+        }
+      }
+    }
+  }
+}
+
+// Rotates a bit array clockwise 90 degrees.
+//
+// The bit array is of `N` by `N` bits. When N is a multiple of 64 the
+// 4-cycles are spread over SNAILSPEED_THREADS threads, one at a time or in
+// super-tiles if SNAILSPEED_SUPERTILE is set
+void rotate_bit_matrix(uint8_t* restrict img, const bits_t N) {
+  if (N % BASE) {
+    rotate_bit_matrix_ragged(img, N);
+    return;
+  }
+
+  // the fixed kernels have no super-tile or prefetch variants, so asking
+  // for either keeps the general path
+  const bool super_tiles = get_super_tiles();
+  const size_t distance = get_prefetch_distance();
+  if (!super_tiles && !distance &&
+      rotate_bit_matrix_fixed(img, N, 0)) {
+    return;
+  }
+
+  const bits_t size = N >> LOG_BASE;
+
+  struct rotation_s rotation = {
+    // just changing to pointer to achieve larger rows
+    .img_64 = (ROW_TYPE*) img,
+    .N = N,
+    .size = size,
+    // the top-left quadrant is (size + 1) / 2 block rows by size / 2 blocks
+    .ncycles = ((size + 1) / 2) * (size / 2),
+    .super_tiles_per_row = (size / 2 + SUPER_TILE - 1) / SUPER_TILE,
+    .transpose = get_transpose_fn(),
+    .prefetch_distance = distance,
+  };
+  rotation.nsuper_tiles = rotation.super_tiles_per_row *
+                          (((size + 1) / 2 + SUPER_TILE - 1) / SUPER_TILE);
+
+  if (super_tiles) {
+    parallel_for(rotation.nsuper_tiles + (size & 1), rotate_super_tiles, &rotation);
+  } else {
+    parallel_for(rotation.ncycles + (size & 1), rotate_cycles, &rotation);
   }
 
   return;
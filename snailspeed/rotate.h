@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef ROTATE_H
+#define ROTATE_H
+
+#include "../utils/utils.h"
+
+// Rotates the `N` by `N` bit matrix `img` clockwise 90 degrees in place.
+// Rows are `bits_to_bytes(N)` bytes, so any `N` works. Sizes with a kernel
+// in `rotate_bit_matrix_fixed` use it, other multiples of 64 take the block
+// path and the rest `rotate_bit_matrix_ragged`
+void rotate_bit_matrix(uint8_t *img, const bits_t N);
+
+// Returns whether `rotate_bit_matrix` walks multiples of 64 in 8x8 groups of
+// 4-cycles. Starts from SNAILSPEED_SUPERTILE
+bool get_super_tiles(void);
+
+// Sets whether `rotate_bit_matrix` walks multiples of 64 in 8x8 groups of
+// 4-cycles, from the next rotation on
+void set_super_tiles(const bool enabled);
+
+// Returns how many 4-cycles ahead `rotate_bit_matrix` prefetches, 0 for
+// none. Starts from SNAILSPEED_PREFETCH
+size_t get_prefetch_distance(void);
+
+// Sets how many 4-cycles ahead `rotate_bit_matrix` prefetches, from the next
+// rotation on
+void set_prefetch_distance(const size_t distance);
+
+// Rotates the `N` by `N` bit matrix `img` clockwise 90 degrees in place for
+// any `N`, with rows of `bits_to_bytes(N)` bytes. Tiles that straddle the
+// edge of the matrix are read with funnel shifts and written with masks, so
+// the padding bits at the end of each row are left alone
+void rotate_bit_matrix_ragged(uint8_t *img, const bits_t N);
+
+// Rotates the `N` by `N` bit matrix `img` clockwise 90 degrees in place with
+// a kernel compiled for this `N` and for square tiles of `tile` bits (32,
+// 64, 128 or 256, or 0 for the one `rotate_bit_matrix` uses). Kernels exist
+// for N of 1024, 2048, 4096 and 8192. Returns false, leaving `img` alone,
+// when there is none
+bool rotate_bit_matrix_fixed(uint8_t *img, const bits_t N, bits_t tile);
+
+// Returns the tile width `rotate_bit_matrix` uses for the fixed kernels of
+// size `N` on the current number of threads: the widest that still gives
+// every thread a few 4-cycles, and never narrower than 64 bits. Returns 0
+// when there is no kernel for `N`
+bits_t get_fixed_tile(const bits_t N);
+
+// Rotates each of the `count` distinct `N` by `N` bit matrices `imgs`
+// clockwise 90 degrees in place. For multiples of 64 up to 256, groups of 4
+// matrices share every vector transpose, one matrix per lane, and the groups
+// are spread over SNAILSPEED_THREADS threads. Other sizes are rotated one by
+// one
+void rotate_bit_matrix_batch(uint8_t **imgs, const size_t count,
+                             const bits_t N);
+
+// Rotates the `N` by `N` bit matrix `src` clockwise 90 degrees into `dst`,
+// leaving `src` intact in a single pass. `N` is a multiple of 64 and the
+// buffers must not overlap. Written like `rotate_bit_matrix_rect`
+void rotate_bit_matrix_copy(const uint8_t *src, uint8_t *dst, const bits_t N);
+
+// Rotates the `rows` by `cols` bit matrix `src` clockwise 90 degrees into
+// the `cols` by `rows` bit matrix `dst`. Both dimensions are multiples of 64
+// and the buffers must not overlap. Large, cache-line aligned outputs whose
+// rows are a multiple of 512 bits are written with non-temporal stores
+void rotate_bit_matrix_rect(const uint8_t *src, uint8_t *dst,
+                            const bits_t rows, const bits_t cols);
+
+// Rotates the `rows` by `cols` bit matrix `img` clockwise 90 degrees in
+// place, leaving a `cols` by `rows` bit matrix in the same buffer. Both
+// dimensions are multiples of 64. Uses one block row of scratch memory
+void rotate_bit_matrix_rect_inplace(uint8_t *img, const bits_t rows,
+                                    const bits_t cols);
+
+// Applies `orientation` to the `N` by `N` bit matrix `img` in place in a
+// single pass. `N` is a multiple of 64. Flips and 180 degrees only reverse
+// words and bits; the others transpose each block once
+void transform_bit_matrix(uint8_t *img, const bits_t N,
+                          const enum orientation_e orientation);
+
+// Returns the orientation that applies `first` and then `second`. The eight
+// orientations form a group, so any sequence of them reduces to one: four
+// clockwise turns are the identity, a turn and a flip are a transpose
+enum orientation_e compose_orientations(const enum orientation_e first,
+                                        const enum orientation_e second);
+
+// Returns a readable name for `orientation`
+const char *get_orientation_name(const enum orientation_e orientation);
+
+#endif  // ROTATE_H
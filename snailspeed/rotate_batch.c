@@ -0,0 +1,154 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./rotate.h"
+
+#include "./thread_pool.h"
+#include "./transpose.h"
+
+// matrices rotated side by side, one per 64-bit lane of a ymm register
+#define LANES 4
+
+// largest matrix, in blocks per side, worth batching. Past it the LANES
+// matrices of a group no longer fit in L1 together, and the per-call
+// overhead the batch saves is small next to the rotation itself
+#define MAX_BATCH_SIZE 4
+
+// one interleaved row, built in a register so the kernel's vector loads
+// are not held up waiting on LANES separate scalar stores
+typedef ROW_TYPE lanes_t __attribute__((vector_size(LANES * sizeof(ROW_TYPE))));
+
+// everything a worker needs to rotate its share of a batch
+struct batch_rotation_s {
+  uint8_t **imgs;
+  size_t count;
+  bits_t N;
+  bits_t size;
+
+  // number of 4-cycles of each matrix; the center block of an odd `size`
+  // comes after them
+  size_t ncycles;
+
+  // the kernel for LANES interleaved blocks picked at startup
+  transpose_fn_t transpose_x4;
+};
+
+// Rotates the groups of LANES matrices numbered [`begin`, `end`).
+//
+// Every matrix of a group walks the same 4-cycles as `rotate_bit_matrix`,
+// in lockstep. Block b of each matrix is gathered into lane m of the
+// interleaved buffer `blocks[b]`, so one vector transpose handles the same
+// block of all LANES matrices. A short last group repeats its first matrix
+// in the empty lanes and never stores them
+static void rotate_batch_groups(void *arg, size_t begin, size_t end) {
+  const struct batch_rotation_s *batch = arg;
+  const bits_t N = batch->N;
+  const bits_t size = batch->size;
+  const bits_t half = size / 2;
+
+  // one interleaved buffer per block of a 4-cycle
+  ROW_TYPE blocks[4][LANES * BASE] __attribute__((aligned(32)));
+
+  for (size_t g = begin; g < end; g++) {
+    const size_t first = g * LANES;
+    const int lanes =
+        batch->count - first < LANES ? batch->count - first : LANES;
+
+    ROW_TYPE *img_64[LANES];
+    for (int m = 0; m < LANES; m++) {
+      img_64[m] = (ROW_TYPE *)batch->imgs[first + (m < lanes ? m : 0)];
+    }
+
+    for (size_t t = 0; t <= batch->ncycles; t++) {
+      // the word offsets of the blocks of cycle t, or of the center block
+      size_t offsets[4];
+      int nblocks = 4;
+
+      if (t == batch->ncycles) {
+        if (!(size & 1)) {
+          break;
+        }
+        offsets[0] = (half << LOG_BASE) * size + half;
+        nblocks = 1;
+      } else {
+        const bits_t i = t / half;
+        const bits_t j = t % half;
+        offsets[0] = i * N + j;
+        offsets[1] = j * N + size - 1 - i;
+        offsets[2] = (size - 1 - i) * N + size - 1 - j;
+        offsets[3] = (size - 1 - j) * N + i;
+      }
+
+      for (int k = 0; k < BASE; ++k) {
+        for (int b = 0; b < nblocks; b++) {
+          const size_t offset = offsets[b] + size * k;
+          *(lanes_t *)(blocks[b] + LANES * k) =
+              (lanes_t){img_64[0][offset], img_64[1][offset],
+                        img_64[2][offset], img_64[3][offset]};
+        }
+      }
+
+      for (int b = 0; b < nblocks; b++) {
+        batch->transpose_x4(blocks[b]);
+      }
+
+      // block b goes where block b + 1 was, in reverse row order to
+      // complete the rotation
+      for (int k = 0; k < BASE; ++k) {
+        for (int b = 0; b < nblocks; b++) {
+          const size_t offset = offsets[(b + 1) % nblocks] + size * k;
+          for (int m = 0; m < lanes; m++) {
+            img_64[m][offset] = blocks[b][LANES * (LAST_BASE_INDEX - k) + m];
+          }
+        }
+      }
+    }
+  }
+}
+
+void rotate_bit_matrix_batch(uint8_t **imgs, const size_t count,
+                             const bits_t N) {
+  // Sanity check the input
+  assert(imgs);
+  assert(N > 0);
+
+  // the lanes need every matrix to be a whole number of blocks, and only
+  // pay off for small ones
+  if (N % BASE || N > MAX_BATCH_SIZE * BASE) {
+    for (size_t m = 0; m < count; m++) {
+      rotate_bit_matrix(imgs[m], N);
+    }
+    return;
+  }
+
+  const bits_t size = N >> LOG_BASE;
+  struct batch_rotation_s batch = {
+      .imgs = imgs,
+      .count = count,
+      .N = N,
+      .size = size,
+      .ncycles = ((size + 1) / 2) * (size / 2),
+      .transpose_x4 = get_transpose_x4_fn(),
+  };
+
+  parallel_for((count + LANES - 1) / LANES, rotate_batch_groups, &batch);
+}
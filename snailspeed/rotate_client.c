@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// A client of the rotation daemon started with `./rotate -t daemon -o
+// socket-path`. It sends the same shared memory image again and again and
+// reports how long the jobs took, the way a caller that keeps its buffers
+// would see them
+
+#include "./daemon.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../utils/fasttime.h"
+
+const bits_t DEFAULT_N = 8192;
+const size_t DEFAULT_JOBS = 64;
+
+static int compare_nsec(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a;
+  const uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Prints the smallest, median and largest of the `count` times `nsec`,
+// sorting them
+static void print_latency(const char *name, uint64_t *nsec,
+                          const size_t count) {
+  qsort(nsec, count, sizeof(*nsec), compare_nsec);
+  printf("%-10s min %8.1f us\tmedian %8.1f us\tmax %8.1f us\n", name,
+         nsec[0] / 1e3, nsec[count / 2] / 1e3, nsec[count - 1] / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+  const char *socket_path = NULL;
+  bits_t N = DEFAULT_N;
+  size_t jobs = DEFAULT_JOBS;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "hs:N:j:")) != -1) {
+    switch (opt) {
+      case 's':  // Daemon socket
+        socket_path = optarg;
+        break;
+
+      case 'N':  // Image dimension
+        N = strtoul(optarg, NULL, 10);
+        break;
+
+      case 'j':  // Number of jobs
+        jobs = strtoul(optarg, NULL, 10);
+        break;
+
+      default:
+        goto help;
+    }
+  }
+
+  if (optind < argc || socket_path == NULL || N == 0 || jobs == 0) {
+    goto help;
+  }
+
+  const size_t size = N * bits_to_bytes(N);
+  const int sock = connect_rotate_daemon(socket_path);
+  const int fd = create_rotate_job_memory(size);
+  if (sock < 0 || fd < 0) {
+    return 1;
+  }
+
+  uint8_t *img = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  uint8_t *original = generate_bit_matrix(N, false);
+  uint64_t *round_trip_nsec = malloc(jobs * sizeof(uint64_t));
+  uint64_t *job_nsec = malloc(jobs * sizeof(uint64_t));
+  uint64_t *transform_nsec = malloc(jobs * sizeof(uint64_t));
+  assert(img != MAP_FAILED && original && round_trip_nsec && job_nsec &&
+         transform_nsec);
+  memcpy(img, original, size);
+
+  // Every fourth clockwise turn brings the original back
+  bool correct = true;
+  for (size_t j = 0; j < jobs; j++) {
+    struct rotate_reply_s reply;
+    const fasttime_t start = gettime();
+    if (!submit_rotate_job(sock, fd, N, ORIENT_ROTATE_CW, &reply)) {
+      printf("Error: Job %zu failed with status %d\n", j, reply.status);
+      return 1;
+    }
+    round_trip_nsec[j] = tdiff_nsec(start, gettime());
+    job_nsec[j] = reply.job_nsec;
+    transform_nsec[j] = reply.transform_nsec;
+
+    if (j % 4 == 3) {
+      for (bits_t row = 0; row < N && correct; row++) {
+        for (bits_t column = 0; column < N; column++) {
+          correct = correct && get_bit(img, bits_to_bytes(N), column, row) ==
+                                   get_bit(original, bits_to_bytes(N),
+                                           column, row);
+        }
+      }
+    }
+  }
+
+  printf("%zu jobs rotating a %zux%zu image\n", jobs, N, N);
+  print_latency("round trip", round_trip_nsec, jobs);
+  print_latency("job", job_nsec, jobs);
+  print_latency("rotation", transform_nsec, jobs);
+  printf("Result: %s\n", correct ? "PASS" : "FAIL");
+
+  munmap(img, size);
+  close(fd);
+  close(sock);
+  free_bit_matrix(original);
+  free(round_trip_nsec);
+  free(job_nsec);
+  free(transform_nsec);
+
+  return correct ? 0 : 1;
+
+help:
+  printf(
+      "usage:\n"
+      "\t"
+      "-s socket-path            \t Socket of `./rotate -t daemon`        \t "
+      "Required\n"
+      "\t"
+      "-N dimension              \t Image dimension                       \t "
+      "Default is %zu\n"
+      "\t"
+      "-j jobs                   \t Number of rotations to send           \t "
+      "Default is %zu\n"
+      "\t"
+      "-h                        \t This help message\n",
+      DEFAULT_N, DEFAULT_JOBS);
+
+  return 1;
+}
@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./rotate_file.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../utils/libbmp.h"
+#include "./thread_pool.h"
+#include "./transpose.h"
+#include "./view.h"
+
+// everything a worker needs to fill its share of the output
+struct file_transform_s {
+  // the raw input pixels, seen through the orientation to apply to them
+  struct bit_view_s view;
+
+  // the raw output pixels, `N` rows of `N` / 8 bytes. They sit just past
+  // the headers, so their words are not aligned
+  uint8_t *output;
+};
+
+// Fills block rows [`begin`, `end`) of the output, one view tile at a time.
+// Each row word is copied out with `memcpy`, since the output is unaligned
+static void transform_file_blocks(void *arg, size_t begin, size_t end) {
+  const struct file_transform_s *transform = arg;
+  const bits_t N = transform->view.N;
+  const bits_t size = N >> LOG_BASE;
+  const bytes_t row_size = size * sizeof(ROW_TYPE);
+
+  ROW_TYPE tile[BASE];
+
+  for (size_t i = begin; i < end; i++) {
+    uint8_t *rows = transform->output + (i << LOG_BASE) * row_size;
+    for (bits_t j = 0; j < size; j++) {
+      bit_view_get_tile(&transform->view, j << LOG_BASE, i << LOG_BASE, tile);
+      for (int k = 0; k < BASE; ++k) {
+        memcpy(rows + k * row_size + j * sizeof(ROW_TYPE), &tile[k],
+               sizeof(ROW_TYPE));
+      }
+    }
+  }
+}
+
+// The separate passes, for sides that are not a multiple of 64
+static bool rotate_bmp_file_passes(const char *fname, const char *output_fname,
+                                   const enum orientation_e orientation) {
+  struct color_table_s color_tables[2];
+  int width, height, row_size;
+  uint8_t *img = read_binary_bmp(fname, &width, &height, &row_size,
+                                 color_tables);
+  if (!img) {
+    return false;
+  }
+  if (width != height) {
+    printf("Error: Only square images can be transformed\n");
+    free_bit_matrix(img);
+    return false;
+  }
+
+  struct bit_view_s view = make_bit_view(img, width, orientation);
+  bit_view_materialize(&view);
+  const bool written =
+      write_binary_bmp_rect(output_fname, img, color_tables, width, width,
+                            parallel_for);
+
+  free_bit_matrix(img);
+  return written;
+}
+
+bool rotate_bmp_file(const char *fname, const char *output_fname,
+                     const enum orientation_e orientation) {
+  // Sanity check the input
+  assert(fname);
+  assert(output_fname);
+  assert(orientation < NORIENTATIONS);
+
+  // Writing the output would truncate the mapped input, so transforming a
+  // file onto itself reads it whole first
+  if (is_same_file(fname, output_fname)) {
+    return rotate_bmp_file_passes(fname, output_fname, orientation);
+  }
+
+  struct bmp_map_s bmp;
+  if (!map_binary_bmp(fname, &bmp)) {
+    // Padded rows cannot be mapped
+    return rotate_bmp_file_passes(fname, output_fname, orientation);
+  }
+
+  if (bmp.width != bmp.height) {
+    printf("Error: Only square images can be transformed\n");
+    unmap_binary_bmp(&bmp);
+    return false;
+  }
+
+  const bits_t N = bmp.width;
+  if (N % BASE) {
+    unmap_binary_bmp(&bmp);
+    return rotate_bmp_file_passes(fname, output_fname, orientation);
+  }
+
+  // The raw rows of a bottom-up file are the image flipped vertically, so
+  // the raw output is the raw input flipped back, transformed and flipped
+  // again for the bottom-up output
+  enum orientation_e raw_orientation = orientation;
+  if (bmp.bottom_up) {
+    raw_orientation = compose_orientations(ORIENT_FLIP_VERTICAL, orientation);
+  }
+  raw_orientation = compose_orientations(raw_orientation, ORIENT_FLIP_VERTICAL);
+
+  FILE *output_f = fopen(output_fname, "wb+");
+  if (!output_f) {
+    perror("Error writing BMP file");
+    unmap_binary_bmp(&bmp);
+    return false;
+  }
+
+  const uint64_t data_size = (uint64_t)N * bmp.row_size;
+  const uint64_t file_size =
+      sizeof(struct header_s) + sizeof(struct info_header_s) +
+      sizeof(bmp.color_tables) + data_size;
+  const uint32_t data_offset =
+      write_binary_bmp_headers(output_f, bmp.color_tables, N, N, file_size);
+  fflush(output_f);
+
+  uint8_t *map = MAP_FAILED;
+  if (!ftruncate(fileno(output_f), file_size)) {
+    map = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               fileno(output_f), 0);
+  }
+  if (map == MAP_FAILED) {
+    perror("Error mapping BMP file");
+    fclose(output_f);
+    unmap_binary_bmp(&bmp);
+    return false;
+  }
+
+  struct file_transform_s transform = {
+      .view = make_bit_view(bmp.pixels, N, raw_orientation),
+      .output = map + data_offset,
+  };
+  parallel_for(N >> LOG_BASE, transform_file_blocks, &transform);
+
+  // The pixels reach the file through the mapping, so failing to let go of
+  // either is failing to write it
+  bool written = !munmap(map, file_size);
+  written = !fclose(output_f) && written;
+  if (!written) {
+    perror("Error writing BMP file");
+  }
+  unmap_binary_bmp(&bmp);
+
+  return written;
+}
@@ -0,0 +1,40 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef ROTATE_FILE_H
+#define ROTATE_FILE_H
+
+#include "./rotate.h"
+
+// Applies `orientation` to the square binary BMP `fname` and saves the
+// result as the binary BMP `output_fname`. When the side is a multiple of
+// 64 this is a single pass: the input is mapped, the output is sized up
+// front and mapped, and every 64 by 64 tile goes straight from one pixel
+// array to the other. Both files store their rows bottom up, and those
+// flips are folded into the orientation applied to the raw pixel data.
+// Other sizes are read, transformed and written in separate passes.
+//
+// Returns `true` on success
+bool rotate_bmp_file(const char *fname, const char *output_fname,
+                     const enum orientation_e orientation);
+
+#endif  // ROTATE_FILE_H
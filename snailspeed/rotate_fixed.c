@@ -0,0 +1,181 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./rotate.h"
+
+#include "./thread_pool.h"
+#include "./transpose.h"
+
+// everything a fixed-size worker needs that is not a constant
+struct fixed_rotation_s {
+  uint8_t *img;
+
+  // the kernel picked at startup for blocks of 64-bit rows
+  transpose_fn_t transpose;
+};
+
+#define KERNEL_N 1024
+#define KERNEL_TILE 32
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 1024
+#define KERNEL_TILE 64
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 1024
+#define KERNEL_TILE 128
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 1024
+#define KERNEL_TILE 256
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 2048
+#define KERNEL_TILE 32
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 2048
+#define KERNEL_TILE 64
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 2048
+#define KERNEL_TILE 128
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 2048
+#define KERNEL_TILE 256
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 4096
+#define KERNEL_TILE 32
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 4096
+#define KERNEL_TILE 64
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 4096
+#define KERNEL_TILE 128
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 4096
+#define KERNEL_TILE 256
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 8192
+#define KERNEL_TILE 32
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 8192
+#define KERNEL_TILE 64
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 8192
+#define KERNEL_TILE 128
+#include "./rotate_kernel.h"
+
+#define KERNEL_N 8192
+#define KERNEL_TILE 256
+#include "./rotate_kernel.h"
+
+// a generated worker, and the 4-cycles of tiles it walks
+struct fixed_kernel_s {
+  bits_t N;
+  bits_t tile;
+  range_fn_t rotate_cycles;
+};
+
+#define FIXED_KERNEL(n, tile) \
+  {n, tile, rotate_fixed_##n##_##tile}
+
+static const struct fixed_kernel_s fixed_kernels[] = {
+    FIXED_KERNEL(1024, 32), FIXED_KERNEL(1024, 64),
+    FIXED_KERNEL(1024, 128), FIXED_KERNEL(1024, 256),
+    FIXED_KERNEL(2048, 32), FIXED_KERNEL(2048, 64),
+    FIXED_KERNEL(2048, 128), FIXED_KERNEL(2048, 256),
+    FIXED_KERNEL(4096, 32), FIXED_KERNEL(4096, 64),
+    FIXED_KERNEL(4096, 128), FIXED_KERNEL(4096, 256),
+    FIXED_KERNEL(8192, 32), FIXED_KERNEL(8192, 64),
+    FIXED_KERNEL(8192, 128), FIXED_KERNEL(8192, 256),
+};
+
+// 4-cycles each thread should have at least, so that work stealing can
+// even out the load
+#define FIXED_CYCLES_PER_THREAD 4
+
+// the narrowest tile `rotate_bit_matrix` picks. 32-bit tiles are several
+// times slower than the rest at every size, and 64-bit tiles already give
+// as many 4-cycles as the general path
+#define MIN_FIXED_TILE 64
+
+bits_t get_fixed_tile(const bits_t N) {
+  const size_t wanted = FIXED_CYCLES_PER_THREAD * get_num_threads();
+
+  // The widest tiles measured fastest from 1024 up, by more the larger the
+  // matrix, as long as every thread gets some of them
+  bits_t widest = 0;
+  bool found = false;
+  const size_t nkernels = sizeof(fixed_kernels) / sizeof(fixed_kernels[0]);
+  for (size_t k = 0; k < nkernels; k++) {
+    const bits_t tile = fixed_kernels[k].tile;
+    if (fixed_kernels[k].N != N || tile < MIN_FIXED_TILE) {
+      continue;
+    }
+
+    found = true;
+    const size_t half = N / tile / 2;
+    if (half * half >= wanted && tile > widest) {
+      widest = tile;
+    }
+  }
+
+  if (!found) {
+    return 0;
+  }
+  return widest ? widest : MIN_FIXED_TILE;
+}
+
+bool rotate_bit_matrix_fixed(uint8_t *img, const bits_t N, bits_t tile) {
+  // Sanity check the input
+  assert(img);
+
+  if (!tile) {
+    tile = get_fixed_tile(N);
+  }
+
+  const size_t nkernels = sizeof(fixed_kernels) / sizeof(fixed_kernels[0]);
+  for (size_t k = 0; k < nkernels; k++) {
+    if (fixed_kernels[k].N != N || fixed_kernels[k].tile != tile) {
+      continue;
+    }
+
+    struct fixed_rotation_s rotation = {
+        .img = img,
+        .transpose = get_transpose_fn(),
+    };
+    const size_t half = N / tile / 2;
+    parallel_for(half * half, fixed_kernels[k].rotate_cycles, &rotation);
+    return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,133 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// A 4-cycle rotation worker specialized at compile time, meant to be
+// included once per instance with these defined beforehand:
+//
+//   KERNEL_N     side of the matrix in bits
+//   KERNEL_TILE  side of a tile in bits: 32, 64, 128 or 256
+//
+// The instance is a `range_fn_t` named rotate_fixed_<N>_<TILE>, whose
+// argument is a `const struct fixed_rotation_s *`. 32-bit tiles are single
+// blocks of 32-bit rows. Wider tiles are square groups of 64-bit blocks,
+// so the column-walking tiles of a cycle read and write several words of
+// each row they touch instead of one.
+//
+// With every size a constant, the strides, the cycle count and the division
+// that locates a cycle fold away and the row loops have fixed trip counts.
+// The parameters are undefined again at the end
+
+#if KERNEL_TILE == 32
+#define KERNEL_WORD uint32_t
+#define KERNEL_TRANSPOSE(rotation, block) transpose_32(block)
+#else
+#define KERNEL_WORD uint64_t
+#define KERNEL_TRANSPOSE(rotation, block) (rotation)->transpose(block)
+#endif
+
+#define KERNEL_PASTE(n, tile) rotate_fixed_##n##_##tile
+#define KERNEL_INSTANCE(n, tile) KERNEL_PASTE(n, tile)
+#define KERNEL_NAME KERNEL_INSTANCE(KERNEL_N, KERNEL_TILE)
+
+#define KERNEL_WORD_BITS (8 * sizeof(KERNEL_WORD))
+// words per matrix row, i.e. the stride between rows
+#define KERNEL_ROW_WORDS (KERNEL_N / KERNEL_WORD_BITS)
+#define KERNEL_TILE_BITS KERNEL_TILE
+#define KERNEL_TILE_WORDS (KERNEL_TILE / KERNEL_WORD_BITS)
+// tiles per side, and per side of a quadrant
+#define KERNEL_SIZE (KERNEL_N / KERNEL_TILE_BITS)
+#define KERNEL_HALF (KERNEL_SIZE / 2)
+
+_Static_assert(KERNEL_N % (2 * KERNEL_TILE_BITS) == 0,
+               "a fixed kernel needs an even number of whole tiles");
+
+static void KERNEL_NAME(void *arg, size_t begin, size_t end) {
+  const struct fixed_rotation_s *rotation = arg;
+  KERNEL_WORD *img = (KERNEL_WORD *)rotation->img;
+
+  // blocks[q][a][b] is block (a, b) of the tile of quadrant q. At 32 KB
+  // for the widest tiles it is kept off the stack, in the thread's scratch
+  KERNEL_WORD(*restrict blocks)[KERNEL_TILE_WORDS][KERNEL_TILE_WORDS]
+                               [KERNEL_WORD_BITS] = get_thread_scratch(
+      4 * sizeof(*blocks));
+
+  for (size_t t = begin; t < end; t++) {
+    const size_t i = t / KERNEL_HALF;
+    const size_t j = t % KERNEL_HALF;
+
+    // the first word of the tiles of cycle t, in the order they move
+    KERNEL_WORD *tiles[4] = {
+        img + i * KERNEL_TILE_BITS * KERNEL_ROW_WORDS + j * KERNEL_TILE_WORDS,
+        img + j * KERNEL_TILE_BITS * KERNEL_ROW_WORDS +
+            (KERNEL_SIZE - 1 - i) * KERNEL_TILE_WORDS,
+        img + (KERNEL_SIZE - 1 - i) * KERNEL_TILE_BITS * KERNEL_ROW_WORDS +
+            (KERNEL_SIZE - 1 - j) * KERNEL_TILE_WORDS,
+        img + (KERNEL_SIZE - 1 - j) * KERNEL_TILE_BITS * KERNEL_ROW_WORDS +
+            i * KERNEL_TILE_WORDS,
+    };
+
+    for (int r = 0; r < KERNEL_TILE_BITS; r++) {
+      for (int q = 0; q < 4; q++) {
+        for (int b = 0; b < KERNEL_TILE_WORDS; b++) {
+          blocks[q][r / KERNEL_WORD_BITS][b][r % KERNEL_WORD_BITS] =
+              tiles[q][r * KERNEL_ROW_WORDS + b];
+        }
+      }
+    }
+
+    for (int q = 0; q < 4; q++) {
+      for (int a = 0; a < KERNEL_TILE_WORDS; a++) {
+        for (int b = 0; b < KERNEL_TILE_WORDS; b++) {
+          KERNEL_TRANSPOSE(rotation, blocks[q][a][b]);
+        }
+      }
+    }
+
+    // tile q goes where tile q + 1 was. Block (a, b) of it lands on block
+    // (b, KERNEL_TILE_WORDS - 1 - a), in reverse row order to complete the
+    // rotation
+    for (int r = 0; r < KERNEL_TILE_BITS; r++) {
+      for (int q = 0; q < 4; q++) {
+        for (int c = 0; c < KERNEL_TILE_WORDS; c++) {
+          tiles[(q + 1) % 4][r * KERNEL_ROW_WORDS + c] =
+              blocks[q][KERNEL_TILE_WORDS - 1 - c][r / KERNEL_WORD_BITS]
+                    [KERNEL_WORD_BITS - 1 - r % KERNEL_WORD_BITS];
+        }
+      }
+    }
+  }
+}
+
+#undef KERNEL_HALF
+#undef KERNEL_SIZE
+#undef KERNEL_TILE_WORDS
+#undef KERNEL_TILE_BITS
+#undef KERNEL_ROW_WORDS
+#undef KERNEL_WORD_BITS
+#undef KERNEL_NAME
+#undef KERNEL_INSTANCE
+#undef KERNEL_PASTE
+#undef KERNEL_TRANSPOSE
+#undef KERNEL_WORD
+
+#undef KERNEL_N
+#undef KERNEL_TILE
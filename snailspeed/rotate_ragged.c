@@ -0,0 +1,351 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./rotate.h"
+
+#include <string.h>
+
+#include "./thread_pool.h"
+#include "./transpose.h"
+
+// pixels per tile side. A region of the tile starts up to 7 pixels into a
+// byte, so this leaves room for it inside a byte-aligned row word
+#define RAGGED_TILE (BASE - 8)
+
+// The passes of a threaded rotation. A tile only shares bytes with the
+// tiles next to it in the quadrant, except on the border of the quadrant,
+// where its regions meet the other quadrants' and the ends of the rows. So
+// the inner tiles go in two checkerboard passes, in which no two tiles
+// running at once are neighbours, and the border tiles go last, with the
+// bytes at the edges of their rows written atomically
+enum ragged_pass_e {
+  RAGGED_PASS_ALL,
+  RAGGED_PASS_EVEN,
+  RAGGED_PASS_ODD,
+  RAGGED_PASS_BORDER
+};
+
+// everything a worker needs to rotate its share of a ragged matrix
+struct ragged_rotation_s {
+  uint8_t *img;
+  bits_t N;
+  bytes_t row_size;
+
+  // one past the last byte of the matrix, which row accesses must not cross
+  const uint8_t *end;
+
+  // the top-left quadrant is `quadrant_rows` by `quadrant_columns` pixels,
+  // cut into tiles of up to RAGGED_TILE x RAGGED_TILE pixels
+  bits_t quadrant_rows;
+  bits_t quadrant_columns;
+  size_t tile_rows;
+  size_t tiles_per_row;
+
+  // the tiles this pass rotates
+  enum ragged_pass_e pass;
+
+  // whether other threads may be writing other pixels of the same bytes,
+  // which only happens at the edges of a tile's row spans
+  bool shared;
+
+  // the kernel picked at startup for this machine
+  transpose_fn_t transpose;
+};
+
+// A rectangle of pixels of the matrix
+struct region_s {
+  bits_t top;
+  bits_t left;
+  bits_t rows;
+  bits_t columns;
+};
+
+// Reads the row word starting at byte `p`. Unless `careful`, the word must
+// lie within the matrix; otherwise bytes past its end read as 0
+static inline ROW_TYPE load_row_word(const struct ragged_rotation_s *rotation,
+                                     const uint8_t *p, const bool careful) {
+  ROW_TYPE word = 0;
+  if (!careful || p + sizeof(word) <= rotation->end) {
+    memcpy(&word, p, sizeof(word));
+  } else {
+    memcpy(&word, p, rotation->end - p);
+  }
+  return word;
+}
+
+// The bytes of a region's row words that hold its pixels. Tiles only meet
+// within a row, so of these only the first and the last can hold pixels of
+// a neighbouring tile as well
+struct byte_span_s {
+  int first;
+  int last;
+  bool first_partial;
+  bool last_partial;
+};
+
+static inline struct byte_span_s make_byte_span(const ROW_TYPE mask) {
+  const int first = __builtin_ctzll(mask) / 8;
+  const int last = (BASE - 1 - __builtin_clzll(mask)) / 8;
+  return (struct byte_span_s){
+      .first = first,
+      .last = last,
+      .first_partial = (uint8_t)(mask >> (8 * first)) != 0xFF,
+      .last_partial = (uint8_t)(mask >> (8 * last)) != 0xFF,
+  };
+}
+
+// Writes the pixels of `byte` selected by `byte_mask` to the byte at `p`,
+// atomically, since another thread may be writing its other pixels
+static inline void store_shared_byte(uint8_t *p, const uint8_t byte_mask,
+                                     const uint8_t byte) {
+  __atomic_fetch_and(p, byte | ~byte_mask, __ATOMIC_RELAXED);
+  __atomic_fetch_or(p, byte & byte_mask, __ATOMIC_RELAXED);
+}
+
+// Writes the pixels of row word `word` selected by `mask` to the row word
+// starting at byte `p`, leaving all other pixels alone. Unless `careful`,
+// the word must lie within the matrix. When `rotation->shared`, other
+// threads may be writing the pixels around the mask, so only the bytes of
+// `span` are written, its partial edge bytes atomically
+static inline void store_row_word(const struct ragged_rotation_s *rotation,
+                                  uint8_t *p, const ROW_TYPE mask,
+                                  const ROW_TYPE word,
+                                  const struct byte_span_s *span,
+                                  const bool careful) {
+  if (!careful || p + sizeof(word) <= rotation->end) {
+    if (!rotation->shared) {
+      ROW_TYPE old;
+      memcpy(&old, p, sizeof(old));
+      old = (old & ~mask) | (word & mask);
+      memcpy(p, &old, sizeof(old));
+      return;
+    }
+
+    // the bytes in between belong to this tile alone
+    const uint8_t *bytes = (const uint8_t *)&word;
+    int from = span->first;
+    int to = span->last;
+    if (span->first_partial) {
+      store_shared_byte(p + from, mask >> (8 * from), bytes[from]);
+      from++;
+    }
+    if (span->last_partial && to >= from) {
+      store_shared_byte(p + to, mask >> (8 * to), bytes[to]);
+      to--;
+    }
+    if (to >= from) {
+      memcpy(p + from, bytes + from, to - from + 1);
+    }
+    return;
+  }
+
+  // byte by byte, so nothing past the end of the matrix is ever touched
+  for (int b = 0; b < 8 && p + b < rotation->end; b++) {
+    const uint8_t byte_mask = mask >> (8 * b);
+    const uint8_t byte = word >> (8 * b);
+
+    if (byte_mask == 0xFF) {
+      p[b] = byte;
+    } else if (byte_mask && rotation->shared) {
+      store_shared_byte(p + b, byte_mask, byte);
+    } else if (byte_mask) {
+      p[b] = (p[b] & ~byte_mask) | (byte & byte_mask);
+    }
+  }
+}
+
+// Rotates the 4-cycle of the tile covering `regions[0]`, whose quarter
+// turns are the other regions.
+//
+// Each region is read through the byte-aligned row words around it, so
+// its pixels sit `shift` pixels into the word. A column offset turns into a
+// row offset under rotation, so the region's rows are loaded that many
+// block rows down to land exactly where the next region sits in its own
+// words, and reading the rotated rows from `shift` on undoes its own
+// offset. No row needs a bit shift; the stores only mask out the pixels
+// around the region. `careful` is passed as a constant, so the common case
+// compiles without any bounds checks
+static inline __attribute__((always_inline)) void rotate_ragged_tile(
+    const struct ragged_rotation_s *rotation, const struct region_s *regions,
+    const bool careful) {
+  const bytes_t row_size = rotation->row_size;
+  ROW_TYPE blocks[4][BASE];
+
+  // where each region's row words start, how far into them its pixels
+  // start, and which of their pixels it owns
+  uint8_t *words[4];
+  int shifts[4];
+  ROW_TYPE masks[4];
+  struct byte_span_s spans[4];
+  for (int q = 0; q < 4; q++) {
+    words[q] =
+        rotation->img + regions[q].top * row_size + regions[q].left / 8;
+    shifts[q] = regions[q].left % 8;
+    masks[q] = __builtin_bswap64((~0ULL << (BASE - regions[q].columns)) >>
+                                 shifts[q]);
+    spans[q] = make_byte_span(masks[q]);
+  }
+
+  // row k of a region goes to block row k + offset, so that after the
+  // rotation its pixels line up with the next region's row words
+  int offsets[4];
+  for (int q = 0; q < 4; q++) {
+    offsets[q] = BASE - shifts[(q + 1) % 4] - regions[q].rows;
+  }
+
+  // the regions are read row by row side by side, as in
+  // `rotate_bit_matrix`
+  memset(blocks, 0, sizeof(blocks));
+  for (bits_t k = 0; k < RAGGED_TILE; ++k) {
+    for (int q = 0; q < 4; q++) {
+      if (k < regions[q].rows) {
+        blocks[q][k + offsets[q]] =
+            load_row_word(rotation, words[q] + k * row_size, careful);
+      }
+    }
+  }
+
+  for (int q = 0; q < 4; q++) {
+    rotation->transpose(blocks[q]);
+  }
+
+  // row j of the next region is rotated row shift + j, kept in reverse
+  // order by the transpose
+  for (bits_t j = 0; j < RAGGED_TILE; ++j) {
+    for (int q = 0; q < 4; q++) {
+      const int next = (q + 1) % 4;
+      if (j < regions[next].rows) {
+        store_row_word(rotation, words[next] + j * row_size, masks[next],
+                       blocks[q][LAST_BASE_INDEX - shifts[q] - j],
+                       &spans[next], careful);
+      }
+    }
+  }
+}
+
+// Returns whether tile `a`, `b` of the quadrant is rotated in this pass
+static inline bool in_ragged_pass(const struct ragged_rotation_s *rotation,
+                                  const size_t a, const size_t b) {
+  if (rotation->pass == RAGGED_PASS_ALL) {
+    return true;
+  }
+
+  const bool border = a == 0 || b == 0 || a == rotation->tile_rows - 1 ||
+                      b == rotation->tiles_per_row - 1;
+  if (rotation->pass == RAGGED_PASS_BORDER) {
+    return border;
+  }
+  return !border && (a + b) % 2 == (rotation->pass == RAGGED_PASS_ODD);
+}
+
+// Rotates the 4-cycles of tiles numbered [`begin`, `end`) that belong to the
+// pass.
+//
+// Tile t covers up to RAGGED_TILE x RAGGED_TILE pixels of the top-left
+// quadrant, which holds rows below ceil(N / 2) and columns below
+// floor(N / 2). The quadrant and its three quarter turns cover every pixel
+// but the center of an odd N, which stays put
+static void rotate_ragged_tiles(void *arg, size_t begin, size_t end) {
+  const struct ragged_rotation_s *rotation = arg;
+  const bits_t N = rotation->N;
+  const bytes_t row_size = rotation->row_size;
+
+  for (size_t t = begin; t < end; t++) {
+    const size_t a = t / rotation->tiles_per_row;
+    const size_t b = t % rotation->tiles_per_row;
+    if (!in_ragged_pass(rotation, a, b)) {
+      continue;
+    }
+
+    const bits_t r = a * RAGGED_TILE;
+    const bits_t c = b * RAGGED_TILE;
+    const bits_t h = r + RAGGED_TILE < rotation->quadrant_rows
+                         ? RAGGED_TILE
+                         : rotation->quadrant_rows - r;
+    const bits_t w = c + RAGGED_TILE < rotation->quadrant_columns
+                         ? RAGGED_TILE
+                         : rotation->quadrant_columns - c;
+
+    // each region is the quarter turn of the one before it
+    const struct region_s regions[4] = {
+        {r, c, h, w},
+        {c, N - r - h, w, h},
+        {N - r - h, N - c - w, h, w},
+        {N - c - w, r, w, h},
+    };
+
+    // a region whose last row word runs off the end of the matrix needs
+    // bounds checks
+    bool careful = false;
+    for (int q = 0; q < 4; q++) {
+      const bits_t last_row = regions[q].top + regions[q].rows - 1;
+      const uint8_t *last_word =
+          rotation->img + last_row * row_size + regions[q].left / 8;
+      careful = careful || last_word + sizeof(ROW_TYPE) > rotation->end;
+    }
+
+    if (careful) {
+      rotate_ragged_tile(rotation, regions, true);
+    } else {
+      rotate_ragged_tile(rotation, regions, false);
+    }
+  }
+}
+
+void rotate_bit_matrix_ragged(uint8_t *img, const bits_t N) {
+  // Sanity check the input
+  assert(N > 0);
+
+  const bytes_t row_size = bits_to_bytes(N);
+  struct ragged_rotation_s rotation = {
+      .img = img,
+      .N = N,
+      .row_size = row_size,
+      .end = img + N * row_size,
+      .quadrant_rows = (N + 1) / 2,
+      .quadrant_columns = N / 2,
+      .pass = RAGGED_PASS_ALL,
+      .shared = false,
+      .transpose = get_transpose_fn(),
+  };
+  rotation.tile_rows =
+      (rotation.quadrant_rows + RAGGED_TILE - 1) / RAGGED_TILE;
+  rotation.tiles_per_row =
+      (rotation.quadrant_columns + RAGGED_TILE - 1) / RAGGED_TILE;
+
+  const size_t ntiles = rotation.tile_rows * rotation.tiles_per_row;
+  if (!ntiles) {
+    return;
+  }
+  if (get_num_threads() == 1) {
+    rotate_ragged_tiles(&rotation, 0, ntiles);
+    return;
+  }
+
+  rotation.pass = RAGGED_PASS_EVEN;
+  parallel_for(ntiles, rotate_ragged_tiles, &rotation);
+  rotation.pass = RAGGED_PASS_ODD;
+  parallel_for(ntiles, rotate_ragged_tiles, &rotation);
+  rotation.pass = RAGGED_PASS_BORDER;
+  rotation.shared = true;
+  parallel_for(ntiles, rotate_ragged_tiles, &rotation);
+}
@@ -0,0 +1,265 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./rotate.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+#include "./thread_pool.h"
+#include "./transpose.h"
+
+// destination blocks written together. 8 words of a row fill a cache line
+#define STRIP_WIDTH 8
+
+// outputs at least this large bypass the cache on the way out, since they
+// would only evict the source that is still to be read
+#define STREAMING_THRESHOLD (4 * 1024 * 1024)
+
+#define CACHE_LINE_SIZE 64
+
+// everything a worker needs to rotate its share of a rectangular matrix
+struct rect_rotation_s {
+  const ROW_TYPE *src;
+  ROW_TYPE *dst;
+
+  // the source is `row_blocks` by `col_blocks` blocks
+  bits_t row_blocks;
+  bits_t col_blocks;
+
+  // the kernel picked at startup for this machine
+  transpose_fn_t transpose;
+
+  // whether the out-of-place destination is written with streaming stores
+  bool streaming;
+};
+
+// Rotates the groups of destination strips numbered [`begin`, `end`).
+//
+// A strip is up to STRIP_WIDTH horizontally adjacent destination blocks,
+// which come from a run of vertically adjacent blocks in one source block
+// column. Writing the strip row by row covers whole 64-byte lines of the
+// destination (given an aligned destination whose rows are a multiple of
+// STRIP_WIDTH words), so non-temporal stores can go straight to memory
+// without reading the lines first. A group is the STRIP_WIDTH strips of
+// neighbouring destination block rows, whose sources are neighbouring
+// source block columns, so the source lines a strip reads are used up by
+// the rest of its group while they are still in cache
+static void rotate_rect_strips(void *arg, size_t begin, size_t end) {
+  const struct rect_rotation_s *rotation = arg;
+  const bits_t row_blocks = rotation->row_blocks;
+  const bits_t col_blocks = rotation->col_blocks;
+  const size_t strips_per_row = (row_blocks + STRIP_WIDTH - 1) / STRIP_WIDTH;
+  ROW_TYPE strip[STRIP_WIDTH][BASE];
+
+  for (size_t t = begin; t < end; t++) {
+    // destination block rows [c_begin, c_end), words [x_begin, x_end) of
+    // every row in them
+    const bits_t c_begin = (t / strips_per_row) * STRIP_WIDTH;
+    const bits_t c_end =
+        c_begin + STRIP_WIDTH < col_blocks ? c_begin + STRIP_WIDTH : col_blocks;
+    const bits_t x_begin = (t % strips_per_row) * STRIP_WIDTH;
+    const bits_t x_end =
+        x_begin + STRIP_WIDTH < row_blocks ? x_begin + STRIP_WIDTH : row_blocks;
+
+    for (bits_t c = c_begin; c < c_end; c++) {
+      // destination word column x holds source block row `row_blocks - 1 - x`
+      for (bits_t x = x_begin; x < x_end; x++) {
+        const bits_t r = row_blocks - 1 - x;
+        load_block(strip[x - x_begin],
+                   rotation->src + r * BASE * col_blocks + c, col_blocks);
+        rotation->transpose(strip[x - x_begin]);
+      }
+
+      ROW_TYPE *dst = rotation->dst + c * BASE * row_blocks;
+      if (rotation->streaming) {
+        for (int k = 0; k < BASE; ++k) {
+          for (bits_t x = x_begin; x < x_end; x++) {
+            _mm_stream_si64((long long *)(dst + row_blocks * k + x),
+                            strip[x - x_begin][LAST_BASE_INDEX - k]);
+          }
+        }
+      } else {
+        for (int k = 0; k < BASE; ++k) {
+          for (bits_t x = x_begin; x < x_end; x++) {
+            *(dst + row_blocks * k + x) =
+                strip[x - x_begin][LAST_BASE_INDEX - k];
+          }
+        }
+      }
+    }
+  }
+
+  // non-temporal stores are weakly ordered, so publish them before the
+  // caller is told this range is done
+  if (rotation->streaming) {
+    _mm_sfence();
+  }
+}
+
+void rotate_bit_matrix_rect(const uint8_t *src, uint8_t *dst,
+                            const bits_t rows, const bits_t cols) {
+  // Sanity check the input
+  assert(rows > 0 && cols > 0);
+  assert(!(rows % BASE) && !(cols % BASE));
+
+  struct rect_rotation_s rotation = {
+      .src = (const ROW_TYPE *)src,
+      .dst = (ROW_TYPE *)dst,
+      .row_blocks = rows >> LOG_BASE,
+      .col_blocks = cols >> LOG_BASE,
+      .transpose = get_transpose_fn(),
+  };
+
+  // streaming only pays off if every strip row is exactly one cache line;
+  // partially written lines get flushed to memory one piece at a time
+  rotation.streaming = rows * cols / 8 >= STREAMING_THRESHOLD &&
+                       !((uintptr_t)dst % CACHE_LINE_SIZE) &&
+                       !(rotation.row_blocks % STRIP_WIDTH);
+
+  const size_t strips_per_row =
+      (rotation.row_blocks + STRIP_WIDTH - 1) / STRIP_WIDTH;
+  const size_t strip_rows =
+      (rotation.col_blocks + STRIP_WIDTH - 1) / STRIP_WIDTH;
+  parallel_for(strip_rows * strips_per_row, rotate_rect_strips, &rotation);
+}
+
+void rotate_bit_matrix_copy(const uint8_t *src, uint8_t *dst,
+                            const bits_t N) {
+  rotate_bit_matrix_rect(src, dst, N, N);
+}
+
+// Turns each source block row numbered [`begin`, `end`) into `col_blocks`
+// contiguous blocks, rotating every block on the way. A block row and its
+// blocks cover exactly the same words, so this stays within the block row
+static void rotate_rect_block_rows(void *arg, size_t begin, size_t end) {
+  const struct rect_rotation_s *rotation = arg;
+  const bits_t col_blocks = rotation->col_blocks;
+  const size_t block_row_words = BASE * col_blocks;
+  ROW_TYPE block[BASE];
+
+  // one block row, kept by this thread across ranges
+  ROW_TYPE *scratch = get_thread_scratch(block_row_words * sizeof(ROW_TYPE));
+
+  for (size_t r = begin; r < end; r++) {
+    ROW_TYPE *block_row = rotation->dst + r * block_row_words;
+    memcpy(scratch, block_row, block_row_words * sizeof(ROW_TYPE));
+
+    for (bits_t c = 0; c < col_blocks; c++) {
+      load_block(block, scratch + c, col_blocks);
+      rotation->transpose(block);
+      store_block_rotated(block_row + c * BASE, 1, block);
+    }
+  }
+}
+
+// Turns every run of `row_blocks` contiguous blocks numbered [`begin`,
+// `end`) back into a block row of 64 rows of `row_blocks` words
+static void blocks_to_block_rows(void *arg, size_t begin, size_t end) {
+  const struct rect_rotation_s *rotation = arg;
+  const bits_t row_blocks = rotation->row_blocks;
+  const size_t block_row_words = BASE * row_blocks;
+
+  // one block row, kept by this thread across ranges
+  ROW_TYPE *scratch = get_thread_scratch(block_row_words * sizeof(ROW_TYPE));
+
+  for (size_t c = begin; c < end; c++) {
+    ROW_TYPE *block_row = rotation->dst + c * block_row_words;
+    memcpy(scratch, block_row, block_row_words * sizeof(ROW_TYPE));
+
+    for (bits_t r = 0; r < row_blocks; r++) {
+      for (int k = 0; k < BASE; ++k) {
+        *(block_row + row_blocks * k + r) = scratch[r * BASE + k];
+      }
+    }
+  }
+}
+
+// Swaps the contents of two blocks
+static inline void swap_blocks(ROW_TYPE *block_1, ROW_TYPE *block_2) {
+  for (int k = 0; k < BASE; ++k) {
+    ROW_TYPE temp = block_1[k];
+    block_1[k] = block_2[k];
+    block_2[k] = temp;
+  }
+}
+
+// Moves rotated source block (r, c), stored contiguously at position
+// r * col_blocks + c, to destination block (c, row_blocks - 1 - r) at
+// position c * row_blocks + row_blocks - 1 - r by following the cycles of
+// that permutation. Each block is moved exactly once
+static void permute_blocks(ROW_TYPE *blocks, const bits_t row_blocks,
+                           const bits_t col_blocks) {
+  const size_t nblocks = row_blocks * col_blocks;
+  uint8_t *visited = calloc((nblocks + 7) / 8, 1);
+  assert(visited);
+  ROW_TYPE carry[BASE];
+
+  for (size_t start = 0; start < nblocks; start++) {
+    if (visited[start / 8] & (1 << (start % 8))) {
+      continue;
+    }
+
+    // `carry` always holds the block that belongs at the next position
+    memcpy(carry, blocks + start * BASE, sizeof(carry));
+    size_t position = start;
+    do {
+      const bits_t r = position / col_blocks;
+      const bits_t c = position % col_blocks;
+      position = c * row_blocks + row_blocks - 1 - r;
+
+      swap_blocks(carry, blocks + position * BASE);
+      visited[position / 8] |= 1 << (position % 8);
+    } while (position != start);
+  }
+
+  free(visited);
+}
+
+void rotate_bit_matrix_rect_inplace(uint8_t *img, const bits_t rows,
+                                    const bits_t cols) {
+  // Sanity check the input
+  assert(rows > 0 && cols > 0);
+  assert(!(rows % BASE) && !(cols % BASE));
+
+  if (rows == cols) {
+    rotate_bit_matrix(img, rows);
+    return;
+  }
+
+  struct rect_rotation_s rotation = {
+      .src = (const ROW_TYPE *)img,
+      .dst = (ROW_TYPE *)img,
+      .row_blocks = rows >> LOG_BASE,
+      .col_blocks = cols >> LOG_BASE,
+      .transpose = get_transpose_fn(),
+  };
+
+  // 1. rotate every block into a contiguous run of 64 words
+  parallel_for(rotation.row_blocks, rotate_rect_block_rows, &rotation);
+
+  // 2. move the blocks to their place in the destination block grid
+  permute_blocks(rotation.dst, rotation.row_blocks, rotation.col_blocks);
+
+  // 3. interleave the blocks of each destination block row into rows
+  parallel_for(rotation.col_blocks, blocks_to_block_rows, &rotation);
+}
@@ -0,0 +1,452 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./stream.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../utils/libbmp.h"
+#include "../utils/libg4.h"
+#include "./thread_pool.h"
+#include "./transpose.h"
+
+// strips per batch when nothing is set. At 64 strips every output row gets
+// 512 contiguous bytes per batch
+#define DEFAULT_STREAM_STRIPS 64
+
+// set from SNAILSPEED_STREAM_STRIPS at startup
+static size_t stream_strips = DEFAULT_STREAM_STRIPS;
+
+__attribute__((constructor)) static void read_stream_settings(void) {
+  const char *strips = getenv("SNAILSPEED_STREAM_STRIPS");
+  if (strips && atoi(strips) > 0) {
+    stream_strips = atoi(strips);
+  }
+}
+
+// everything a worker needs to turn a batch of input strips into output
+// column strips
+struct stream_s {
+  // the batch, `nstrips` strips of 64 file rows of `row_size` bytes each,
+  // starting with strip `first_strip` of the input
+  const uint8_t *batch;
+  size_t first_strip;
+  size_t nstrips;
+  bytes_t row_size;
+
+  // input width and height in pixels
+  bits_t width;
+  bits_t height;
+
+  // the first byte of the output pixel data, and its rows in the file
+  uint8_t *output;
+  bytes_t output_row_size;
+
+  transpose_fn_t transpose;
+};
+
+// Writes output rows [64 `begin`, 64 `end`) for the current batch.
+//
+// BMP rows are stored bottom up, so file row f of the input is image row
+// height - 1 - f, which the rotation sends to output column f. Output rows
+// are input columns, so block b of every strip is transposed into word s of
+// output rows 64 b .. 64 b + 63, which are stored bottom up as well
+static void rotate_stream_blocks(void *arg, size_t begin, size_t end) {
+  const struct stream_s *stream = arg;
+  const bytes_t row_size = stream->row_size;
+  const bytes_t output_bytes = bits_to_bytes(stream->height);
+
+  ROW_TYPE block[BASE];
+
+  for (size_t b = begin; b < end; b++) {
+    const bytes_t offset = b * sizeof(ROW_TYPE);
+    const bytes_t nbytes =
+        row_size - offset < sizeof(ROW_TYPE) ? row_size - offset
+                                             : sizeof(ROW_TYPE);
+    const bits_t nrows =
+        stream->width - b * BASE < BASE ? stream->width - b * BASE : BASE;
+
+    for (size_t s = 0; s < stream->nstrips; s++) {
+      const uint8_t *strip = stream->batch + s * BASE * row_size + offset;
+      for (int k = 0; k < BASE; ++k) {
+        block[k] = 0;
+        memcpy(&block[k], strip + k * row_size, nbytes);
+      }
+
+      // the kernel leaves the block anti-transposed, so row x of the
+      // transpose is row 63 - x with its pixels reversed
+      stream->transpose(block);
+
+      const size_t column = (stream->first_strip + s) * sizeof(ROW_TYPE);
+      const bytes_t column_bytes = output_bytes - column < sizeof(ROW_TYPE)
+                                       ? output_bytes - column
+                                       : sizeof(ROW_TYPE);
+      for (bits_t x = 0; x < nrows; x++) {
+        const ROW_TYPE word = reverse_row_bits(block[LAST_BASE_INDEX - x]);
+        uint8_t *row = stream->output +
+                       (stream->width - 1 - b * BASE - x) *
+                           stream->output_row_size;
+        memcpy(row + column, &word, column_bytes);
+      }
+    }
+  }
+}
+
+bool rotate_bmp_stream(const char *fname, const char *output_fname,
+                       size_t strips) {
+  // Sanity check the input
+  assert(fname);
+  assert(output_fname);
+
+  if (!strips) {
+    strips = stream_strips;
+  }
+
+  struct header_s header;
+  struct info_header_s info_header;
+  struct color_table_s color_tables[2];
+  FILE *f = open_binary_bmp(fname, &header, &info_header, color_tables);
+  if (!f) {
+    return false;
+  }
+
+  const bits_t width = info_header.width;
+  const bits_t height = info_header.height;
+  const bytes_t row_size = ((width + 31) / 32) * 4;
+  const bytes_t output_row_size = ((height + 31) / 32) * 4;
+
+  // The output is `height` wide and `width` high. Size it up front and map
+  // it, so strips can land anywhere in it. A file rotated onto itself would
+  // be truncated before its strips are read, so its output goes to a
+  // temporary file beside it, with its permissions, that replaces it at the
+  // end
+  char *temp_fname = NULL;
+  FILE *output_f = NULL;
+  if (is_same_file(fname, output_fname)) {
+    temp_fname = malloc(strlen(output_fname) + sizeof(".XXXXXX"));
+    assert(temp_fname);
+    sprintf(temp_fname, "%s.XXXXXX", output_fname);
+
+    struct stat st;
+    const int fd = mkstemp(temp_fname);
+    if (fd >= 0 && !fstat(fileno(f), &st) && !fchmod(fd, st.st_mode & 07777)) {
+      output_f = fdopen(fd, "wb+");
+    }
+    if (!output_f) {
+      if (fd >= 0) {
+        close(fd);
+        unlink(temp_fname);
+      }
+      free(temp_fname);
+    }
+  } else {
+    output_f = fopen(output_fname, "wb+");
+  }
+  if (!output_f) {
+    perror("Error writing BMP file");
+    fclose(f);
+    return false;
+  }
+
+  const uint64_t data_size = (uint64_t)width * output_row_size;
+  const uint64_t file_size =
+      sizeof(header) + sizeof(info_header) + sizeof(color_tables) + data_size;
+  const uint32_t data_offset = write_binary_bmp_headers(
+      output_f, color_tables, height, width, file_size);
+  fflush(output_f);
+
+  uint8_t *map = MAP_FAILED;
+  if (!ftruncate(fileno(output_f), file_size)) {
+    map = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               fileno(output_f), 0);
+  }
+  if (map == MAP_FAILED) {
+    perror("Error mapping BMP file");
+    fclose(f);
+    fclose(output_f);
+    if (temp_fname) {
+      unlink(temp_fname);
+      free(temp_fname);
+    }
+    return false;
+  }
+
+  // the only buffer, one batch of input strips
+  uint8_t *batch = malloc(strips * BASE * row_size);
+  if (!batch) {
+    printf("Error: Run out of heap space! Please try fewer strips.\n");
+    assert(false);
+  }
+
+  struct stream_s stream = {
+      .batch = batch,
+      .row_size = row_size,
+      .width = width,
+      .height = height,
+      .output = map + data_offset,
+      .output_row_size = output_row_size,
+      .transpose = get_transpose_fn(),
+  };
+
+  bool ok = true;
+  fseek(f, header.data_offset, SEEK_SET);
+
+  const size_t nstrips = (height + BASE - 1) / BASE;
+  for (size_t first = 0; first < nstrips && ok; first += strips) {
+    stream.first_strip = first;
+    stream.nstrips = nstrips - first < strips ? nstrips - first : strips;
+
+    // The last strip is padded with blank rows
+    const bits_t rows = height - first * BASE < stream.nstrips * BASE
+                            ? height - first * BASE
+                            : stream.nstrips * BASE;
+    if (fread(batch, row_size, rows, f) != rows) {
+      perror("Error reading BMP file");
+      ok = false;
+      break;
+    }
+    memset(batch + rows * row_size, 0, (stream.nstrips * BASE - rows) * row_size);
+
+    parallel_for((width + BASE - 1) / BASE, rotate_stream_blocks, &stream);
+  }
+
+  free(batch);
+  munmap(map, file_size);
+  fclose(f);
+  fclose(output_f);
+
+  if (temp_fname) {
+    if (!ok || rename(temp_fname, output_fname)) {
+      if (ok) {
+        perror("Error replacing BMP file");
+        ok = false;
+      }
+      unlink(temp_fname);
+    }
+    free(temp_fname);
+  }
+
+  return ok;
+}
+
+// everything a worker needs to turn a batch of decoded bands into output
+// column strips
+struct tiff_stream_s {
+  // the batch, `nstrips` bands of 64 rows of `row_size` bytes each,
+  // starting with band `first_strip` of the input
+  const uint8_t *batch;
+  size_t first_strip;
+  size_t nstrips;
+  bytes_t row_size;
+
+  // input width in pixels
+  bits_t width;
+
+  // the rotated image, `width` rows of `output_words` words, with its
+  // `height` columns right aligned
+  uint8_t *output;
+  size_t output_words;
+
+  transpose_fn_t transpose;
+};
+
+// Writes output rows [64 `begin`, 64 `end`) for the current batch.
+//
+// Input row 64 s + y goes to output column height - 1 - 64 s - y, so with
+// the columns right aligned in whole words band s fills word
+// `output_words` - 1 - s of output rows 64 b .. 64 b + 63, reversed. That is
+// the block the kernel leaves anti-transposed, row by row from the bottom
+static void rotate_tiff_blocks(void *arg, size_t begin, size_t end) {
+  const struct tiff_stream_s *stream = arg;
+  const bytes_t row_size = stream->row_size;
+  const bytes_t output_row_size = stream->output_words * sizeof(ROW_TYPE);
+
+  ROW_TYPE block[BASE];
+
+  for (size_t b = begin; b < end; b++) {
+    const bytes_t offset = b * sizeof(ROW_TYPE);
+    const bits_t nrows =
+        stream->width - b * BASE < BASE ? stream->width - b * BASE : BASE;
+
+    for (size_t s = 0; s < stream->nstrips; s++) {
+      const uint8_t *strip = stream->batch + s * BASE * row_size + offset;
+      for (int k = 0; k < BASE; ++k) {
+        memcpy(&block[k], strip + k * row_size, sizeof(ROW_TYPE));
+      }
+
+      stream->transpose(block);
+
+      const size_t word = stream->output_words - 1 - stream->first_strip - s;
+      for (bits_t x = 0; x < nrows; x++) {
+        memcpy(stream->output + (b * BASE + x) * output_row_size +
+                   word * sizeof(ROW_TYPE),
+               &block[LAST_BASE_INDEX - x], sizeof(ROW_TYPE));
+      }
+    }
+  }
+}
+
+// Copies the last `width` pixels of the `nwords` words of `words` into
+// `row`, left aligned
+static void unpad_row(uint8_t *row, const uint8_t *words, const size_t nwords,
+                      const bits_t width) {
+  const bits_t pad = nwords * BASE - width;
+  const uint8_t *first = words + pad / 8;
+  const int shift = pad % 8;
+  const bytes_t nbytes = bits_to_bytes(width);
+
+  if (!shift) {
+    memcpy(row, first, nbytes);
+    return;
+  }
+
+  // the byte after the last one read is past the pixels, so it reads as 0
+  for (bytes_t i = 0; i < nbytes; i++) {
+    const uint8_t next = first + i + 1 < words + nwords * sizeof(ROW_TYPE)
+                             ? first[i + 1]
+                             : 0;
+    row[i] = first[i] << shift | next >> (8 - shift);
+  }
+}
+
+bool rotate_tiff_stream(const char *fname, const char *output_fname,
+                        size_t strips) {
+  // Sanity check the input
+  assert(fname);
+  assert(output_fname);
+
+  if (!strips) {
+    strips = stream_strips;
+  }
+
+  struct g4_tiff_s tiff;
+  if (!open_g4_tiff(fname, &tiff)) {
+    return false;
+  }
+
+  const bits_t width = tiff.width;
+  const bits_t height = tiff.height;
+
+  // Rows padded to whole words, so blocks load with plain word copies
+  const bytes_t row_size = (width + BASE - 1) / BASE * sizeof(ROW_TYPE);
+  const size_t output_words = (height + BASE - 1) / BASE;
+  const uint64_t output_size =
+      (uint64_t)width * output_words * sizeof(ROW_TYPE);
+
+  // The rotated pixels wait in a file the kernel can page out, rather than
+  // on the heap, until every band is in. It sits beside the output, on the
+  // disk that will hold the result, since /tmp is often memory. It is
+  // unlinked straight away, so it goes with its descriptor
+  char *scratch_fname = malloc(strlen(output_fname) + sizeof(".XXXXXX"));
+  assert(scratch_fname);
+  sprintf(scratch_fname, "%s.XXXXXX", output_fname);
+  const int scratch = mkstemp(scratch_fname);
+  if (scratch >= 0) {
+    unlink(scratch_fname);
+  }
+  free(scratch_fname);
+
+  uint8_t *map = MAP_FAILED;
+  if (scratch >= 0 && !ftruncate(scratch, output_size)) {
+    map = mmap(NULL, output_size, PROT_READ | PROT_WRITE, MAP_SHARED, scratch,
+               0);
+  }
+  if (map == MAP_FAILED) {
+    perror("Error mapping temporary file");
+    if (scratch >= 0) {
+      close(scratch);
+    }
+    close_g4_tiff(&tiff);
+    return false;
+  }
+
+  // one batch of decoded bands
+  uint8_t *batch = calloc(strips * BASE, row_size);
+  if (!batch) {
+    printf("Error: Run out of heap space! Please try fewer strips.\n");
+    assert(false);
+  }
+
+  struct tiff_stream_s stream = {
+      .batch = batch,
+      .row_size = row_size,
+      .width = width,
+      .output = map,
+      .output_words = output_words,
+      .transpose = get_transpose_fn(),
+  };
+
+  bool ok = true;
+  const size_t nstrips = (height + BASE - 1) / BASE;
+  for (size_t first = 0; first < nstrips && ok; first += strips) {
+    stream.first_strip = first;
+    stream.nstrips = nstrips - first < strips ? nstrips - first : strips;
+
+    // The last band is padded with blank rows
+    const bits_t rows = height - first * BASE < stream.nstrips * BASE
+                            ? height - first * BASE
+                            : stream.nstrips * BASE;
+    for (bits_t r = 0; r < rows && ok; r++) {
+      ok = read_g4_tiff_row(&tiff, batch + r * row_size);
+    }
+    memset(batch + rows * row_size, 0,
+           (stream.nstrips * BASE - rows) * row_size);
+
+    if (ok) {
+      parallel_for((width + BASE - 1) / BASE, rotate_tiff_blocks, &stream);
+    }
+  }
+
+  free(batch);
+  close_g4_tiff(&tiff);
+
+  // The output is `height` wide and `width` high
+  struct g4_tiff_writer_s writer;
+  ok = ok && create_g4_tiff(output_fname, &writer, height, width);
+  if (ok) {
+    madvise(map, output_size, MADV_SEQUENTIAL);
+
+    uint8_t *row = malloc(bits_to_bytes(height));
+    if (!row) {
+      printf("Error: Run out of heap space!\n");
+      assert(false);
+    }
+
+    const bytes_t output_row_size = output_words * sizeof(ROW_TYPE);
+    for (bits_t j = 0; j < width && ok; j++) {
+      unpad_row(row, map + j * output_row_size, output_words, height);
+      ok = write_g4_tiff_row(&writer, row);
+    }
+    free(row);
+
+    // Finish even a failed file, to close it
+    ok = finish_g4_tiff(&writer) && ok;
+  }
+
+  munmap(map, output_size);
+  close(scratch);
+
+  return ok;
+}
@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "../utils/utils.h"
+
+// Rotates the binary BMP `fname` clockwise 90 degrees into a new binary BMP
+// `output_fname` without holding either image in memory. The input is read
+// front to back in batches of `strips` strips of 64 rows, or of
+// SNAILSPEED_STREAM_STRIPS strips if `strips` is 0. Every strip becomes a
+// 64-column strip of the output, which is written through a shared mapping
+// of the output file. Any width and height work. An `output_fname` naming
+// the input is written beside it and replaces it once every strip is in.
+//
+// Returns `true` on success
+bool rotate_bmp_stream(const char *fname, const char *output_fname,
+                       size_t strips);
+
+// Rotates the G4-compressed TIFF `fname` clockwise 90 degrees into a new
+// G4-compressed TIFF `output_fname` without holding either image in memory
+// uncompressed. The input is decoded in batches of `strips` bands of 64
+// rows, or of SNAILSPEED_STREAM_STRIPS bands if `strips` is 0. Every band
+// becomes a 64-column strip of the output, which is gathered in an unlinked
+// temporary file in the directory of `output_fname` and encoded row by row
+// once the input is done. Any width and height work.
+//
+// Returns `true` on success
+bool rotate_tiff_stream(const char *fname, const char *output_fname,
+                        size_t strips);
+
+#endif  // STREAM_H
@@ -0,0 +1,261 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./thread_pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_THREADS 256
+
+// An owner takes 1 / ADAPTIVE_SPLIT of what is left in its deque at a time,
+// so chunks shrink as the range drains and most of it stays stealable
+#define ADAPTIVE_SPLIT 8
+
+// The indices a thread has yet to run. The owner pops chunks off the front
+// and thieves take the back half, so a contiguous range is all the deque
+// needs to hold. Padded to a cache line to keep the locks apart
+struct deque_s {
+  pthread_spinlock_t lock;
+  size_t begin;
+  size_t end;
+} __attribute__((aligned(64)));
+
+static struct deque_s deques[MAX_THREADS];
+
+// The pool only ever runs one `parallel_for` at a time. Workers sleep on
+// `start` until `generation` changes and report back through `done`
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+
+  pthread_t *workers;
+  int nworkers;
+  bool stop;
+
+  unsigned long generation;
+  unsigned long spawn_generation;
+  int pending;
+
+  range_fn_t fn;
+  void *arg;
+  size_t n;
+  int nthreads;
+} pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+          PTHREAD_COND_INITIALIZER};
+
+// Held by the thread that currently owns the pool
+static pthread_mutex_t submit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// set from SNAILSPEED_THREADS at startup and by `set_num_threads`. Threads
+// of the batch pipeline and the daemon read it at any time, so it is only
+// touched atomically
+static int nthreads_setting = 1;
+
+__attribute__((constructor)) static void read_thread_settings(void) {
+  for (int id = 0; id < MAX_THREADS; id++) {
+    pthread_spin_init(&deques[id].lock, PTHREAD_PROCESS_PRIVATE);
+  }
+
+  const char *requested = getenv("SNAILSPEED_THREADS");
+  if (requested) {
+    set_num_threads(atoi(requested));
+  }
+}
+
+// Takes the next chunk of `deque` for its owner. Returns false if it is empty
+static bool pop_chunk(struct deque_s *deque, size_t *begin, size_t *end) {
+  pthread_spin_lock(&deque->lock);
+  const size_t remaining = deque->end - deque->begin;
+  const size_t chunk = (remaining + ADAPTIVE_SPLIT - 1) / ADAPTIVE_SPLIT;
+  *begin = deque->begin;
+  *end = deque->begin + chunk;
+  deque->begin = *end;
+  pthread_spin_unlock(&deque->lock);
+
+  return chunk != 0;
+}
+
+// Moves the back half of some other thread's deque into the deque of
+// thread `id`. Returns false once every other deque is empty
+static bool steal_chunk(int id) {
+  for (int offset = 1; offset < pool.nthreads; offset++) {
+    struct deque_s *victim = &deques[(id + offset) % pool.nthreads];
+
+    pthread_spin_lock(&victim->lock);
+    const size_t remaining = victim->end - victim->begin;
+    const size_t stolen = remaining - remaining / 2;
+    const size_t end = victim->end;
+    victim->end -= stolen;
+    pthread_spin_unlock(&victim->lock);
+
+    if (stolen) {
+      pthread_spin_lock(&deques[id].lock);
+      deques[id].begin = end - stolen;
+      deques[id].end = end;
+      pthread_spin_unlock(&deques[id].lock);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Runs chunks of the current job on thread `id` until no deque has work
+// left. Every thread starts with an equal slice and steals once it is done,
+// so threads that drew cheaper indices help out the slower ones
+static void run_share(int id) {
+  size_t begin, end;
+
+  do {
+    while (pop_chunk(&deques[id], &begin, &end)) {
+      pool.fn(pool.arg, begin, end);
+    }
+  } while (steal_chunk(id));
+}
+
+static void *worker_main(void *arg) {
+  const int id = (int)(size_t)arg;
+
+  pthread_mutex_lock(&pool.lock);
+
+  // Only wake up for jobs submitted after this worker was started
+  unsigned long seen = pool.spawn_generation;
+  for (;;) {
+    while (pool.generation == seen && !pool.stop) {
+      pthread_cond_wait(&pool.start, &pool.lock);
+    }
+    if (pool.stop) {
+      break;
+    }
+    seen = pool.generation;
+    pthread_mutex_unlock(&pool.lock);
+
+    run_share(id);
+
+    pthread_mutex_lock(&pool.lock);
+    if (--pool.pending == 0) {
+      pthread_cond_signal(&pool.done);
+    }
+  }
+  pthread_mutex_unlock(&pool.lock);
+
+  return NULL;
+}
+
+// Joins every worker. Must be called with `submit_lock` held
+static void stop_workers(void) {
+  pthread_mutex_lock(&pool.lock);
+  pool.stop = true;
+  pthread_cond_broadcast(&pool.start);
+  pthread_mutex_unlock(&pool.lock);
+
+  for (int i = 0; i < pool.nworkers; i++) {
+    pthread_join(pool.workers[i], NULL);
+  }
+
+  free(pool.workers);
+  pool.workers = NULL;
+  pool.nworkers = 0;
+  pool.stop = false;
+}
+
+// Makes sure `nworkers` threads are waiting for work. Must be called with
+// `submit_lock` held. Returns the number of workers actually running
+static int start_workers(int nworkers) {
+  if (pool.nworkers == nworkers) {
+    return nworkers;
+  }
+
+  stop_workers();
+
+  pool.workers = malloc(nworkers * sizeof(pthread_t));
+  if (!pool.workers) {
+    return 0;
+  }
+
+  pool.spawn_generation = pool.generation;
+
+  for (int i = 0; i < nworkers; i++) {
+    if (pthread_create(&pool.workers[i], NULL, worker_main,
+                       (void *)(size_t)(i + 1))) {
+      fprintf(stderr, "Warning: could only start %d worker threads\n", i);
+      break;
+    }
+    pool.nworkers++;
+  }
+
+  return pool.nworkers;
+}
+
+int get_num_threads(void) {
+  return __atomic_load_n(&nthreads_setting, __ATOMIC_RELAXED);
+}
+
+void set_num_threads(int nthreads) {
+  if (nthreads < 1) {
+    nthreads = 1;
+  }
+  if (nthreads > MAX_THREADS) {
+    nthreads = MAX_THREADS;
+  }
+
+  __atomic_store_n(&nthreads_setting, nthreads, __ATOMIC_RELAXED);
+}
+
+void parallel_for(size_t n, range_fn_t fn, void *arg) {
+  const int nthreads = get_num_threads();
+
+  if (nthreads == 1 || n < 2 || pthread_mutex_trylock(&submit_lock)) {
+    fn(arg, 0, n);
+    return;
+  }
+
+  const int nworkers = start_workers(nthreads - 1);
+
+  pthread_mutex_lock(&pool.lock);
+  pool.fn = fn;
+  pool.arg = arg;
+  pool.n = n;
+  pool.nthreads = nworkers + 1;
+  pool.pending = nworkers;
+  for (int id = 0; id < pool.nthreads; id++) {
+    deques[id].begin = n * id / pool.nthreads;
+    deques[id].end = n * (id + 1) / pool.nthreads;
+  }
+  pool.generation++;
+  pthread_cond_broadcast(&pool.start);
+  pthread_mutex_unlock(&pool.lock);
+
+  run_share(0);
+
+  pthread_mutex_lock(&pool.lock);
+  while (pool.pending) {
+    pthread_cond_wait(&pool.done, &pool.lock);
+  }
+  pthread_mutex_unlock(&pool.lock);
+
+  pthread_mutex_unlock(&submit_lock);
+}
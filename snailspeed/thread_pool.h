@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+// A piece of work over the index range [`begin`, `end`)
+typedef void (*range_fn_t)(void *arg, size_t begin, size_t end);
+
+// Runs `fn` over the indices [0, `n`) on the persistent thread pool and
+// returns once every index has been processed. The calling thread takes a
+// share of the work. Each thread runs `fn` on chunks of its own slice that
+// shrink as the slice drains, then steals from the others, so `fn` may see
+// many small ranges. If the pool is already busy with another caller, the
+// whole range runs on the calling thread instead
+void parallel_for(size_t n, range_fn_t fn, void *arg);
+
+// Returns the number of threads `parallel_for` uses, including the caller.
+// Defaults to the SNAILSPEED_THREADS environment variable, or 1 if unset
+int get_num_threads(void);
+
+// Sets the number of threads `parallel_for` uses. The pool is rebuilt on
+// its next use
+void set_num_threads(int nthreads);
+
+#endif  // THREAD_POOL_H
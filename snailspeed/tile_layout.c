@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./tile_layout.h"
+
+#include <string.h>
+
+#include "./thread_pool.h"
+#include "./transpose.h"
+
+// everything a worker needs to convert or rotate its share of the tiles
+struct tile_layout_s {
+  const ROW_TYPE *src;
+  ROW_TYPE *dst;
+  bits_t N;
+  // tiles per side
+  bits_t size;
+
+  // number of 4-cycles; the center tile of an odd `size` comes after them
+  size_t ncycles;
+
+  transpose_fn_t transpose;
+};
+
+// Returns the first word of tile (`i`, `j`)
+static inline size_t tile_offset(const bits_t size, const bits_t i,
+                                 const bits_t j) {
+  return (i * size + j) << LOG_BASE;
+}
+
+// Copies the tile rows numbered [`begin`, `end`) from row-major `src` to
+// tile-major `dst`. Rows of the source are read front to back, and each
+// lands in the next row word of one of `size` tiles
+static void gather_tile_rows(void *arg, size_t begin, size_t end) {
+  const struct tile_layout_s *layout = arg;
+  const bits_t size = layout->size;
+
+  for (size_t i = begin; i < end; i++) {
+    for (int k = 0; k < BASE; ++k) {
+      const ROW_TYPE *row = layout->src + ((i << LOG_BASE) + k) * size;
+      for (bits_t j = 0; j < size; j++) {
+        layout->dst[tile_offset(size, i, j) + k] = row[j];
+      }
+    }
+  }
+}
+
+// Copies the tile rows numbered [`begin`, `end`) from tile-major `src` back
+// to row-major `dst`, writing every row of the destination front to back
+static void scatter_tile_rows(void *arg, size_t begin, size_t end) {
+  const struct tile_layout_s *layout = arg;
+  const bits_t size = layout->size;
+
+  for (size_t i = begin; i < end; i++) {
+    for (int k = 0; k < BASE; ++k) {
+      ROW_TYPE *row = layout->dst + ((i << LOG_BASE) + k) * size;
+      for (bits_t j = 0; j < size; j++) {
+        row[j] = layout->src[tile_offset(size, i, j) + k];
+      }
+    }
+  }
+}
+
+void bit_matrix_to_tiles(const uint8_t *src, uint8_t *tiles, const bits_t N) {
+  // Sanity check the input
+  assert(src && tiles);
+  assert(!(N % BASE));
+
+  struct tile_layout_s layout = {
+      .src = (const ROW_TYPE *)src,
+      .dst = (ROW_TYPE *)tiles,
+      .N = N,
+      .size = N >> LOG_BASE,
+  };
+  parallel_for(layout.size, gather_tile_rows, &layout);
+}
+
+void tiles_to_bit_matrix(const uint8_t *tiles, uint8_t *dst, const bits_t N) {
+  // Sanity check the input
+  assert(tiles && dst);
+  assert(!(N % BASE));
+
+  struct tile_layout_s layout = {
+      .src = (const ROW_TYPE *)tiles,
+      .dst = (ROW_TYPE *)dst,
+      .N = N,
+      .size = N >> LOG_BASE,
+  };
+  parallel_for(layout.size, scatter_tile_rows, &layout);
+}
+
+// Rotates the 4-cycles of tiles numbered [`begin`, `end`), numbered as in
+// `rotate_cycles`.
+//
+// Every tile of the cycle is transposed where it lies. Then each moves to
+// the next position in reverse row order, which completes its rotation,
+// with the last one staged in a single block of scratch
+static void rotate_tile_cycles(void *arg, size_t begin, size_t end) {
+  const struct tile_layout_s *layout = arg;
+  ROW_TYPE *tiles = layout->dst;
+  const bits_t size = layout->size;
+  const bits_t half = size / 2;
+
+  ROW_TYPE last[BASE];
+
+  for (size_t t = begin; t < end; t++) {
+    if (t == layout->ncycles) {
+      ROW_TYPE *center = tiles + tile_offset(size, half, half);
+      layout->transpose(center);
+      memcpy(last, center, sizeof(last));
+      for (int k = 0; k < BASE; ++k) {
+        center[k] = last[LAST_BASE_INDEX - k];
+      }
+      continue;
+    }
+
+    const bits_t i = t / half;
+    const bits_t j = t % half;
+
+    ROW_TYPE *cycle[4] = {
+        tiles + tile_offset(size, i, j),
+        tiles + tile_offset(size, j, size - 1 - i),
+        tiles + tile_offset(size, size - 1 - i, size - 1 - j),
+        tiles + tile_offset(size, size - 1 - j, i),
+    };
+
+    for (int q = 0; q < 4; q++) {
+      layout->transpose(cycle[q]);
+    }
+
+    // tile q goes where tile q + 1 was
+    memcpy(last, cycle[3], sizeof(last));
+    for (int q = 3; q > 0; q--) {
+      for (int k = 0; k < BASE; ++k) {
+        cycle[q][k] = cycle[q - 1][LAST_BASE_INDEX - k];
+      }
+    }
+    for (int k = 0; k < BASE; ++k) {
+      cycle[0][k] = last[LAST_BASE_INDEX - k];
+    }
+  }
+}
+
+void rotate_tiles(uint8_t *tiles, const bits_t N) {
+  // Sanity check the input
+  assert(tiles);
+  assert(!(N % BASE));
+
+  const bits_t size = N >> LOG_BASE;
+  struct tile_layout_s layout = {
+      .dst = (ROW_TYPE *)tiles,
+      .N = N,
+      .size = size,
+      .ncycles = ((size + 1) / 2) * (size / 2),
+      .transpose = get_transpose_fn(),
+  };
+  parallel_for(layout.ncycles + (size & 1), rotate_tile_cycles, &layout);
+}
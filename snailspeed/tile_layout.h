@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef TILE_LAYOUT_H
+#define TILE_LAYOUT_H
+
+#include "../utils/utils.h"
+
+// Tile-major storage. An `N` by `N` bit matrix, `N` a multiple of 64, is
+// cut into 64 by 64 tiles that are laid out in row-major order of tiles.
+// Each tile is 512 contiguous bytes holding its 64 row words in order, so
+// rotating it reads and writes whole tiles sequentially. A tile-major
+// matrix is the same size as the row-major one
+
+// Copies the row-major `N` by `N` bit matrix `src` into the tile-major
+// buffer `tiles`. The buffers must not overlap
+void bit_matrix_to_tiles(const uint8_t *src, uint8_t *tiles, const bits_t N);
+
+// Copies the tile-major `N` by `N` bit matrix `tiles` into the row-major
+// buffer `dst`. The buffers must not overlap
+void tiles_to_bit_matrix(const uint8_t *tiles, uint8_t *dst, const bits_t N);
+
+// Rotates the tile-major `N` by `N` bit matrix `tiles` clockwise 90 degrees
+// in place. Each 4-cycle of tile indices moves four whole tiles, with one
+// transpose per tile
+void rotate_tiles(uint8_t *tiles, const bits_t N);
+
+#endif  // TILE_LAYOUT_H
@@ -0,0 +1,280 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./rotate.h"
+
+#include "./thread_pool.h"
+#include "./transpose.h"
+
+// everything a worker needs to apply its share of an orientation
+struct transform_s {
+  ROW_TYPE *img_64;
+  bits_t N;
+  bits_t size;
+
+  // number of 4-cycles of a quarter turn; the center block of an odd
+  // `size` comes after them
+  size_t ncycles;
+
+  // the flags of the orientation
+  bool transpose;
+  bool vertical;
+  bool horizontal;
+
+  // the kernel picked at startup for this machine
+  transpose_fn_t transpose_fn;
+};
+
+// Flips the rows numbered [`begin`, `end`) without transposing. With a
+// vertical flip row r trades places with row N - 1 - r, otherwise it stays
+// put. With a horizontal flip the words of each row are reversed along with
+// the bits inside them
+static void flip_rows(void *arg, size_t begin, size_t end) {
+  const struct transform_s *transform = arg;
+  const bits_t words = transform->size;
+
+  for (size_t r = begin; r < end; r++) {
+    ROW_TYPE *row_1 = transform->img_64 + r * words;
+    ROW_TYPE *row_2 = transform->vertical
+                          ? transform->img_64 + (transform->N - 1 - r) * words
+                          : row_1;
+
+    if (!transform->horizontal) {
+      for (bits_t k = 0; k < words; k++) {
+        ROW_TYPE temp = row_1[k];
+        row_1[k] = row_2[k];
+        row_2[k] = temp;
+      }
+      continue;
+    }
+
+    if (row_1 == row_2) {
+      for (bits_t k = 0; k < words / 2; k++) {
+        const bits_t l = words - 1 - k;
+        const ROW_TYPE row_1_k = row_1[k];
+        row_1[k] = reverse_row_bits(row_1[l]);
+        row_1[l] = reverse_row_bits(row_1_k);
+      }
+      if (words & 1) {
+        row_1[words / 2] = reverse_row_bits(row_1[words / 2]);
+      }
+      continue;
+    }
+
+    // words k and l of both rows are read before any of them is written, so
+    // this also works on the middle word
+    for (bits_t k = 0; k < (words + 1) / 2; k++) {
+      const bits_t l = words - 1 - k;
+      const ROW_TYPE row_1_k = row_1[k];
+      const ROW_TYPE row_1_l = row_1[l];
+      const ROW_TYPE row_2_k = row_2[k];
+      const ROW_TYPE row_2_l = row_2[l];
+
+      row_1[k] = reverse_row_bits(row_2_l);
+      row_1[l] = reverse_row_bits(row_2_k);
+      row_2[k] = reverse_row_bits(row_1_l);
+      row_2[l] = reverse_row_bits(row_1_k);
+    }
+  }
+}
+
+// Moves block row `*i`, block column `*j` to the block the orientation
+// sends it to
+static inline void next_block(const struct transform_s *transform, bits_t *i,
+                              bits_t *j) {
+  const bits_t row = *i;
+  *i = transform->vertical ? transform->size - 1 - *j : *j;
+  *j = transform->horizontal ? transform->size - 1 - row : row;
+}
+
+// Applies a transposing orientation to every block of the orbit of block
+// (`i`, `j`) and moves each one a step along the orbit.
+//
+// The transpose kernels leave a block anti-transposed, which is the whole
+// job for an anti-transpose. The other orientations differ from it by a
+// vertical flip, done for free by storing the rows in reverse order, and a
+// horizontal flip, done by reversing the bits of every row
+static inline __attribute__((always_inline)) void transform_orbit(
+    const struct transform_s *transform, bits_t i, bits_t j,
+    const int length) {
+  const bits_t N = transform->N;
+  const bits_t size = transform->size;
+
+  // orbits have one, two or four blocks. Callers pass the length as a
+  // constant so these loops unroll
+  ROW_TYPE blocks[4][BASE];
+  ROW_TYPE *block_img_pointers[4];
+
+  for (int b = 0; b < length; b++) {
+    block_img_pointers[b] = transform->img_64 + i * N + j;
+    next_block(transform, &i, &j);
+  }
+
+  // the blocks are read row by row side by side, as in `rotate_bit_matrix`
+  for (int k = 0; k < BASE; ++k) {
+    for (int b = 0; b < length; b++) {
+      blocks[b][k] = *(block_img_pointers[b] + size * k);
+    }
+  }
+
+  for (int b = 0; b < length; b++) {
+    transform->transpose_fn(blocks[b]);
+    if (!transform->horizontal) {
+      for (int k = 0; k < BASE; ++k) {
+        blocks[b][k] = reverse_row_bits(blocks[b][k]);
+      }
+    }
+  }
+
+  // block b goes where block b + 1 was, written back row by row side by side
+  for (int k = 0; k < BASE; ++k) {
+    const int block_row = transform->vertical ? k : LAST_BASE_INDEX - k;
+    for (int b = 0; b < length; b++) {
+      *(block_img_pointers[(b + 1) % length] + size * k) = blocks[b][block_row];
+    }
+  }
+}
+
+// Applies a transpose or an anti-transpose to block rows numbered
+// [`begin`, `end`). Block row i swaps the blocks on one side of the
+// diagonal with their mirror images and transforms its diagonal block in
+// place
+static void transform_block_rows(void *arg, size_t begin, size_t end) {
+  const struct transform_s *transform = arg;
+  const bits_t size = transform->size;
+  const bool anti = transform->vertical;
+
+  for (size_t i = begin; i < end; i++) {
+    const bits_t j_begin = anti ? 0 : i;
+    const bits_t j_end = anti ? size - i : size;
+
+    // the diagonal block comes first for a transpose and last for an
+    // anti-transpose
+    for (bits_t j = j_begin; j < j_end; j++) {
+      if (j == (anti ? size - 1 - i : i)) {
+        transform_orbit(transform, i, j, 1);
+      } else {
+        transform_orbit(transform, i, j, 2);
+      }
+    }
+  }
+}
+
+// Applies a quarter turn to the 4-cycles numbered [`begin`, `end`), which
+// are numbered as in `rotate_bit_matrix`
+static void transform_cycles(void *arg, size_t begin, size_t end) {
+  const struct transform_s *transform = arg;
+  const bits_t size = transform->size;
+  const bits_t half = size / 2;
+
+  for (size_t t = begin; t < end; t++) {
+    if (t == transform->ncycles) {
+      transform_orbit(transform, half, half, 1);
+    } else {
+      transform_orbit(transform, t / half, t % half, 4);
+    }
+  }
+}
+
+// Applies one of the eight symmetries of a square to a bit array.
+//
+// The bit array is of `N` by `N` bits where N is a multiple of 64. Clockwise
+// rotation is left to `rotate_bit_matrix`. Flips and 180 degrees touch each
+// row pair once, transposes swap mirrored block pairs, and a counter-
+// clockwise turn walks the same 4-cycles as a clockwise one the other way
+void transform_bit_matrix(uint8_t *restrict img, const bits_t N,
+                          const enum orientation_e orientation) {
+  // Sanity check the input
+  assert(!(N % BASE));
+  assert(orientation < NORIENTATIONS);
+
+  if (orientation == ORIENT_IDENTITY) {
+    return;
+  }
+  if (orientation == ORIENT_ROTATE_CW) {
+    rotate_bit_matrix(img, N);
+    return;
+  }
+
+  const bits_t size = N >> LOG_BASE;
+  struct transform_s transform = {
+      .img_64 = (ROW_TYPE *)img,
+      .N = N,
+      .size = size,
+      .ncycles = ((size + 1) / 2) * (size / 2),
+      .transpose = orientation & ORIENT_TRANSPOSE_BIT,
+      .vertical = orientation & ORIENT_FLIP_VERTICAL_BIT,
+      .horizontal = orientation & ORIENT_FLIP_HORIZONTAL_BIT,
+      .transpose_fn = get_transpose_fn(),
+  };
+
+  if (!transform.transpose) {
+    parallel_for(transform.vertical ? (N + 1) / 2 : N, flip_rows, &transform);
+  } else if (transform.vertical == transform.horizontal) {
+    parallel_for(size, transform_block_rows, &transform);
+  } else {
+    parallel_for(transform.ncycles + (size & 1), transform_cycles, &transform);
+  }
+}
+
+enum orientation_e compose_orientations(const enum orientation_e first,
+                                        const enum orientation_e second) {
+  // Sanity check the input
+  assert(first < NORIENTATIONS);
+  assert(second < NORIENTATIONS);
+
+  // A transpose swaps the axes of the flips applied before it, so moving
+  // `second`'s transpose in front of `first`'s flips exchanges them. Flips
+  // along the same axis, and transposes, cancel in pairs
+  const bool vertical = first & ORIENT_FLIP_VERTICAL_BIT;
+  const bool horizontal = first & ORIENT_FLIP_HORIZONTAL_BIT;
+  int flips = first & ~ORIENT_TRANSPOSE_BIT;
+  if (second & ORIENT_TRANSPOSE_BIT) {
+    flips = (vertical ? ORIENT_FLIP_HORIZONTAL_BIT : 0) |
+            (horizontal ? ORIENT_FLIP_VERTICAL_BIT : 0);
+  }
+
+  return ((first ^ second) & ORIENT_TRANSPOSE_BIT) |
+         (flips ^ (second & ~ORIENT_TRANSPOSE_BIT));
+}
+
+const char *get_orientation_name(const enum orientation_e orientation) {
+  switch (orientation) {
+    case ORIENT_IDENTITY:
+      return "identity";
+    case ORIENT_TRANSPOSE:
+      return "transpose";
+    case ORIENT_FLIP_VERTICAL:
+      return "vertical flip";
+    case ORIENT_ROTATE_CCW:
+      return "counter-clockwise";
+    case ORIENT_FLIP_HORIZONTAL:
+      return "horizontal flip";
+    case ORIENT_ROTATE_CW:
+      return "clockwise";
+    case ORIENT_ROTATE_180:
+      return "180 degrees";
+    case ORIENT_ANTI_TRANSPOSE:
+      return "anti-transpose";
+  }
+  return "unknown";
+}
@@ -0,0 +1,373 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./transpose.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+#define SWAP_WITHIN_BYTES(row_1, row_2, shift, mask)\
+ do {\
+   ROW_TYPE temp = ((row_1) ^ ((row_2) >> (shift))) & (mask);\
+    (row_1) = (row_1) ^ (temp);\
+     (row_2) = (row_2) ^ ((temp) << (shift));\
+ } while(0)
+
+#define SWAP_BYTES(row_1, row_2, shift, mask)\
+ do {\
+ ROW_TYPE temp = ((row_1) ^ ((row_2) << (shift))) & (mask);\
+  (row_1) = (row_1) ^ (temp);\
+   (row_2) = (row_2) ^ ((temp) >> (shift));\
+   } while(0)
+
+void transpose_64(uint64_t *img) {
+  // Transposes the 64x64 bit image by transposing submatrices of the image inward
+ 
+  ROW_TYPE mask = 0xFFFFFFFF00000000;
+
+  int shift = BASE >> 1, k, index_for_swap;
+  
+  // Handles the swaps for >= 8 bits (1 byte), to account for little endianness of machine
+  while (shift != 4) {
+    for (k = 0; k < BASE; k += shift<<1) {
+      for (index_for_swap = k; index_for_swap < shift + k; index_for_swap++) {
+        SWAP_BYTES(*(img + (index_for_swap + shift)), *(img + index_for_swap), shift, mask);
+      } 
+    }
+    shift >>= 1;
+    mask ^= mask >> shift;
+  }
+
+  mask >>= shift;
+  // Swaps within single bytes, where endianness does not matter
+  while (shift != 0) {
+    for (k = 0; k < BASE; k += shift<<1) {
+       for (index_for_swap = k; index_for_swap < shift + k; index_for_swap++) {
+        SWAP_WITHIN_BYTES(*(img + (index_for_swap + shift)), *(img + index_for_swap), shift, mask);
+      }
+    }
+    shift >>= 1;
+    mask ^= mask << shift;
+  }
+
+}
+
+void transpose_32(uint32_t *img) {
+  // Same network as transpose_64 on a 32x32 block with 32-bit rows
+  uint32_t mask = 0xFFFF0000;
+
+  int shift = 16, k, index_for_swap;
+
+  while (shift != 4) {
+    for (k = 0; k < 32; k += shift<<1) {
+      for (index_for_swap = k; index_for_swap < shift + k; index_for_swap++) {
+        SWAP_BYTES(*(img + (index_for_swap + shift)), *(img + index_for_swap), shift, mask);
+      }
+    }
+    shift >>= 1;
+    mask ^= mask >> shift;
+  }
+
+  mask >>= shift;
+  while (shift != 0) {
+    for (k = 0; k < 32; k += shift<<1) {
+      for (index_for_swap = k; index_for_swap < shift + k; index_for_swap++) {
+        SWAP_WITHIN_BYTES(*(img + (index_for_swap + shift)), *(img + index_for_swap), shift, mask);
+      }
+    }
+    shift >>= 1;
+    mask ^= mask << shift;
+  }
+}
+
+// The vector forms of the swaps above, applied to 4 row pairs at once.
+// `shift` must be a literal since it is an instruction immediate
+#define SWAP_BYTES_256(row_1, row_2, shift, mask)\
+ do {\
+   __m256i temp = _mm256_and_si256(\
+       _mm256_xor_si256((row_1), _mm256_slli_epi64((row_2), (shift))), (mask));\
+   (row_1) = _mm256_xor_si256((row_1), temp);\
+   (row_2) = _mm256_xor_si256((row_2), _mm256_srli_epi64(temp, (shift)));\
+ } while(0)
+
+#define SWAP_WITHIN_BYTES_256(row_1, row_2, shift, mask)\
+ do {\
+   __m256i temp = _mm256_and_si256(\
+       _mm256_xor_si256((row_1), _mm256_srli_epi64((row_2), (shift))), (mask));\
+   (row_1) = _mm256_xor_si256((row_1), temp);\
+   (row_2) = _mm256_xor_si256((row_2), _mm256_slli_epi64(temp, (shift)));\
+ } while(0)
+
+// Swaps rows that share a register. `partner` holds the same rows as `row`
+// with every row moved onto the lane of the row it is paired with, and
+// `upper_lanes` selects (as a 32-bit blend mask) the lanes that play the
+// role of `row_1` in SWAP_WITHIN_BYTES
+#define SWAP_WITHIN_REGISTER_256(row, partner, shift, mask, upper_lanes)\
+ do {\
+   __m256i temp_1 = _mm256_and_si256(\
+       _mm256_xor_si256((row), _mm256_srli_epi64((partner), (shift))), (mask));\
+   __m256i temp_2 = _mm256_and_si256(\
+       _mm256_xor_si256((partner), _mm256_srli_epi64((row), (shift))), (mask));\
+   (row) = _mm256_xor_si256((row),\
+       _mm256_blend_epi32(_mm256_slli_epi64(temp_2, (shift)), temp_1,\
+                          (upper_lanes)));\
+ } while(0)
+
+// Register `r` holds rows 4r .. 4r + 3. The four widest stages pair rows
+// that live in different registers, so they are plain vertical operations.
+// The last two stages pair rows within a register and need a lane shuffle
+__attribute__((target("avx2")))
+void transpose_64_avx2(uint64_t *img) {
+  __m256i rows[BASE / 4];
+  int r;
+
+  for (r = 0; r < BASE / 4; r++) {
+    rows[r] = _mm256_loadu_si256((const __m256i *)(img + 4 * r));
+  }
+
+  const __m256i mask_32 = _mm256_set1_epi64x(0xFFFFFFFF00000000);
+  const __m256i mask_16 = _mm256_set1_epi64x(0xFFFF0000FFFF0000);
+  const __m256i mask_8 = _mm256_set1_epi64x(0xFF00FF00FF00FF00);
+  const __m256i mask_4 = _mm256_set1_epi64x(0x0F0F0F0F0F0F0F0F);
+  const __m256i mask_2 = _mm256_set1_epi64x(0x3333333333333333);
+  const __m256i mask_1 = _mm256_set1_epi64x(0x5555555555555555);
+
+  // Rows 32 apart are 8 registers apart
+  for (r = 0; r < 8; r++) {
+    SWAP_BYTES_256(rows[r + 8], rows[r], 32, mask_32);
+  }
+
+  // Rows 16 apart are 4 registers apart
+  for (r = 0; r < BASE / 4; r += 8) {
+    for (int k = r; k < r + 4; k++) {
+      SWAP_BYTES_256(rows[k + 4], rows[k], 16, mask_16);
+    }
+  }
+
+  // Rows 8 apart are 2 registers apart
+  for (r = 0; r < BASE / 4; r += 4) {
+    SWAP_BYTES_256(rows[r + 2], rows[r], 8, mask_8);
+    SWAP_BYTES_256(rows[r + 3], rows[r + 1], 8, mask_8);
+  }
+
+  // Rows 4 apart are in neighbouring registers
+  for (r = 0; r < BASE / 4; r += 2) {
+    SWAP_WITHIN_BYTES_256(rows[r + 1], rows[r], 4, mask_4);
+  }
+
+  for (r = 0; r < BASE / 4; r++) {
+    // Rows 2 apart are in opposite 128-bit halves of a register
+    __m256i partner = _mm256_permute4x64_epi64(rows[r], 0x4E);
+    SWAP_WITHIN_REGISTER_256(rows[r], partner, 2, mask_2, 0xF0);
+
+    // Rows 1 apart are in opposite 64-bit halves of a 128-bit lane
+    partner = _mm256_shuffle_epi32(rows[r], 0x4E);
+    SWAP_WITHIN_REGISTER_256(rows[r], partner, 1, mask_1, 0xCC);
+
+    _mm256_storeu_si256((__m256i *)(img + 4 * r), rows[r]);
+  }
+}
+
+// Gathers the 8x8 byte block of rows 8g .. 8g + 7 into byte columns. On
+// return `low` holds byte columns 0, 1, 4, 5 and `high` holds byte columns
+// 2, 3, 6, 7, one per 64-bit lane, with byte t of a column taken from row
+// 8g + t
+__attribute__((target("avx2"))) static inline void gather_byte_columns(
+    const uint64_t *group, __m256i *low, __m256i *high) {
+  // Interleaves the two rows of a 128-bit lane byte by byte
+  const __m256i interleave_rows = _mm256_setr_epi8(
+      0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15,
+      0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15);
+  // Interleaves the two row pairs of a 128-bit lane 16 bits at a time
+  const __m256i interleave_pairs = _mm256_setr_epi8(
+      0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15,
+      0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+
+  __m256i rows_0_3 = _mm256_loadu_si256((const __m256i *)group);
+  __m256i rows_4_7 = _mm256_loadu_si256((const __m256i *)(group + 4));
+
+  rows_0_3 = _mm256_shuffle_epi8(rows_0_3, interleave_rows);
+  rows_4_7 = _mm256_shuffle_epi8(rows_4_7, interleave_rows);
+
+  // Bring byte columns 0-3 of every row pair into the low lane
+  rows_0_3 = _mm256_permute4x64_epi64(rows_0_3, 0xD8);
+  rows_4_7 = _mm256_permute4x64_epi64(rows_4_7, 0xD8);
+
+  rows_0_3 = _mm256_shuffle_epi8(rows_0_3, interleave_pairs);
+  rows_4_7 = _mm256_shuffle_epi8(rows_4_7, interleave_pairs);
+
+  *low = _mm256_unpacklo_epi32(rows_0_3, rows_4_7);
+  *high = _mm256_unpackhi_epi32(rows_0_3, rows_4_7);
+}
+
+// Transposes the 64-bit lanes of 4 registers. `a` .. `d` each hold 4 byte
+// columns of one row group; on return `first_*` hold lane 0 and 2 of every
+// input and `second_*` lane 1 and 3, ordered `a` to `d`
+#define TRANSPOSE_LANES_256(a, b, c, d, first_low, first_high, second_low,\
+                            second_high)\
+ do {\
+   __m256i ab_0 = _mm256_unpacklo_epi64((a), (b));\
+   __m256i ab_1 = _mm256_unpackhi_epi64((a), (b));\
+   __m256i cd_0 = _mm256_unpacklo_epi64((c), (d));\
+   __m256i cd_1 = _mm256_unpackhi_epi64((c), (d));\
+   (first_low) = _mm256_permute2x128_si256(ab_0, cd_0, 0x20);\
+   (first_high) = _mm256_permute2x128_si256(ab_0, cd_0, 0x31);\
+   (second_low) = _mm256_permute2x128_si256(ab_1, cd_1, 0x20);\
+   (second_high) = _mm256_permute2x128_si256(ab_1, cd_1, 0x31);\
+ } while(0)
+
+// Builds output rows directly instead of running the butterfly network.
+// Byte column j of the block is gathered into 64 byte lanes (one per input
+// row), and each of its 8 bit columns is then peeled off with a shift and a
+// movemask. Produces exactly the same block as `transpose_64`
+__attribute__((target("avx2")))
+void transpose_64_movemask(uint64_t *img) {
+  __m256i low[8], high[8];
+  int g, j, q;
+
+  for (g = 0; g < 8; g++) {
+    gather_byte_columns(img + 8 * g, &low[g], &high[g]);
+  }
+
+  // Output byte 7 - g comes from row group g, so the groups are laid out
+  // in reverse: groups 7 .. 4 feed the low 32 bits of every output row
+  __m256i columns_low[8], columns_high[8];
+  TRANSPOSE_LANES_256(low[7], low[6], low[5], low[4], columns_low[0],
+                      columns_low[4], columns_low[1], columns_low[5]);
+  TRANSPOSE_LANES_256(high[7], high[6], high[5], high[4], columns_low[2],
+                      columns_low[6], columns_low[3], columns_low[7]);
+  TRANSPOSE_LANES_256(low[3], low[2], low[1], low[0], columns_high[0],
+                      columns_high[4], columns_high[1], columns_high[5]);
+  TRANSPOSE_LANES_256(high[3], high[2], high[1], high[0], columns_high[2],
+                      columns_high[6], columns_high[3], columns_high[7]);
+
+  for (j = 0; j < 8; j++) {
+    __m256i column_low = columns_low[j];
+    __m256i column_high = columns_high[j];
+
+    // Bit column q of byte column j is bit 7 - q of every byte
+    for (q = 0; q < 8; q++) {
+      uint32_t bits_low = _mm256_movemask_epi8(column_low);
+      uint32_t bits_high = _mm256_movemask_epi8(column_high);
+      img[LAST_BASE_INDEX - 8 * j - q] =
+          ((uint64_t)bits_high << 32) | bits_low;
+
+      column_low = _mm256_add_epi8(column_low, column_low);
+      column_high = _mm256_add_epi8(column_high, column_high);
+    }
+  }
+}
+
+void transpose_64_x4(uint64_t *img) {
+  uint64_t block[BASE];
+
+  for (int m = 0; m < 4; m++) {
+    for (int k = 0; k < BASE; ++k) {
+      block[k] = img[4 * k + m];
+    }
+    transpose_64(block);
+    for (int k = 0; k < BASE; ++k) {
+      img[4 * k + m] = block[k];
+    }
+  }
+}
+
+// One stage of the butterfly network of `transpose_64` on 4 blocks at once.
+// Every swap pairs two rows of the same block, so lane m of a register only
+// ever meets lane m of another and the stage is the scalar one, widened
+#define TRANSPOSE_STAGE_X4(rows, shift, mask, swap)\
+ do {\
+   for (int k = 0; k < BASE; k += 2 * (shift)) {\
+     for (int i = k; i < k + (shift); i++) {\
+       swap((rows)[i + (shift)], (rows)[i], (shift), (mask));\
+     }\
+   }\
+ } while(0)
+
+// Register k holds row k of all 4 blocks, so there are 64 of them and the
+// network runs out of L1 rather than out of registers
+__attribute__((target("avx2")))
+void transpose_64_x4_avx2(uint64_t *img) {
+  __m256i *rows = (__m256i *)img;
+
+  TRANSPOSE_STAGE_X4(rows, 32, _mm256_set1_epi64x(0xFFFFFFFF00000000),
+                     SWAP_BYTES_256);
+  TRANSPOSE_STAGE_X4(rows, 16, _mm256_set1_epi64x(0xFFFF0000FFFF0000),
+                     SWAP_BYTES_256);
+  TRANSPOSE_STAGE_X4(rows, 8, _mm256_set1_epi64x(0xFF00FF00FF00FF00),
+                     SWAP_BYTES_256);
+  TRANSPOSE_STAGE_X4(rows, 4, _mm256_set1_epi64x(0x0F0F0F0F0F0F0F0F),
+                     SWAP_WITHIN_BYTES_256);
+  TRANSPOSE_STAGE_X4(rows, 2, _mm256_set1_epi64x(0x3333333333333333),
+                     SWAP_WITHIN_BYTES_256);
+  TRANSPOSE_STAGE_X4(rows, 1, _mm256_set1_epi64x(0x5555555555555555),
+                     SWAP_WITHIN_BYTES_256);
+}
+
+static transpose_fn_t selected_transpose = transpose_64;
+static const char *selected_transpose_name = "scalar";
+static transpose_fn_t selected_transpose_x4 = transpose_64_x4;
+
+// Picks the transpose kernel once, before `main` runs
+__attribute__((constructor)) static void select_transpose(void) {
+  // libgcc's CPU model may not be set up yet when constructors run
+  __builtin_cpu_init();
+  const bool has_avx2 = __builtin_cpu_supports("avx2");
+  const char *requested = getenv("SNAILSPEED_TRANSPOSE");
+
+  if (requested && !strcmp(requested, "scalar")) {
+    return;
+  }
+
+  // there is only one vector kernel for 4 blocks at once
+  if (has_avx2) {
+    selected_transpose_x4 = transpose_64_x4_avx2;
+  }
+
+  if (requested && !strcmp(requested, "movemask")) {
+    if (has_avx2) {
+      selected_transpose = transpose_64_movemask;
+      selected_transpose_name = "movemask";
+    } else {
+      fprintf(stderr, "AVX2 is not supported on this CPU, using scalar\n");
+    }
+    return;
+  }
+
+  if (requested && strcmp(requested, "avx2") && strcmp(requested, "auto")) {
+    fprintf(stderr, "Unknown SNAILSPEED_TRANSPOSE \"%s\", using auto\n",
+            requested);
+  }
+
+  if (has_avx2) {
+    selected_transpose = transpose_64_avx2;
+    selected_transpose_name = "avx2";
+  } else if (requested && !strcmp(requested, "avx2")) {
+    fprintf(stderr, "AVX2 is not supported on this CPU, using scalar\n");
+  }
+}
+
+transpose_fn_t get_transpose_fn(void) { return selected_transpose; }
+
+const char *get_transpose_name(void) { return selected_transpose_name; }
+
+transpose_fn_t get_transpose_x4_fn(void) { return selected_transpose_x4; }
@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include "../utils/utils.h"
+
+#define BASE 64
+#define LAST_BASE_INDEX BASE - 1
+#define LOG_BASE 6
+
+#define ROW_TYPE uint64_t
+
+// A kernel that transposes a BASExBASE bit block held in BASE rows
+typedef void (*transpose_fn_t)(uint64_t *img);
+
+// Portable butterfly transpose, always available
+void transpose_64(uint64_t *img);
+
+// Portable butterfly transpose of a 32x32 bit block held in 32 rows of
+// 32 bits, for kernels that tile with half-width rows
+void transpose_32(uint32_t *img);
+
+// Same butterfly network with 4 rows per ymm register. Requires AVX2
+void transpose_64_avx2(uint64_t *img);
+
+// Gather/movemask kernel with no butterfly stages. Requires AVX2
+void transpose_64_movemask(uint64_t *img);
+
+// Transposes 4 independent blocks held interleaved: row k of block m is
+// `img[4 * k + m]`. Portable, always available
+void transpose_64_x4(uint64_t *img);
+
+// Same, with one block per 64-bit lane of a ymm register. Requires AVX2 and
+// a 32-byte aligned `img`
+void transpose_64_x4_avx2(uint64_t *img);
+
+// Returns the transpose kernel selected at startup. The choice is made
+// from CPUID and can be forced with the SNAILSPEED_TRANSPOSE environment
+// variable (`scalar`, `avx2` or `movemask`)
+transpose_fn_t get_transpose_fn(void);
+
+// Returns the name of the transpose kernel selected at startup
+const char *get_transpose_name(void);
+
+// Returns the kernel for 4 interleaved blocks selected at startup. It is
+// the AVX2 one unless the CPU lacks AVX2 or SNAILSPEED_TRANSPOSE is `scalar`
+transpose_fn_t get_transpose_x4_fn(void);
+
+// Loads the BASE rows of a block whose rows are `stride` words apart
+static inline void load_block(ROW_TYPE *block, const ROW_TYPE *img,
+                              const size_t stride) {
+  for (int k = 0; k < BASE; ++k) {
+    block[k] = *(img + stride * k);
+  }
+}
+
+// Stores a transposed block in reverse row order, which completes a
+// clockwise rotation of the block. Rows are `stride` words apart
+static inline void store_block_rotated(ROW_TYPE *img, const size_t stride,
+                                       const ROW_TYPE *block) {
+  for (int k = 0; k < BASE; ++k) {
+    *(img + stride * k) = block[LAST_BASE_INDEX - k];
+  }
+}
+
+// Reverses the order of the 64 pixels held in a row word. Pixels are packed
+// most significant bit first within little-endian bytes, so this is a plain
+// 64-bit bit reversal
+static inline ROW_TYPE reverse_row_bits(ROW_TYPE row) {
+  row = ((row >> 1) & 0x5555555555555555) | ((row & 0x5555555555555555) << 1);
+  row = ((row >> 2) & 0x3333333333333333) | ((row & 0x3333333333333333) << 2);
+  row = ((row >> 4) & 0x0F0F0F0F0F0F0F0F) | ((row & 0x0F0F0F0F0F0F0F0F) << 4);
+  return __builtin_bswap64(row);
+}
+
+#endif  // TRANSPOSE_H
@@ -0,0 +1,277 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./view.h"
+
+#include <string.h>
+
+#include "./thread_pool.h"
+#include "./transpose.h"
+
+struct bit_view_s make_bit_view(uint8_t *img, const bits_t N,
+                                const enum orientation_e orientation) {
+  // Sanity check the input
+  assert(img);
+  assert(orientation < NORIENTATIONS);
+
+  struct bit_view_s view = {
+      .img = img,
+      .N = N,
+      .row_size = bits_to_bytes(N),
+      .orientation = orientation,
+  };
+  return view;
+}
+
+// Maps column `*i`, row `*j` of the view to the column and row of the same
+// pixel in the source matrix, undoing the flips and then the transpose
+static inline void view_to_source(const struct bit_view_s *view, uint32_t *i,
+                                  uint32_t *j) {
+  uint32_t column = *i, row = *j;
+  if (view->orientation & ORIENT_FLIP_HORIZONTAL_BIT) {
+    column = view->N - 1 - column;
+  }
+  if (view->orientation & ORIENT_FLIP_VERTICAL_BIT) {
+    row = view->N - 1 - row;
+  }
+  if (view->orientation & ORIENT_TRANSPOSE_BIT) {
+    *i = row;
+    *j = column;
+  } else {
+    *i = column;
+    *j = row;
+  }
+}
+
+uint8_t bit_view_get_bit(const struct bit_view_s *view, uint32_t i,
+                         uint32_t j) {
+  view_to_source(view, &i, &j);
+  return get_bit(view->img, view->row_size, i, j);
+}
+
+void bit_view_set_bit(const struct bit_view_s *view, uint32_t i, uint32_t j,
+                      uint8_t value) {
+  view_to_source(view, &i, &j);
+  set_bit(view->img, view->row_size, i, j, value);
+}
+
+// Returns the 64 pixels of source row `j` starting at column `i`, at any bit
+// offset, packed as a row word. Pixels past the right edge are 0
+static ROW_TYPE load_source_row(const struct bit_view_s *view, uint32_t i,
+                                uint32_t j) {
+  const uint8_t *p = view->img + j * view->row_size + i / 8;
+  const bytes_t available = view->row_size - i / 8;
+
+  // pixel x of the span is bit 63 - x once the bytes are big-endian, so
+  // dropping the first i % 8 pixels is a left shift
+  ROW_TYPE word = 0;
+  memcpy(&word, p, available < sizeof(word) ? available : sizeof(word));
+  word = __builtin_bswap64(word);
+  if (i % 8 && available > sizeof(word)) {
+    word = (word << (i % 8)) | (p[sizeof(word)] >> (8 - i % 8));
+  } else {
+    word <<= i % 8;
+  }
+
+  if (view->N - i < BASE) {
+    word &= ~(ROW_TYPE)0 << (BASE - (view->N - i));
+  }
+  return __builtin_bswap64(word);
+}
+
+// Like `load_source_row`, for a span that may start left of column 0 or lie
+// above or below the matrix. Pixels outside the matrix are 0
+static ROW_TYPE load_clipped_source_row(const struct bit_view_s *view,
+                                        int64_t i, int64_t j) {
+  if (j < 0 || j >= (int64_t)view->N || i <= -BASE) {
+    return 0;
+  }
+  if (i >= 0) {
+    return load_source_row(view, i, j);
+  }
+
+  // the span starts -i pixels before column 0
+  const ROW_TYPE word = __builtin_bswap64(load_source_row(view, 0, j));
+  return __builtin_bswap64(word >> -i);
+}
+
+uint64_t bit_view_get_row(const struct bit_view_s *view, uint32_t i,
+                          uint32_t j) {
+  // Sanity check the input
+  assert(i < view->N && j < view->N);
+
+  const bits_t N = view->N;
+  const bits_t count = N - i < BASE ? N - i : BASE;
+
+  // a row of a transposed view is a source column, gathered pixel by pixel
+  if (view->orientation & ORIENT_TRANSPOSE_BIT) {
+    ROW_TYPE word = 0;
+    for (bits_t x = 0; x < count; x++) {
+      word |= (ROW_TYPE)bit_view_get_bit(view, i + x, j) << (BASE - 1 - x);
+    }
+    return __builtin_bswap64(word);
+  }
+
+  const uint32_t row =
+      view->orientation & ORIENT_FLIP_VERTICAL_BIT ? N - 1 - j : j;
+  if (!(view->orientation & ORIENT_FLIP_HORIZONTAL_BIT)) {
+    return load_source_row(view, i, row);
+  }
+
+  // a mirrored span ends at source column N - 1 - i. Short spans at the
+  // right edge are read from column 0 and moved down to pixel 0
+  if (count == BASE) {
+    return reverse_row_bits(load_source_row(view, N - BASE - i, row));
+  }
+  const ROW_TYPE word = reverse_row_bits(load_source_row(view, 0, row));
+  return __builtin_bswap64(__builtin_bswap64(word) << (BASE - count));
+}
+
+void bit_view_get_tile(const struct bit_view_s *view, uint32_t i, uint32_t j,
+                       uint64_t *tile) {
+  // Sanity check the input
+  assert(tile);
+  assert(i < view->N && j < view->N);
+
+  const bits_t N = view->N;
+  const bool vertical = view->orientation & ORIENT_FLIP_VERTICAL_BIT;
+  const bool horizontal = view->orientation & ORIENT_FLIP_HORIZONTAL_BIT;
+
+  if (!(view->orientation & ORIENT_TRANSPOSE_BIT)) {
+    for (int k = 0; k < BASE; ++k) {
+      tile[k] = j + k < N ? bit_view_get_row(view, i, j + k) : 0;
+    }
+    return;
+  }
+
+  // The source block whose columns are the tile's rows. The kernel leaves
+  // it anti-transposed, which is the tile flipped both ways, so the flips
+  // of the view undo those of the kernel. A tile over the edge maps to a
+  // block partly outside the source, which reads as 0
+  const int64_t first_row = horizontal ? (int64_t)N - BASE - i : i;
+  const int64_t first_column = vertical ? (int64_t)N - BASE - j : j;
+
+  ROW_TYPE block[BASE];
+  for (int k = 0; k < BASE; ++k) {
+    block[k] = load_clipped_source_row(view, first_column, first_row + k);
+  }
+
+  get_transpose_fn()(block);
+
+  for (int k = 0; k < BASE; ++k) {
+    const ROW_TYPE row = block[vertical ? k : LAST_BASE_INDEX - k];
+    tile[k] = horizontal ? row : reverse_row_bits(row);
+  }
+}
+
+void bit_view_apply(struct bit_view_s *view,
+                    const enum orientation_e orientation) {
+  view->orientation = compose_orientations(view->orientation, orientation);
+}
+
+// everything a worker needs to build its share of a materialized view
+struct view_materialization_s {
+  const struct bit_view_s *view;
+  uint8_t *scratch;
+};
+
+// Builds tile rows [`begin`, `end`) of the view into the scratch matrix, one
+// tile at a time. Tiles over the edge come back with 0 outside the matrix,
+// so the padding bits of each row end up clear
+static void materialize_tile_rows(void *arg, size_t begin, size_t end) {
+  const struct view_materialization_s *materialization = arg;
+  const struct bit_view_s *view = materialization->view;
+  const bits_t N = view->N;
+  const bytes_t row_size = view->row_size;
+
+  ROW_TYPE tile[BASE];
+
+  for (size_t t = begin; t < end; t++) {
+    const bits_t j = t << LOG_BASE;
+    const bits_t rows = N - j < BASE ? N - j : BASE;
+    for (bits_t i = 0; i < N; i += BASE) {
+      bit_view_get_tile(view, i, j, tile);
+      const bytes_t nbytes =
+          row_size - i / 8 < sizeof(*tile) ? row_size - i / 8 : sizeof(*tile);
+      for (bits_t k = 0; k < rows; k++) {
+        memcpy(materialization->scratch + (j + k) * row_size + i / 8,
+               &tile[k], nbytes);
+      }
+    }
+  }
+}
+
+void bit_view_materialize(struct bit_view_s *view) {
+  const bits_t N = view->N;
+  const bytes_t row_size = view->row_size;
+
+  if (view->orientation == ORIENT_IDENTITY) {
+    return;
+  }
+  if (!(N % BASE)) {
+    transform_bit_matrix(view->img, N, view->orientation);
+    view->orientation = ORIENT_IDENTITY;
+    return;
+  }
+
+  // The ragged kernel turns the matrix in place, leaving the padding bits
+  // alone, so they are cleared after it like the other orientations do
+  if (view->orientation == ORIENT_ROTATE_CW) {
+    rotate_bit_matrix(view->img, N);
+    if (N % 8) {
+      const uint8_t mask = 0xFF << (8 - N % 8);
+      for (bits_t j = 0; j < N; j++) {
+        view->img[j * row_size + row_size - 1] &= mask;
+      }
+    }
+    view->orientation = ORIENT_IDENTITY;
+    return;
+  }
+
+  // every tile of the view reads the source, so the result is built apart
+  uint8_t *scratch = malloc(N * row_size);
+  if (!scratch) {
+    printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+    assert(false);
+  }
+
+  struct view_materialization_s materialization = {view, scratch};
+  parallel_for((N + BASE - 1) >> LOG_BASE, materialize_tile_rows,
+               &materialization);
+
+  memcpy(view->img, scratch, N * row_size);
+  free(scratch);
+  view->orientation = ORIENT_IDENTITY;
+}
+
+void transform_bit_matrix_sequence(uint8_t *img, const bits_t N,
+                                   const enum orientation_e *orientations,
+                                   const size_t count) {
+  // Sanity check the input
+  assert(orientations || !count);
+
+  struct bit_view_s view = make_bit_view(img, N, ORIENT_IDENTITY);
+  for (size_t k = 0; k < count; k++) {
+    bit_view_apply(&view, orientations[k]);
+  }
+  bit_view_materialize(&view);
+}
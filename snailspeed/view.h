@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef VIEW_H
+#define VIEW_H
+
+#include "./rotate.h"
+
+// An `N` by `N` bit matrix seen through one of the eight orientations. The
+// accessors remap coordinates on the fly, so reading a strip of a rotated
+// matrix only touches the source pixels of that strip. Nothing moves until
+// `bit_view_materialize` is called
+struct bit_view_s {
+  uint8_t *img;
+  bits_t N;
+  bytes_t row_size;
+  enum orientation_e orientation;
+};
+
+// Returns a view of the `N` by `N` bit matrix `img`, with rows of
+// `bits_to_bytes(N)` bytes, as if `orientation` had been applied to it
+struct bit_view_s make_bit_view(uint8_t *img, const bits_t N,
+                                const enum orientation_e orientation);
+
+// Returns the bit at column `i`, row `j` of the view, like `get_bit`
+uint8_t bit_view_get_bit(const struct bit_view_s *view, uint32_t i,
+                         uint32_t j);
+
+// Sets the bit at column `i`, row `j` of the view to `value`, like `set_bit`
+void bit_view_set_bit(const struct bit_view_s *view, uint32_t i, uint32_t j,
+                      uint8_t value);
+
+// Returns the 64 pixels of row `j` of the view starting at column `i`,
+// packed as a row word of the matrix. Pixels past the right edge are 0
+uint64_t bit_view_get_row(const struct bit_view_s *view, uint32_t i,
+                          uint32_t j);
+
+// Fills `tile` with the 64 by 64 pixels of the view whose top left pixel is
+// column `i`, row `j`, one row word per row. The tile may run over the right
+// or bottom edge of the matrix; pixels past it are 0. Transposing
+// orientations cost one block transpose
+void bit_view_get_tile(const struct bit_view_s *view, uint32_t i, uint32_t j,
+                       uint64_t *tile);
+
+// Applies `orientation` on top of the one `view` already has, without moving
+// anything. A view collects a run of rotations and flips this way and pays
+// for them with one pass when it is materialized
+void bit_view_apply(struct bit_view_s *view,
+                    const enum orientation_e orientation);
+
+// Applies the orientation of `view` to its matrix in place and resets it to
+// ORIENT_IDENTITY. Multiples of 64 go through `transform_bit_matrix`. For
+// other sizes a clockwise turn goes through `rotate_bit_matrix`, and the
+// other orientations are rebuilt tile by tile in scratch memory on the
+// SNAILSPEED_THREADS pool. Either way the padding bits at the end of each
+// row are cleared, unless the view was ORIENT_IDENTITY and nothing moved
+void bit_view_materialize(struct bit_view_s *view);
+
+// Applies the `count` orientations `orientations` to the `N` by `N` bit
+// matrix `img` in order, fused into at most one pass over it
+void transform_bit_matrix_sequence(uint8_t *img, const bits_t N,
+                                   const enum orientation_e *orientations,
+                                   const size_t count);
+
+#endif  // VIEW_H
@@ -23,10 +23,16 @@
 #include "./libbmp.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <malloc.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "./utils.h"
 
 // Read the BMP headers and color tables
 static bool read_headers(FILE* f, struct header_s* header,
@@ -66,10 +72,38 @@ bad:
   return false;
 }
 
+// Opens the binary BMP `fname` and reads its headers and 2 color tables into
+// `header`, `info_header` and `color_tables`, for readers that stream the
+// pixel data themselves from `header->data_offset`.
+//
+// Returns the open file, or NULL if there was an error
+FILE* open_binary_bmp(const char* fname, struct header_s* header,
+                      struct info_header_s* info_header,
+                      struct color_table_s color_tables[2]) {
+  FILE* f = fopen(fname, "rb");
+
+  // There was some sort of error
+  if (!f) {
+    perror("Error reading BMP file");
+    return NULL;
+  }
+
+  if (!read_headers(f, header, info_header, color_tables)) {
+    perror("Error reading BMP headers");
+    fclose(f);
+    return NULL;
+  }
+
+  return f;
+}
+
 // Reads the binary image from `fname` and saves the bit width and height
 // in `_w` and `_h` respectively. Additionally saves the size of a single
 // row in the image in bytes in `_row_size` and the 2 color tables used
-// in the BMP file in `color_tables`
+// in the BMP file in `color_tables`.
+//
+// The returned rows are packed to `bits_to_bytes(width)` bytes each, without
+// the padding that aligns them to 4 bytes in the file
 uint8_t* read_binary_bmp(const char* fname, int* _w, int* _h, int* _row_size,
                          struct color_table_s color_tables[2]) {
   // Sanity checks as per the BMP standard
@@ -109,12 +143,13 @@ uint8_t* read_binary_bmp(const char* fname, int* _w, int* _h, int* _row_size,
     info_header.height = -1 * info_header.height;
   }
 
-  // Rows are aligned on 4-byte boundary
-  int row_size =
+  // Rows are aligned on 4-byte boundary in the file, but not in memory
+  int file_row_size =
       ((info_header.bits_per_pixel * info_header.width + 31) / 32) * 4;
-  uint32_t image_size = row_size * info_header.height;
+  int row_size = bits_to_bytes(info_header.bits_per_pixel * info_header.width);
+  uint32_t image_size = file_row_size * info_header.height;
 
-  uint8_t* ret_img = malloc(info_header.height * row_size);
+  uint8_t* ret_img = alloc_bit_matrix(info_header.height * row_size);
   uint8_t* image_data = malloc(image_size);
 
   if (!ret_img || !image_data) {
@@ -130,13 +165,13 @@ uint8_t* read_binary_bmp(const char* fname, int* _w, int* _h, int* _row_size,
   }
 
   uint8_t* image_offset =
-      image_data + inverted * ((info_header.height - 1) * row_size);
+      image_data + inverted * ((info_header.height - 1) * file_row_size);
   uint8_t* ret_img_offset = ret_img;
   uint32_t h;
   for (h = 0; h < info_header.height; h++) {
     memcpy(ret_img_offset, image_offset, row_size);
 
-    image_offset += scan_dir * row_size;
+    image_offset += scan_dir * file_row_size;
     ret_img_offset += row_size;
   }
 
@@ -152,6 +187,172 @@ uint8_t* read_binary_bmp(const char* fname, int* _w, int* _h, int* _row_size,
   return ret_img;
 }
 
+// Reads the binary image `fname` like `read_binary_bmp`, but into `*buffer`,
+// a bit matrix of `*capacity` bytes from `alloc_bit_matrix` that is only
+// replaced by a larger one when the image does not fit. Rows are read
+// straight into place, so a buffer reused across images is the only memory
+// involved.
+//
+// Returns `true` on success
+bool read_binary_bmp_into(const char* fname, uint8_t** buffer,
+                          size_t* capacity, int* _w, int* _h, int* _row_size,
+                          struct color_table_s color_tables[2]) {
+  // Sanity check the input
+  assert(buffer);
+  assert(capacity);
+
+  struct header_s header;
+  struct info_header_s info_header;
+  FILE* f = open_binary_bmp(fname, &header, &info_header, color_tables);
+  if (!f) {
+    return false;
+  }
+
+  const uint32_t width = info_header.width;
+  const uint32_t height = info_header.height;
+  const size_t row_size = bits_to_bytes(width);
+  const size_t padding = ((width + 31) / 32) * 4 - row_size;
+  const size_t image_size = (size_t)height * row_size;
+
+  if (image_size > *capacity) {
+    free_bit_matrix(*buffer);
+    *buffer = alloc_bit_matrix(image_size);
+    *capacity = *buffer ? image_size : 0;
+    if (!*buffer) {
+      printf("Error: Image size is too large to fit in heap space!\n");
+      fclose(f);
+      return false;
+    }
+  }
+
+  // The file rows are bottom up, each followed by its padding. Without
+  // padding they come in with one read, which skips the stdio buffer, and
+  // are put top down after
+  bool ok = !fseek(f, header.data_offset, SEEK_SET);
+  if (!padding) {
+    ok = ok && fread(*buffer, 1, image_size, f) == image_size;
+    for (uint32_t r = 0; r < height / 2 && ok; r++) {
+      uint8_t* top = *buffer + (size_t)r * row_size;
+      uint8_t* bottom = *buffer + (size_t)(height - 1 - r) * row_size;
+      for (size_t b = 0; b < row_size; b++) {
+        const uint8_t byte = top[b];
+        top[b] = bottom[b];
+        bottom[b] = byte;
+      }
+    }
+  } else {
+    uint8_t pad[4];
+    for (uint32_t r = 0; r < height && ok; r++) {
+      ok = fread(*buffer + (size_t)(height - 1 - r) * row_size, 1, row_size,
+                 f) == row_size &&
+           fread(pad, 1, padding, f) == padding;
+    }
+  }
+
+  fclose(f);
+
+  if (!ok) {
+    printf("Error: BMP file %s is truncated\n", fname);
+    return false;
+  }
+
+  // Set the return dimension values
+  *_w = width;
+  *_h = height;
+  *_row_size = row_size;
+
+  return true;
+}
+
+// Maps the binary image `fname` into memory and describes it in `bmp`, with
+// no copy of the pixel data. The mapping is private, so the pixels can be
+// changed without changing the file, but they are not word aligned; see
+// `struct bmp_map_s`. Only images whose rows need no padding, a width that
+// is a multiple of 32, can be mapped; use `read_binary_bmp` for the others.
+//
+// Returns `true` on success
+bool map_binary_bmp(const char* fname, struct bmp_map_s* bmp) {
+  // Sanity check the input
+  assert(fname);
+  assert(bmp);
+
+  struct header_s header;
+  struct info_header_s info_header;
+  FILE* f = open_binary_bmp(fname, &header, &info_header, bmp->color_tables);
+  if (!f) {
+    return false;
+  }
+
+  // Padded rows would leave the pixels of a row apart from the next
+  if (info_header.width % 32) {
+    fclose(f);
+    return false;
+  }
+
+  fseek(f, 0, SEEK_END);
+  const long file_size = ftell(f);
+  const size_t row_size = info_header.width / 8;
+  const size_t image_size = row_size * info_header.height;
+  if (file_size < 0 || header.data_offset + image_size > (size_t)file_size) {
+    printf("Error: BMP file is shorter than its pixel data\n");
+    fclose(f);
+    return false;
+  }
+
+  void* map = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   fileno(f), 0);
+  fclose(f);
+  if (map == MAP_FAILED) {
+    perror("Error mapping BMP file");
+    return false;
+  }
+
+  bmp->pixels = (uint8_t*)map + header.data_offset;
+  bmp->width = info_header.width;
+  bmp->height = info_header.height;
+  bmp->row_size = row_size;
+  // `height` is unsigned here, so files are always read bottom up, like
+  // `read_binary_bmp` does
+  bmp->bottom_up = true;
+  bmp->map = map;
+  bmp->map_size = file_size;
+
+  return true;
+}
+
+// Reverses the order of the rows of the mapped `bmp` in one in-place pass,
+// so that its first row is the top of the image
+void flip_binary_bmp_rows(struct bmp_map_s* bmp) {
+  // Sanity check the input
+  assert(bmp);
+
+  uint8_t* row = malloc(bmp->row_size);
+  if (!row) {
+    printf("Error: Run out of heap space!\n");
+    assert(false);
+  }
+
+  uint8_t* top = bmp->pixels;
+  uint8_t* bottom = bmp->pixels + (size_t)(bmp->height - 1) * bmp->row_size;
+  for (; top < bottom; top += bmp->row_size, bottom -= bmp->row_size) {
+    memcpy(row, top, bmp->row_size);
+    memcpy(top, bottom, bmp->row_size);
+    memcpy(bottom, row, bmp->row_size);
+  }
+
+  free(row);
+  bmp->bottom_up = !bmp->bottom_up;
+}
+
+// Releases the mapping of `bmp`
+void unmap_binary_bmp(struct bmp_map_s* bmp) {
+  // Sanity check the input
+  assert(bmp);
+
+  munmap(bmp->map, bmp->map_size);
+  bmp->map = bmp->pixels = NULL;
+}
+
 static void init_header(struct header_s* header, const uint32_t file_size,
                         const uint32_t data_offset) {
   // The signature "BM" for bitmap files
@@ -165,15 +366,17 @@ static void init_header(struct header_s* header, const uint32_t file_size,
   return;
 }
 
-// Initializes the info header of a binary image with dimensions `N` by `N` bits
+// Initializes the info header of a binary image with dimensions `width` by
+// `height` bits
 static void init_info_header(struct info_header_s* info_header,
-                             const uint32_t N) {
+                             const uint32_t width, const uint32_t height) {
   // Set the size of the `info_header`
   info_header->size = sizeof(struct info_header_s);
   assert(info_header->size == 40);
 
   // Set the dimensions of the bitmap
-  info_header->width = info_header->height = N;
+  info_header->width = width;
+  info_header->height = height;
 
   // Number of planes is always 1
   info_header->planes = 1;
@@ -197,14 +400,123 @@ static void init_info_header(struct info_header_s* info_header,
   return;
 }
 
-// Write the binary `image_data` encoding an image `N` by `N` bits to
-// `output_fname`.
+// The headers and 2 color tables of a binary BMP, as they sit in the file
+struct bmp_headers_s {
+  struct header_s header;
+  struct info_header_s info_header;
+  struct color_table_s color_tables[2];
+} __attribute__((packed));
+
+// Fills in `headers` for a binary image `width` by `height` bits whose file
+// is `file_size` bytes, which the header only records if it fits in 32 bits
+static void init_headers(struct bmp_headers_s* headers,
+                         struct color_table_s color_tables[2],
+                         const uint32_t width, const uint32_t height,
+                         const uint64_t file_size) {
+  init_header(&headers->header, file_size > UINT32_MAX ? 0 : file_size,
+              sizeof(*headers));
+  init_info_header(&headers->info_header, width, height);
+
+  // The 0th color table is the color of bits that are 0's
+  // and the 1st is for the bits that are 1's
+  headers->color_tables[0] = color_tables[0];
+  headers->color_tables[1] = color_tables[1];
+}
+
+// Bytes of file rows each writer stages before handing them to `pwrite`
+#define WRITE_STAGE_BYTES (1 << 20)
+
+// everything a worker needs to write its share of the rows
+struct bmp_writer_s {
+  const uint8_t* image_data;
+  uint32_t height;
+  uint32_t row_size;
+  uint32_t file_row_size;
+  uint32_t data_offset;
+  int fd;
+
+  // file rows per staging buffer
+  uint32_t stage_rows;
+
+  // set by any worker whose write failed
+  bool failed;
+};
+
+// Writes all `nbytes` of `buf` to `fd` at `offset`, going on after short
+// writes and interruptions.
+//
+// Returns `true` on success
+static bool pwrite_all(const int fd, const uint8_t* buf, size_t nbytes,
+                       off_t offset) {
+  while (nbytes) {
+    const ssize_t written = pwrite(fd, buf, nbytes, offset);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    buf += written;
+    nbytes -= written;
+    offset += written;
+  }
+
+  return true;
+}
+
+// Writes the staging buffers numbered [`begin`, `end`). Buffer s holds file
+// rows s * `stage_rows` onwards, each an image row in reverse order plus its
+// zero padding, and goes out with a single `pwrite`. The buffer is the
+// running thread's scratch, so a worker stages every range in the same one
+static void write_rows(void* arg, size_t begin, size_t end) {
+  struct bmp_writer_s* writer = arg;
+  const uint32_t height = writer->height;
+  const uint32_t row_size = writer->row_size;
+  const uint32_t file_row_size = writer->file_row_size;
+
+  uint8_t* stage =
+      get_thread_scratch((size_t)writer->stage_rows * file_row_size);
+
+  for (size_t s = begin; s < end; s++) {
+    const uint32_t first = s * writer->stage_rows;
+    const uint32_t nrows = height - first < writer->stage_rows
+                               ? height - first
+                               : writer->stage_rows;
+
+    // The `image_data` gets traversed from bottom to top since our `height`
+    // is positive and as per the definition of the BMP file format
+    for (uint32_t r = 0; r < nrows; r++) {
+      uint8_t* file_row = stage + (size_t)r * file_row_size;
+      memcpy(file_row,
+             writer->image_data + (size_t)(height - 1 - first - r) * row_size,
+             row_size);
+      memset(file_row + row_size, 0, file_row_size - row_size);
+    }
+
+    const size_t nbytes = (size_t)nrows * file_row_size;
+    const off_t offset = writer->data_offset + (off_t)first * file_row_size;
+    if (!pwrite_all(writer->fd, stage, nbytes, offset)) {
+      __atomic_store_n(&writer->failed, true, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+// Write the binary `image_data` encoding an image `width` by `height` bits
+// to `output_fname`.
 //
 // The output image will use the 2 color tables supplied. Bits set to 0 will use
 // the color in the 0th color table and likewise bits set to 1 will use the 1st
-// color table
-void write_binary_bmp(const char* output_fname, uint8_t* image_data,
-                      struct color_table_s color_tables[2], const uint32_t N) {
+// color table.
+//
+// The file is sized up front and its rows are written in large staged
+// ranges, spread over threads by `parallel_for_fn`, or written one after
+// another if it is NULL.
+//
+// Returns `true` on success
+bool write_binary_bmp_rect(const char* output_fname, uint8_t* image_data,
+                           struct color_table_s color_tables[2],
+                           const uint32_t width, const uint32_t height,
+                           const bmp_parallel_for_t parallel_for_fn) {
   // Sanity checks as per the BMP standard
   static_assert(sizeof(struct header_s) == 14,
                 "Incorrect size of BMP file header struct");
@@ -213,86 +525,87 @@ void write_binary_bmp(const char* output_fname, uint8_t* image_data,
   static_assert(sizeof(struct color_table_s) == 4,
                 "Incorrect size of color table struct");
 
-  // For now, writes will only support 1-byte aligned images
-  assert(N > 0);
-  assert(!(N % 8));
-
-  struct header_s header;
-  struct info_header_s info_header;
+  // Sanity check the input
+  assert(width > 0 && height > 0);
 
   // Create a file `output_fname` if necessary
-  FILE* f = fopen(output_fname, "wb+");
+  const int fd = open(output_fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
 
   // There was some sort of error
-  if (!f) {
+  if (fd < 0) {
     perror("Error writing BMP file");
-    return;
+    return false;
   }
 
-  // First set the `info_header` accordingly
-  init_info_header(&info_header, N);
-
-  //
-  // Write the `image_data`
-  //
-
-  // Seek past all of the metadata to start writing the `image_data`
-  const uint32_t data_offset =
-      sizeof(header) + sizeof(info_header) + 2 * sizeof(color_tables[0]);
-  fseek(f, data_offset, SEEK_SET);
-
-  // Some useful constants for writing rows to the file
-  const uint32_t row_size = N / 8;
-  uint8_t* image_data_offset = image_data + (N - 1) * row_size;
-
-  // Have an array of 0's to pad each row to a 4-byte alignment as per the BMP
-  // file format
-  const uint32_t npad = row_size & 0b11;
-  uint8_t zeros[3] = {0};
-
-  // The `image_data` gets traversed from bottom to top since our `height`
-  // is positive and as per the definition of the BMP file format
-  uint32_t i;
-  for (i = 0; i < N; i++) {
-    // Write the row to `f`
-    fwrite(image_data_offset, 1, row_size, f);
+  // Rows of `image_data` are packed to whole bytes, and padded to a 4-byte
+  // alignment in the file as per the BMP file format
+  struct bmp_writer_s writer = {
+      .image_data = image_data,
+      .height = height,
+      .row_size = bits_to_bytes(width),
+      .file_row_size = ((width + 31) / 32) * 4,
+      .data_offset = sizeof(struct bmp_headers_s),
+      .fd = fd,
+  };
+  writer.stage_rows = WRITE_STAGE_BYTES / writer.file_row_size
+                          ? WRITE_STAGE_BYTES / writer.file_row_size
+                          : 1;
+
+  const uint64_t file_size =
+      writer.data_offset + (uint64_t)height * writer.file_row_size;
+
+  // Reserve the whole file, so the writers never extend it. Filesystems
+  // without preallocation just get the size
+  if (posix_fallocate(fd, 0, file_size) && ftruncate(fd, file_size)) {
+    perror("Error writing BMP file");
+    close(fd);
+    return false;
+  }
 
-    // Fill the rest of the row with 0's to make it 4-byte aligned
-    fwrite(zeros, 1, npad, f);
+  struct bmp_headers_s headers;
+  init_headers(&headers, color_tables, width, height, file_size);
+  if (!pwrite_all(fd, (const uint8_t*)&headers, sizeof(headers), 0)) {
+    writer.failed = true;
+  }
 
-    // Decrement the `image_data_offset` for the next row
-    image_data_offset -= row_size;
+  const size_t nstages = (height + writer.stage_rows - 1) / writer.stage_rows;
+  if (parallel_for_fn) {
+    parallel_for_fn(nstages, write_rows, &writer);
+  } else {
+    write_rows(&writer, 0, nstages);
   }
 
-  // After writing the image data, set the file `header`
+  if (writer.failed) {
+    perror("Error writing BMP file");
+  }
 
-  // Get the `file_size`
-  fseek(f, 0, SEEK_END);
-  int32_t file_size = ftell(f);
+  // Close the file once finished!
+  close(fd);
 
-  // Sanity check for errors
-  assert(file_size >= 0);
+  return !writer.failed;
+}
 
-  init_header(&header, file_size, data_offset);
+// Write the binary `image_data` encoding an image `N` by `N` bits to
+// `output_fname`, as `write_binary_bmp_rect` does on the calling thread
+void write_binary_bmp(const char* output_fname, uint8_t* image_data,
+                      struct color_table_s color_tables[2], const uint32_t N) {
+  write_binary_bmp_rect(output_fname, image_data, color_tables, N, N, NULL);
+}
 
-  //
-  // Write the file metadata
-  //
+// Writes the headers and 2 color tables of a binary image `width` by `height`
+// bits at the start of `f`, for writers that fill in the pixel data
+// themselves. `file_size` is the size of the whole file, which the header
+// only records if it fits in 32 bits.
+//
+// Returns the offset of the pixel data
+uint32_t write_binary_bmp_headers(FILE* f, struct color_table_s color_tables[2],
+                                  const uint32_t width, const uint32_t height,
+                                  const uint64_t file_size) {
+  struct bmp_headers_s headers;
+  init_headers(&headers, color_tables, width, height, file_size);
 
-  // Seek back to the beginning
   fseek(f, 0, SEEK_SET);
+  fwrite(&headers, 1, sizeof(headers), f);
 
-  // Write the respective headers and such
-  fwrite(&header, 1, sizeof(header), f);
-  fwrite(&info_header, 1, sizeof(info_header), f);
-
-  // The 0th color table is the color of bits that are 0's
-  // and the 1st is for the bits that are 1's
-  fwrite(&color_tables[0], 1, sizeof(color_tables[0]), f);
-  fwrite(&color_tables[1], 1, sizeof(color_tables[1]), f);
-
-  // Close the file once finished!
-  fclose(f);
-
-  return;
+  return sizeof(headers);
 }
@@ -23,7 +23,10 @@
 #ifndef LIBBMP_H
 #define LIBBMP_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 // BMP standard read from:
 //  http://www.ece.ualberta.ca/~elliott/ee552/studentAppNotes/2003_w/misc/bmp_file_format/bmp_file_format.htm
@@ -56,10 +59,63 @@ struct color_table_s {
   uint8_t reserved;
 } __attribute__((packed));
 
+// A binary BMP mapped into memory. `pixels` points straight at the pixel
+// data of the file, `height` rows of `row_size` bytes in file order, so the
+// first row is the bottom of the image when `bottom_up` is set. Seen that
+// way the image is flipped vertically.
+//
+// `pixels` keeps the offset the pixel data has in the file, 62 bytes for
+// the BMPs written here, so it is not word aligned. It must not go to the
+// in-place kernels, `bit_view_materialize` included, which load and store
+// whole aligned words. Read it bytewise or with `bit_view_get_tile`, which
+// copies words out with `memcpy`
+struct bmp_map_s {
+  uint8_t *pixels;
+  int width;
+  int height;
+  int row_size;
+  bool bottom_up;
+  struct color_table_s color_tables[2];
+
+  // the whole mapping
+  void *map;
+  size_t map_size;
+};
+
 uint8_t *read_binary_bmp(const char *fname, int *_w, int *_h, int *_row_size,
                          struct color_table_s color_tables[2]);
 
+bool read_binary_bmp_into(const char *fname, uint8_t **buffer,
+                          size_t *capacity, int *_w, int *_h, int *_row_size,
+                          struct color_table_s color_tables[2]);
+
 void write_binary_bmp(const char *output_fname, uint8_t *image_data,
                       struct color_table_s color_tables[2], const uint32_t N);
 
+// A loop that calls `fn(arg, begin, end)` on ranges covering [0, `n`),
+// possibly on several threads at once, such as `parallel_for`
+typedef void (*bmp_parallel_for_t)(size_t n,
+                                   void (*fn)(void *arg, size_t begin,
+                                              size_t end),
+                                   void *arg);
+
+bool write_binary_bmp_rect(const char *output_fname, uint8_t *image_data,
+                           struct color_table_s color_tables[2],
+                           const uint32_t width, const uint32_t height,
+                           const bmp_parallel_for_t parallel_for_fn);
+
+bool map_binary_bmp(const char *fname, struct bmp_map_s *bmp);
+
+void flip_binary_bmp_rows(struct bmp_map_s *bmp);
+
+void unmap_binary_bmp(struct bmp_map_s *bmp);
+
+FILE *open_binary_bmp(const char *fname, struct header_s *header,
+                      struct info_header_s *info_header,
+                      struct color_table_s color_tables[2]);
+
+uint32_t write_binary_bmp_headers(FILE *f, struct color_table_s color_tables[2],
+                                  const uint32_t width, const uint32_t height,
+                                  const uint64_t file_size);
+
 #endif  // LIBBMP_H
@@ -0,0 +1,1062 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./libg4.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./utils.h"
+
+// The run length codes of T.4, as written in its tables. Entry r < 64 is the
+// terminating code of a run of r pixels, and entry r >= 64 the make-up code
+// of a run of (r - 63) * 64 pixels
+#define NTERMINATING 64
+#define NMAKEUP 27
+static const char *const white_run_codes[NTERMINATING + NMAKEUP] = {
+    "00110101", "000111", "0111", "1000", "1011", "1100", "1110", "1111",
+    "10011", "10100", "00111", "01000", "001000", "000011", "110100",
+    "110101", "101010", "101011", "0100111", "0001100", "0001000", "0010111",
+    "0000011", "0000100", "0101000", "0101011", "0010011", "0100100",
+    "0011000", "00000010", "00000011", "00011010", "00011011", "00010010",
+    "00010011", "00010100", "00010101", "00010110", "00010111", "00101000",
+    "00101001", "00101010", "00101011", "00101100", "00101101", "00000100",
+    "00000101", "00001010", "00001011", "01010010", "01010011", "01010100",
+    "01010101", "00100100", "00100101", "01011000", "01011001", "01011010",
+    "01011011", "01001010", "01001011", "00110010", "00110011", "00110100",
+    // make-up codes of 64 to 1728
+    "11011", "10010", "010111", "0110111", "00110110", "00110111",
+    "01100100", "01100101", "01101000", "01100111", "011001100",
+    "011001101", "011010010", "011010011", "011010100", "011010101",
+    "011010110", "011010111", "011011000", "011011001", "011011010",
+    "011011011", "010011000", "010011001", "010011010", "011000",
+    "010011011",
+};
+static const char *const black_run_codes[NTERMINATING + NMAKEUP] = {
+    "0000110111", "010", "11", "10", "011", "0011", "0010", "00011",
+    "000101", "000100", "0000100", "0000101", "0000111", "00000100",
+    "00000111", "000011000", "0000010111", "0000011000", "0000001000",
+    "00001100111", "00001101000", "00001101100", "00000110111",
+    "00000101000", "00000010111", "00000011000", "000011001010",
+    "000011001011", "000011001100", "000011001101", "000001101000",
+    "000001101001", "000001101010", "000001101011", "000011010010",
+    "000011010011", "000011010100", "000011010101", "000011010110",
+    "000011010111", "000001101100", "000001101101", "000011011010",
+    "000011011011", "000001010100", "000001010101", "000001010110",
+    "000001010111", "000001100100", "000001100101", "000001010010",
+    "000001010011", "000000100100", "000000110111", "000000111000",
+    "000000100111", "000000101000", "000001011000", "000001011001",
+    "000000101011", "000000101100", "000001011010", "000001100110",
+    "000001100111",
+    // make-up codes of 64 to 1728
+    "0000001111", "000011001000", "000011001001", "000001011011",
+    "000000110011", "000000110100", "000000110101", "0000001101100",
+    "0000001101101", "0000001001010", "0000001001011", "0000001001100",
+    "0000001001101", "0000001110010", "0000001110011", "0000001110100",
+    "0000001110101", "0000001110110", "0000001110111", "0000001010010",
+    "0000001010011", "0000001010100", "0000001010101", "0000001011010",
+    "0000001011011", "0000001100100", "0000001100101",
+};
+
+// The make-up codes of 1792 to 2560 that both colors share
+#define NEXTENDED 13
+static const char *const extended_run_codes[NEXTENDED] = {
+    "00000001000",  "00000001100",  "00000001101",  "000000010010",
+    "000000010011", "000000010100", "000000010101", "000000010110",
+    "000000010111", "000000011100", "000000011101", "000000011110",
+    "000000011111",
+};
+
+// The longest run a single make-up code covers
+#define MAX_MAKEUP_RUN 2560
+
+// The coding modes of T.6. Vertical modes are numbered by how far a1 is to
+// the right of b1, plus 3
+enum g4_mode_e {
+  MODE_VERTICAL_L3,
+  MODE_VERTICAL_L2,
+  MODE_VERTICAL_L1,
+  MODE_VERTICAL_0,
+  MODE_VERTICAL_R1,
+  MODE_VERTICAL_R2,
+  MODE_VERTICAL_R3,
+  MODE_PASS,
+  MODE_HORIZONTAL,
+  NMODES
+};
+static const char *const mode_codes[NMODES] = {
+    "0000010", "000010", "010", "1", "011", "000011", "0000011", "0001", "001",
+};
+
+// A code word, right aligned in `bits`
+struct g4_code_s {
+  uint16_t bits;
+  uint8_t length;
+};
+
+// A decoding table entry, looked up with the next bits of the stream. A
+// `length` of 0 is a code that is not in the table
+struct g4_lookup_s {
+  int16_t value;
+  uint8_t length;
+};
+
+// Bits looked at to decode a run or a mode, the longest codes of each
+#define RUN_LOOKUP_BITS 13
+#define MODE_LOOKUP_BITS 7
+
+// Encoding tables, indexed like the code strings, with color 0 white
+static struct g4_code_s run_codes[2][NTERMINATING + NMAKEUP];
+static struct g4_code_s extended_codes[NEXTENDED];
+static struct g4_code_s modes[NMODES];
+
+// Decoding tables, giving a run length or an `enum g4_mode_e`
+static struct g4_lookup_s run_lookup[2][1 << RUN_LOOKUP_BITS];
+static struct g4_lookup_s mode_lookup[1 << MODE_LOOKUP_BITS];
+
+static struct g4_code_s parse_code(const char *code) {
+  struct g4_code_s parsed = {0, strlen(code)};
+  for (int b = 0; b < parsed.length; b++) {
+    parsed.bits = (parsed.bits << 1) | (code[b] == '1');
+  }
+  return parsed;
+}
+
+// Fills in every entry of `lookup` that starts with `code`
+static void add_lookup(struct g4_lookup_s *lookup, const int lookup_bits,
+                       const struct g4_code_s code, const int16_t value) {
+  const int free_bits = lookup_bits - code.length;
+  for (uint32_t rest = 0; rest < (1u << free_bits); rest++) {
+    struct g4_lookup_s *entry = &lookup[(code.bits << free_bits) | rest];
+
+    // The codes are prefix free
+    assert(entry->length == 0);
+    *entry = (struct g4_lookup_s){value, code.length};
+  }
+}
+
+__attribute__((constructor)) static void build_g4_tables(void) {
+  for (int color = 0; color < 2; color++) {
+    const char *const *codes = color ? black_run_codes : white_run_codes;
+    for (int c = 0; c < NTERMINATING + NMAKEUP; c++) {
+      run_codes[color][c] = parse_code(codes[c]);
+      add_lookup(run_lookup[color], RUN_LOOKUP_BITS, run_codes[color][c],
+                 c < NTERMINATING ? c : (c - NTERMINATING + 1) * 64);
+    }
+    for (int c = 0; c < NEXTENDED; c++) {
+      extended_codes[c] = parse_code(extended_run_codes[c]);
+      add_lookup(run_lookup[color], RUN_LOOKUP_BITS, extended_codes[c],
+                 (NMAKEUP + 1 + c) * 64);
+    }
+  }
+
+  for (int m = 0; m < NMODES; m++) {
+    modes[m] = parse_code(mode_codes[m]);
+    add_lookup(mode_lookup, MODE_LOOKUP_BITS, modes[m], m);
+  }
+}
+
+// Bytes read from or written to a file at a time
+#define G4_BUFFER_BYTES (1 << 16)
+
+// Reads the bits of one strip, most significant first
+struct bit_reader_s {
+  FILE *f;
+
+  // bytes of the strip not yet in `buffer`, and the rest of `buffer`
+  uint64_t remaining;
+  uint8_t buffer[G4_BUFFER_BYTES];
+  size_t pos;
+  size_t end;
+
+  // the next `nbits` bits, left aligned
+  uint64_t bits;
+  int nbits;
+
+  // bits of the strip left to consume, which goes negative once bits past
+  // its end were taken
+  int64_t available;
+
+  // FillOrder 2 stores the first pixel in the least significant bit
+  bool reversed;
+};
+
+static uint8_t reverse_byte(uint8_t byte) {
+  byte = (byte & 0xF0) >> 4 | (byte & 0x0F) << 4;
+  byte = (byte & 0xCC) >> 2 | (byte & 0x33) << 2;
+  return (byte & 0xAA) >> 1 | (byte & 0x55) << 1;
+}
+
+// Tops up `reader` to at least 57 bits, with zeros past the end of the strip
+static void refill_bits(struct bit_reader_s *reader) {
+  while (reader->nbits <= 56) {
+    if (reader->pos == reader->end && reader->remaining) {
+      const size_t n = reader->remaining < G4_BUFFER_BYTES
+                           ? reader->remaining
+                           : G4_BUFFER_BYTES;
+      reader->end = fread(reader->buffer, 1, n, reader->f);
+      reader->pos = 0;
+
+      // A truncated file ends the strip early
+      if (reader->end < n) {
+        reader->available -= (reader->remaining - reader->end) * 8;
+        reader->remaining = 0;
+      } else {
+        reader->remaining -= n;
+      }
+    }
+
+    uint8_t byte = 0;
+    if (reader->pos < reader->end) {
+      byte = reader->buffer[reader->pos++];
+      byte = reader->reversed ? reverse_byte(byte) : byte;
+    }
+
+    reader->bits |= (uint64_t)byte << (56 - reader->nbits);
+    reader->nbits += 8;
+  }
+}
+
+// Returns the next `n` bits of `reader` without consuming them
+static inline uint32_t peek_bits(struct bit_reader_s *reader, const int n) {
+  if (reader->nbits < n) {
+    refill_bits(reader);
+  }
+  return reader->bits >> (64 - n);
+}
+
+static inline void consume_bits(struct bit_reader_s *reader, const int n) {
+  reader->bits <<= n;
+  reader->nbits -= n;
+  reader->available -= n;
+}
+
+// Writes bits to a file, most significant first
+struct bit_writer_s {
+  FILE *f;
+  uint8_t buffer[G4_BUFFER_BYTES];
+  size_t pos;
+
+  // the last `nbits` bits of `bits` are yet to be written
+  uint64_t bits;
+  int nbits;
+
+  // bytes written so far
+  uint64_t nbytes;
+  bool failed;
+};
+
+static void flush_buffer(struct bit_writer_s *writer) {
+  if (fwrite(writer->buffer, 1, writer->pos, writer->f) != writer->pos) {
+    writer->failed = true;
+  }
+  writer->nbytes += writer->pos;
+  writer->pos = 0;
+}
+
+static inline void put_code(struct bit_writer_s *writer,
+                            const struct g4_code_s code) {
+  writer->bits = (writer->bits << code.length) | code.bits;
+  writer->nbits += code.length;
+  while (writer->nbits >= 8) {
+    writer->nbits -= 8;
+    writer->buffer[writer->pos++] = writer->bits >> writer->nbits;
+    if (writer->pos == G4_BUFFER_BYTES) {
+      flush_buffer(writer);
+    }
+  }
+}
+
+// Writes the last bits padded with zeros to a whole byte
+static void flush_bits(struct bit_writer_s *writer) {
+  if (writer->nbits) {
+    put_code(writer, (struct g4_code_s){0, 8 - writer->nbits});
+  }
+  flush_buffer(writer);
+}
+
+// A row is described by its changing elements, the positions of the pixels
+// whose color differs from the one before, with an imaginary white pixel in
+// front of the row. Even entries start black runs and odd ones end them.
+// Every list is followed by CHANGE_TERMINATORS copies of the width, so
+// looking a couple of entries ahead never runs off the end
+#define CHANGE_TERMINATORS 4
+
+// Decodes the rows of a strip against the row above each
+struct g4_decoder_s {
+  uint32_t width;
+
+  // the changing elements of the reference row and the row being decoded
+  uint32_t *reference;
+  uint32_t *coding;
+
+  struct bit_reader_s reader;
+};
+
+// Encodes rows against the row above each
+struct g4_encoder_s {
+  uint32_t width;
+  uint32_t *reference;
+  uint32_t *coding;
+
+  // a copy of the row being encoded, padded to whole words
+  uint8_t *row;
+
+  struct bit_writer_s writer;
+};
+
+static uint32_t *alloc_changes(const uint32_t width) {
+  uint32_t *changes =
+      malloc((width + 1 + CHANGE_TERMINATORS) * sizeof(*changes));
+  if (!changes) {
+    printf("Error: Run out of heap space!\n");
+    assert(false);
+  }
+  return changes;
+}
+
+// Makes `changes` an all-white row, the reference of the first row of a strip
+static void reset_changes(uint32_t *changes, const uint32_t width) {
+  for (int t = 0; t < CHANGE_TERMINATORS; t++) {
+    changes[t] = width;
+  }
+}
+
+// Returns b1, the index of the first changing element of `reference` right
+// of `a0` whose color is the opposite of `color`, the color of a0. Indexes
+// below `*start` are known to be at or left of a0, and `*start` is moved up
+static inline uint32_t find_b1(const uint32_t *reference, uint32_t *start,
+                               const int64_t a0, const int color) {
+  uint32_t i = *start;
+  while (reference[i] <= a0) {
+    i++;
+  }
+  *start = i;
+
+  // Even entries are black, odd ones white
+  return i + ((i & 1) != (uint32_t)color);
+}
+
+// Decodes a run of `color` pixels, a chain of make-up codes ended by a
+// terminating code.
+//
+// Returns the run length, or -1 if the bits are not a run length code
+static int64_t decode_run(struct bit_reader_s *reader, const int color) {
+  int64_t run = 0;
+  for (;;) {
+    const struct g4_lookup_s entry =
+        run_lookup[color][peek_bits(reader, RUN_LOOKUP_BITS)];
+    if (!entry.length) {
+      return -1;
+    }
+    consume_bits(reader, entry.length);
+
+    run += entry.value;
+    if (entry.value < NTERMINATING) {
+      return run;
+    }
+  }
+}
+
+// Sets the pixels [`start`, `end`) of `row` black
+static void fill_run(uint8_t *row, const uint32_t start, const uint32_t end) {
+  if (start >= end) {
+    return;
+  }
+
+  const uint32_t first = start / 8;
+  const uint32_t last = (end - 1) / 8;
+  const uint8_t first_mask = 0xFF >> (start % 8);
+  const uint8_t last_mask = 0xFF << (7 - (end - 1) % 8);
+
+  if (first == last) {
+    row[first] |= first_mask & last_mask;
+  } else {
+    row[first] |= first_mask;
+    memset(row + first + 1, 0xFF, last - first - 1);
+    row[last] |= last_mask;
+  }
+}
+
+// Decodes the next row of the strip into `row`, `width` pixels packed into
+// whole bytes.
+//
+// Returns `true` on success
+static bool decode_row(struct g4_decoder_s *decoder, uint8_t *row) {
+  const uint32_t width = decoder->width;
+  const uint32_t *reference = decoder->reference;
+  uint32_t *coding = decoder->coding;
+  struct bit_reader_s *reader = &decoder->reader;
+
+  uint32_t ncoding = 0;
+  uint32_t start = 0;
+  int64_t a0 = -1;
+  int color = 0;
+
+  while (a0 < width) {
+    const struct g4_lookup_s entry =
+        mode_lookup[peek_bits(reader, MODE_LOOKUP_BITS)];
+    if (!entry.length) {
+      return false;
+    }
+    consume_bits(reader, entry.length);
+
+    const uint32_t b1 = find_b1(reference, &start, a0, color);
+
+    if (entry.value == MODE_PASS) {
+      // The run of a0 continues under the b1 b2 run of the row above
+      a0 = reference[b1 + 1];
+
+    } else if (entry.value == MODE_HORIZONTAL) {
+      // Two runs coded by their lengths, the first of the color of a0
+      const int64_t run1 = decode_run(reader, color);
+      const int64_t run2 = run1 < 0 ? -1 : decode_run(reader, !color);
+      const int64_t a1 = (a0 < 0 ? 0 : a0) + run1;
+      const int64_t a2 = a1 + run2;
+      if (run2 < 0 || a2 > width || ncoding + 2 > width + 1) {
+        return false;
+      }
+      coding[ncoding++] = a1;
+      coding[ncoding++] = a2;
+      a0 = a2;
+
+    } else {
+      // A change `entry.value` - 3 pixels right of b1, of the other color
+      const int64_t a1 = (int64_t)reference[b1] + entry.value - MODE_VERTICAL_0;
+      if (a1 <= a0 || a1 > width || ncoding + 1 > width + 1) {
+        return false;
+      }
+      coding[ncoding++] = a1;
+      a0 = a1;
+      color = !color;
+    }
+  }
+
+  // Changes at the right edge only end the row
+  while (ncoding && coding[ncoding - 1] == width) {
+    ncoding--;
+  }
+  for (int t = 0; t < CHANGE_TERMINATORS; t++) {
+    coding[ncoding + t] = width;
+  }
+
+  memset(row, 0, bits_to_bytes(width));
+  for (uint32_t c = 0; c < ncoding; c += 2) {
+    fill_run(row, coding[c], coding[c + 1]);
+  }
+
+  decoder->coding = decoder->reference;
+  decoder->reference = coding;
+
+  return reader->available >= 0;
+}
+
+// Loads the 64 pixels of `row` from word `w` on, the first in the most
+// significant bit
+static inline uint64_t load_pixels(const uint8_t *row, const uint32_t w) {
+  uint64_t word;
+  memcpy(&word, row + w * sizeof(word), sizeof(word));
+  return __builtin_bswap64(word);
+}
+
+// Returns the position of the first pixel of `row` from `p` on whose color
+// is not `color`, or `width` if there is none
+static inline uint32_t next_change(const uint8_t *row, const uint32_t width,
+                                   const uint32_t p, const int color) {
+  const uint64_t flip = color ? ~0ULL : 0;
+  uint32_t w = p / 64;
+  uint64_t word = (load_pixels(row, w) ^ flip) & (~0ULL >> (p % 64));
+
+  while (!word) {
+    if (++w * 64 >= width) {
+      return width;
+    }
+    word = load_pixels(row, w) ^ flip;
+  }
+
+  const uint32_t change = w * 64 + __builtin_clzll(word);
+  return change < width ? change : width;
+}
+
+// Lists the changing elements of `row`, padded to whole words, into
+// `changes`
+static void find_changes(const uint8_t *row, const uint32_t width,
+                         uint32_t *changes) {
+  uint32_t n = 0;
+  int color = 0;
+  for (uint32_t p = next_change(row, width, 0, color); p < width;
+       p = next_change(row, width, p, color)) {
+    changes[n++] = p;
+    color = !color;
+  }
+
+  for (int t = 0; t < CHANGE_TERMINATORS; t++) {
+    changes[n + t] = width;
+  }
+}
+
+// Encodes a run of `color` pixels, as make-up codes for its multiples of 64
+// and a terminating code for the rest
+static void encode_run(struct bit_writer_s *writer, const int color,
+                       uint32_t run) {
+  while (run >= MAX_MAKEUP_RUN) {
+    put_code(writer, extended_codes[NEXTENDED - 1]);
+    run -= MAX_MAKEUP_RUN;
+  }
+
+  if (run >= 64) {
+    const uint32_t makeup = run / 64;
+    put_code(writer, makeup <= NMAKEUP
+                         ? run_codes[color][NTERMINATING + makeup - 1]
+                         : extended_codes[makeup - NMAKEUP - 1]);
+    run %= 64;
+  }
+
+  put_code(writer, run_codes[color][run]);
+}
+
+// Encodes `row`, `width` pixels packed into whole bytes, against the row
+// encoded before it
+static void encode_row(struct g4_encoder_s *encoder, const uint8_t *row) {
+  const uint32_t width = encoder->width;
+  const uint32_t *reference = encoder->reference;
+  uint32_t *coding = encoder->coding;
+  struct bit_writer_s *writer = &encoder->writer;
+
+  memcpy(encoder->row, row, bits_to_bytes(width));
+  find_changes(encoder->row, width, coding);
+
+  uint32_t start = 0;
+  uint32_t a1_index = 0;
+  int64_t a0 = -1;
+  int color = 0;
+
+  while (a0 < width) {
+    while (coding[a1_index] <= a0) {
+      a1_index++;
+    }
+    const uint32_t a1 = coding[a1_index];
+    const uint32_t b1_index = find_b1(reference, &start, a0, color);
+    const uint32_t b1 = reference[b1_index];
+    const uint32_t b2 = reference[b1_index + 1];
+
+    if (b2 < a1) {
+      put_code(writer, modes[MODE_PASS]);
+      a0 = b2;
+
+    } else if (a1 <= b1 + 3 && b1 <= a1 + 3) {
+      put_code(writer, modes[MODE_VERTICAL_0 + (int64_t)a1 - b1]);
+      a0 = a1;
+      color = !color;
+
+    } else {
+      const uint32_t a2 = coding[a1_index + 1];
+      put_code(writer, modes[MODE_HORIZONTAL]);
+      encode_run(writer, color, a1 - (a0 < 0 ? 0 : a0));
+      encode_run(writer, !color, a2 - a1);
+      a0 = a2;
+    }
+  }
+
+  encoder->coding = encoder->reference;
+  encoder->reference = coding;
+}
+
+// TIFF tags and field types used by G4 images
+enum tiff_tag_e {
+  TAG_IMAGE_WIDTH = 256,
+  TAG_IMAGE_LENGTH = 257,
+  TAG_BITS_PER_SAMPLE = 258,
+  TAG_COMPRESSION = 259,
+  TAG_PHOTOMETRIC = 262,
+  TAG_FILL_ORDER = 266,
+  TAG_STRIP_OFFSETS = 273,
+  TAG_SAMPLES_PER_PIXEL = 277,
+  TAG_ROWS_PER_STRIP = 278,
+  TAG_STRIP_BYTE_COUNTS = 279,
+  TAG_T6_OPTIONS = 293,
+};
+
+enum tiff_type_e {
+  TYPE_SHORT = 3,
+  TYPE_LONG = 4,
+};
+
+#define COMPRESSION_G4 4
+#define PHOTOMETRIC_WHITE_IS_ZERO 0
+#define PHOTOMETRIC_BLACK_IS_ZERO 1
+#define FILL_ORDER_REVERSED 2
+
+// The first bytes of little and big endian TIFF files
+static const uint8_t tiff_le_magic[4] = {'I', 'I', 42, 0};
+static const uint8_t tiff_be_magic[4] = {'M', 'M', 0, 42};
+
+struct tiff_header_s {
+  uint8_t magic[4];
+  uint32_t ifd_offset;
+} __attribute__((packed));
+
+struct tiff_entry_s {
+  uint16_t tag;
+  uint16_t type;
+  uint32_t count;
+  uint32_t value;
+} __attribute__((packed));
+
+// Returns `true` if `fname` starts with the magic number of a TIFF
+bool is_g4_tiff(const char *fname) {
+  FILE *f = fopen(fname, "rb");
+  if (!f) {
+    return false;
+  }
+
+  uint8_t magic[4];
+  const bool tiff = fread(magic, 1, 4, f) == 4 &&
+                    (!memcmp(magic, tiff_le_magic, 4) ||
+                     !memcmp(magic, tiff_be_magic, 4));
+
+  fclose(f);
+
+  return tiff;
+}
+
+static uint16_t tiff_u16(const uint16_t value, const bool big_endian) {
+  return big_endian ? __builtin_bswap16(value) : value;
+}
+
+static uint32_t tiff_u32(const uint32_t value, const bool big_endian) {
+  return big_endian ? __builtin_bswap32(value) : value;
+}
+
+// Reads value `index` of the SHORT or LONG field `entry`, byte swapped
+// already. Up to 4 bytes of values sit in the entry itself, the rest at the
+// offset it holds.
+//
+// Returns `false` if the value cannot be read
+static bool read_tiff_value(FILE *f, const struct tiff_entry_s *entry,
+                            const bool big_endian, const uint32_t index,
+                            uint64_t *value) {
+  const uint32_t size = entry->type == TYPE_SHORT ? 2 : 4;
+  if ((entry->type != TYPE_SHORT && entry->type != TYPE_LONG) ||
+      index >= entry->count) {
+    return false;
+  }
+
+  uint8_t bytes[4];
+  if ((uint64_t)entry->count * size <= 4) {
+    memcpy(bytes, (const uint8_t *)&entry->value + index * size, size);
+  } else {
+    const uint64_t offset = tiff_u32(entry->value, big_endian);
+    if (fseek(f, offset + (uint64_t)index * size, SEEK_SET) ||
+        fread(bytes, 1, size, f) != size) {
+      return false;
+    }
+  }
+
+  if (size == 2) {
+    uint16_t v;
+    memcpy(&v, bytes, 2);
+    *value = tiff_u16(v, big_endian);
+  } else {
+    uint32_t v;
+    memcpy(&v, bytes, 4);
+    *value = tiff_u32(v, big_endian);
+  }
+  return true;
+}
+
+// Reads all `entry->count` values of `entry` into a new array
+static uint64_t *read_tiff_values(FILE *f, const struct tiff_entry_s *entry,
+                                  const bool big_endian) {
+  uint64_t *values = malloc(entry->count * sizeof(*values));
+  for (uint32_t v = 0; values && v < entry->count; v++) {
+    if (!read_tiff_value(f, entry, big_endian, v, &values[v])) {
+      free(values);
+      return NULL;
+    }
+  }
+  return values;
+}
+
+// Opens the single-image, bilevel, G4-compressed TIFF `fname` for reading
+// its rows top down with `read_g4_tiff_row`.
+//
+// Returns `true` on success
+bool open_g4_tiff(const char *fname, struct g4_tiff_s *tiff) {
+  // Sanity check the input
+  assert(fname);
+  assert(tiff);
+
+  static_assert(sizeof(struct tiff_header_s) == 8,
+                "Incorrect size of TIFF header struct");
+  static_assert(sizeof(struct tiff_entry_s) == 12,
+                "Incorrect size of TIFF directory entry struct");
+
+  memset(tiff, 0, sizeof(*tiff));
+  tiff->f = fopen(fname, "rb");
+  if (!tiff->f) {
+    perror("Error reading TIFF file");
+    return false;
+  }
+
+  struct tiff_header_s header;
+  uint16_t nentries;
+  if (fread(&header, sizeof(header), 1, tiff->f) != 1 ||
+      (memcmp(header.magic, tiff_le_magic, 4) &&
+       memcmp(header.magic, tiff_be_magic, 4))) {
+    printf("Error reading TIFF header\n");
+    fclose(tiff->f);
+    return false;
+  }
+  const bool big_endian = header.magic[0] == 'M';
+
+  if (fseek(tiff->f, tiff_u32(header.ifd_offset, big_endian), SEEK_SET) ||
+      fread(&nentries, sizeof(nentries), 1, tiff->f) != 1) {
+    printf("Error reading TIFF directory\n");
+    fclose(tiff->f);
+    return false;
+  }
+  nentries = tiff_u16(nentries, big_endian);
+
+  struct tiff_entry_s *entries = malloc(nentries * sizeof(*entries));
+  if (!entries ||
+      fread(entries, sizeof(*entries), nentries, tiff->f) != nentries) {
+    printf("Error reading TIFF directory\n");
+    free(entries);
+    fclose(tiff->f);
+    return false;
+  }
+
+  // The fields that are not given take their default values
+  uint64_t bits_per_sample = 1, compression = 1, fill_order = 1;
+  uint64_t samples_per_pixel = 1, photometric = PHOTOMETRIC_WHITE_IS_ZERO;
+  uint64_t width = 0, height = 0, rows_per_strip = UINT32_MAX;
+  const struct tiff_entry_s *offsets = NULL, *byte_counts = NULL;
+
+  bool ok = true;
+  for (uint16_t e = 0; e < nentries && ok; e++) {
+    struct tiff_entry_s *entry = &entries[e];
+    entry->tag = tiff_u16(entry->tag, big_endian);
+    entry->type = tiff_u16(entry->type, big_endian);
+    entry->count = tiff_u32(entry->count, big_endian);
+
+    uint64_t *field = NULL;
+    switch (entry->tag) {
+      case TAG_IMAGE_WIDTH: field = &width; break;
+      case TAG_IMAGE_LENGTH: field = &height; break;
+      case TAG_BITS_PER_SAMPLE: field = &bits_per_sample; break;
+      case TAG_COMPRESSION: field = &compression; break;
+      case TAG_PHOTOMETRIC: field = &photometric; break;
+      case TAG_FILL_ORDER: field = &fill_order; break;
+      case TAG_SAMPLES_PER_PIXEL: field = &samples_per_pixel; break;
+      case TAG_ROWS_PER_STRIP: field = &rows_per_strip; break;
+      case TAG_STRIP_OFFSETS: offsets = entry; break;
+      case TAG_STRIP_BYTE_COUNTS: byte_counts = entry; break;
+    }
+    if (field) {
+      ok = read_tiff_value(tiff->f, entry, big_endian, 0, field);
+    }
+  }
+
+  tiff->width = width;
+  tiff->height = height;
+  tiff->row = 0;
+  tiff->rows_per_strip = rows_per_strip < height ? rows_per_strip : height;
+  tiff->black_is_zero = photometric == PHOTOMETRIC_BLACK_IS_ZERO;
+
+  ok = ok && width && height && width <= INT32_MAX && height <= INT32_MAX &&
+       tiff->rows_per_strip && bits_per_sample == 1 &&
+       samples_per_pixel == 1 && compression == COMPRESSION_G4 &&
+       photometric <= PHOTOMETRIC_BLACK_IS_ZERO && offsets && byte_counts;
+  if (!ok) {
+    printf("Error: %s is not a bilevel G4-compressed TIFF\n", fname);
+    free(entries);
+    fclose(tiff->f);
+    return false;
+  }
+
+  tiff->nstrips = (height + tiff->rows_per_strip - 1) / tiff->rows_per_strip;
+  tiff->strip_offsets = read_tiff_values(tiff->f, offsets, big_endian);
+  tiff->strip_byte_counts = read_tiff_values(tiff->f, byte_counts, big_endian);
+  free(entries);
+
+  if (!tiff->strip_offsets || !tiff->strip_byte_counts ||
+      offsets->count < tiff->nstrips || byte_counts->count < tiff->nstrips) {
+    printf("Error reading TIFF strips\n");
+    close_g4_tiff(tiff);
+    return false;
+  }
+
+  struct g4_decoder_s *decoder = malloc(sizeof(*decoder));
+  if (!decoder) {
+    printf("Error: Run out of heap space!\n");
+    assert(false);
+  }
+  decoder->width = width;
+  decoder->reference = alloc_changes(width);
+  decoder->coding = alloc_changes(width);
+  decoder->reader.f = tiff->f;
+  decoder->reader.reversed = fill_order == FILL_ORDER_REVERSED;
+  tiff->decoder = decoder;
+
+  return true;
+}
+
+// Decodes the next row of `tiff` into `row`, `width` pixels packed into
+// whole bytes with 1 for black.
+//
+// Returns `true` on success
+bool read_g4_tiff_row(struct g4_tiff_s *tiff, uint8_t *row) {
+  // Sanity check the input
+  assert(tiff);
+  assert(row);
+  assert(tiff->row < tiff->height);
+
+  struct g4_decoder_s *decoder = tiff->decoder;
+
+  // Every strip starts over from an all-white reference row
+  if (tiff->row % tiff->rows_per_strip == 0) {
+    const uint32_t strip = tiff->row / tiff->rows_per_strip;
+    struct bit_reader_s *reader = &decoder->reader;
+    reader->remaining = tiff->strip_byte_counts[strip];
+    reader->pos = reader->end = 0;
+    reader->bits = 0;
+    reader->nbits = 0;
+    reader->available = reader->remaining * 8;
+    reset_changes(decoder->reference, tiff->width);
+
+    if (fseek(tiff->f, tiff->strip_offsets[strip], SEEK_SET)) {
+      return false;
+    }
+  }
+
+  if (!decode_row(decoder, row)) {
+    printf("Error: Corrupt G4 data in row %u\n", tiff->row);
+    return false;
+  }
+  tiff->row++;
+
+  if (tiff->black_is_zero) {
+    const bytes_t row_size = bits_to_bytes(tiff->width);
+    for (bytes_t b = 0; b < row_size; b++) {
+      row[b] = ~row[b];
+    }
+    if (tiff->width % 8) {
+      row[row_size - 1] &= 0xFF << (8 - tiff->width % 8);
+    }
+  }
+
+  return true;
+}
+
+void close_g4_tiff(struct g4_tiff_s *tiff) {
+  if (tiff->decoder) {
+    free(tiff->decoder->reference);
+    free(tiff->decoder->coding);
+    free(tiff->decoder);
+  }
+  free(tiff->strip_offsets);
+  free(tiff->strip_byte_counts);
+  fclose(tiff->f);
+  memset(tiff, 0, sizeof(*tiff));
+}
+
+// Creates the G4-compressed TIFF `fname` of `width` by `height` pixels, to
+// be written top down with `write_g4_tiff_row` and finished with
+// `finish_g4_tiff`. All rows go in a single strip right after the header,
+// and the directory describing them after the strip.
+//
+// Returns `true` on success
+bool create_g4_tiff(const char *fname, struct g4_tiff_writer_s *writer,
+                    const uint32_t width, const uint32_t height) {
+  // Sanity check the input
+  assert(fname);
+  assert(writer);
+  assert(width > 0 && height > 0);
+
+  memset(writer, 0, sizeof(*writer));
+  writer->f = fopen(fname, "wb");
+  if (!writer->f) {
+    perror("Error writing TIFF file");
+    return false;
+  }
+  writer->width = width;
+  writer->height = height;
+
+  // The directory offset is filled in once the strip is written
+  struct tiff_header_s header;
+  memcpy(header.magic, tiff_le_magic, 4);
+  header.ifd_offset = 0;
+  fwrite(&header, sizeof(header), 1, writer->f);
+
+  struct g4_encoder_s *encoder = calloc(1, sizeof(*encoder));
+  const bytes_t padded_row_size = (width + 63) / 64 * sizeof(uint64_t);
+  if (!encoder || !(encoder->row = calloc(padded_row_size, 1))) {
+    printf("Error: Run out of heap space!\n");
+    assert(false);
+  }
+  encoder->width = width;
+  encoder->reference = alloc_changes(width);
+  encoder->coding = alloc_changes(width);
+  encoder->writer.f = writer->f;
+  reset_changes(encoder->reference, width);
+  writer->encoder = encoder;
+
+  return true;
+}
+
+// Encodes `row`, the next row of `writer`, `width` pixels packed into whole
+// bytes with 1 for black.
+//
+// Returns `true` on success
+bool write_g4_tiff_row(struct g4_tiff_writer_s *writer, const uint8_t *row) {
+  // Sanity check the input
+  assert(writer);
+  assert(row);
+  assert(writer->row < writer->height);
+
+  encode_row(writer->encoder, row);
+  writer->row++;
+
+  return !writer->encoder->writer.failed;
+}
+
+// Ends the strip of `writer` and writes the directory describing the image.
+//
+// Returns `true` on success
+bool finish_g4_tiff(struct g4_tiff_writer_s *writer) {
+  // Sanity check the input
+  assert(writer);
+
+  struct g4_encoder_s *encoder = writer->encoder;
+  struct bit_writer_s *bits = &encoder->writer;
+
+  // The strip ends with two EOL codes, and the directory on a word boundary
+  const struct g4_code_s eol = {1, 12};
+  put_code(bits, eol);
+  put_code(bits, eol);
+  flush_bits(bits);
+  if (bits->nbytes & 1) {
+    put_code(bits, (struct g4_code_s){0, 8});
+    flush_buffer(bits);
+  }
+
+  const uint64_t strip_size = bits->nbytes;
+  const uint64_t ifd_offset = sizeof(struct tiff_header_s) + strip_size;
+  bool ok = writer->row == writer->height && !bits->failed &&
+            ifd_offset < UINT32_MAX;
+
+  const struct tiff_entry_s entries[] = {
+      {TAG_IMAGE_WIDTH, TYPE_LONG, 1, writer->width},
+      {TAG_IMAGE_LENGTH, TYPE_LONG, 1, writer->height},
+      {TAG_BITS_PER_SAMPLE, TYPE_SHORT, 1, 1},
+      {TAG_COMPRESSION, TYPE_SHORT, 1, COMPRESSION_G4},
+      {TAG_PHOTOMETRIC, TYPE_SHORT, 1, PHOTOMETRIC_WHITE_IS_ZERO},
+      {TAG_STRIP_OFFSETS, TYPE_LONG, 1, sizeof(struct tiff_header_s)},
+      {TAG_SAMPLES_PER_PIXEL, TYPE_SHORT, 1, 1},
+      {TAG_ROWS_PER_STRIP, TYPE_LONG, 1, writer->height},
+      {TAG_STRIP_BYTE_COUNTS, TYPE_LONG, 1, strip_size},
+      {TAG_T6_OPTIONS, TYPE_LONG, 1, 0},
+  };
+  const uint16_t nentries = sizeof(entries) / sizeof(entries[0]);
+  const uint32_t next_ifd_offset = 0;
+
+  ok = ok && fwrite(&nentries, sizeof(nentries), 1, writer->f) == 1 &&
+       fwrite(entries, sizeof(entries), 1, writer->f) == 1 &&
+       fwrite(&next_ifd_offset, sizeof(next_ifd_offset), 1, writer->f) == 1;
+
+  const uint32_t header_ifd_offset = ifd_offset;
+  ok = ok && !fseek(writer->f, offsetof(struct tiff_header_s, ifd_offset),
+                    SEEK_SET) &&
+       fwrite(&header_ifd_offset, sizeof(header_ifd_offset), 1, writer->f) ==
+           1;
+
+  if (!ok) {
+    perror("Error writing TIFF file");
+  }
+
+  free(encoder->reference);
+  free(encoder->coding);
+  free(encoder->row);
+  free(encoder);
+  ok = !fclose(writer->f) && ok;
+  memset(writer, 0, sizeof(*writer));
+
+  return ok;
+}
+
+// Reads the G4-compressed TIFF `fname` into a new bit matrix, with 1 for
+// black.
+//
+// Returns the bit matrix, or NULL if there was some sort of error
+uint8_t *read_g4_tiff(const char *fname, int *_w, int *_h, int *_row_size) {
+  struct g4_tiff_s tiff;
+  if (!open_g4_tiff(fname, &tiff)) {
+    return NULL;
+  }
+
+  const int row_size = bits_to_bytes(tiff.width);
+  uint8_t *ret_img = alloc_bit_matrix((size_t)tiff.height * row_size);
+  if (!ret_img) {
+    printf("Error: Image size is too large to fit in heap space!\n");
+    assert(false);
+  }
+
+  for (uint32_t j = 0; j < tiff.height; j++) {
+    if (!read_g4_tiff_row(&tiff, ret_img + (size_t)j * row_size)) {
+      free_bit_matrix(ret_img);
+      close_g4_tiff(&tiff);
+      return NULL;
+    }
+  }
+
+  // Set the return dimension values
+  *_w = tiff.width;
+  *_h = tiff.height;
+  *_row_size = row_size;
+
+  close_g4_tiff(&tiff);
+
+  return ret_img;
+}
+
+// Write the binary `image_data` encoding an image `N` by `N` bits to
+// `output_fname` as a G4-compressed TIFF, with bits set to 1 black
+void write_g4_tiff(const char *output_fname, uint8_t *image_data,
+                   const uint32_t N) {
+  // Sanity check the input
+  assert(N > 0);
+
+  struct g4_tiff_writer_s writer;
+  if (!create_g4_tiff(output_fname, &writer, N, N)) {
+    return;
+  }
+
+  const bytes_t row_size = bits_to_bytes(N);
+  for (uint32_t j = 0; j < N; j++) {
+    write_g4_tiff_row(&writer, image_data + j * row_size);
+  }
+
+  finish_g4_tiff(&writer);
+}
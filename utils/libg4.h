@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef LIBG4_H
+#define LIBG4_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// CCITT Group 4 coding read from:
+//  ITU-T Recommendation T.6, with the run length codes of T.4
+// and its TIFF container from:
+//  TIFF Revision 6.0, sections 2, 3 and 11
+//
+// Rows are coded one at a time against the row above them, so an image is
+// read and written a row at a time and never needs to be held whole. Rows
+// are top down and packed into whole bytes with the leftmost pixel in the
+// most significant bit, like our bit matrices, with 1 for black. Images
+// whose samples are BlackIsZero are inverted on the way in, and all images
+// are written WhiteIsZero
+
+// decodes the rows of one strip, and encodes the rows of the output
+struct g4_decoder_s;
+struct g4_encoder_s;
+
+// A G4-compressed TIFF open for reading, with the first `row` rows read
+struct g4_tiff_s {
+  FILE *f;
+  uint32_t width;
+  uint32_t height;
+  uint32_t row;
+
+  // the strips of `rows_per_strip` rows, each coded on its own
+  uint32_t rows_per_strip;
+  uint32_t nstrips;
+  uint64_t *strip_offsets;
+  uint64_t *strip_byte_counts;
+
+  // whether the samples need inverting to make 1 black
+  bool black_is_zero;
+
+  struct g4_decoder_s *decoder;
+};
+
+// A G4-compressed TIFF open for writing, with the first `row` rows written
+struct g4_tiff_writer_s {
+  FILE *f;
+  uint32_t width;
+  uint32_t height;
+  uint32_t row;
+
+  struct g4_encoder_s *encoder;
+};
+
+bool is_g4_tiff(const char *fname);
+
+bool open_g4_tiff(const char *fname, struct g4_tiff_s *tiff);
+
+bool read_g4_tiff_row(struct g4_tiff_s *tiff, uint8_t *row);
+
+void close_g4_tiff(struct g4_tiff_s *tiff);
+
+bool create_g4_tiff(const char *fname, struct g4_tiff_writer_s *writer,
+                    const uint32_t width, const uint32_t height);
+
+bool write_g4_tiff_row(struct g4_tiff_writer_s *writer, const uint8_t *row);
+
+bool finish_g4_tiff(struct g4_tiff_writer_s *writer);
+
+uint8_t *read_g4_tiff(const char *fname, int *_w, int *_h, int *_row_size);
+
+void write_g4_tiff(const char *output_fname, uint8_t *image_data,
+                   const uint32_t N);
+
+#endif  // LIBG4_H
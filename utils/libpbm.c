@@ -0,0 +1,184 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include "./libpbm.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./utils.h"
+
+// The magic number of binary PBM files
+#define PBM_MAGIC "P4"
+
+// Returns `true` if `fname` starts with the magic number of a binary PBM
+bool is_binary_pbm(const char *fname) {
+  FILE *f = fopen(fname, "rb");
+  if (!f) {
+    return false;
+  }
+
+  char magic[2];
+  const bool pbm = fread(magic, 1, 2, f) == 2 && !memcmp(magic, PBM_MAGIC, 2);
+
+  fclose(f);
+
+  return pbm;
+}
+
+// Skips the whitespace and comments in front of the next header field of `f`
+static void skip_header_space(FILE *f) {
+  int c;
+  while ((c = fgetc(f)) != EOF) {
+    if (c == '#') {
+      // A comment runs to the end of the line
+      while ((c = fgetc(f)) != EOF && c != '\n') {
+      }
+    } else if (!isspace(c)) {
+      ungetc(c, f);
+      return;
+    }
+  }
+}
+
+// Reads a positive decimal header field of `f` into `value`
+//
+// Returns `true` on success
+static bool read_header_field(FILE *f, uint32_t *value) {
+  skip_header_space(f);
+
+  uint64_t v = 0;
+  int c, ndigits = 0;
+  while ((c = fgetc(f)) != EOF && isdigit(c)) {
+    v = v * 10 + (c - '0');
+    if (v > INT32_MAX) {
+      return false;
+    }
+    ndigits++;
+  }
+
+  // The field ends at a single whitespace character, which the last field
+  // shares with the start of the pixel data
+  if (!ndigits || v == 0 || c == EOF || !isspace(c)) {
+    return false;
+  }
+
+  *value = v;
+  return true;
+}
+
+// Reads the binary PBM `fname` straight into a new bit matrix, since the
+// rows of the file are already laid out the way they are in memory.
+//
+// Returns the bit matrix, or NULL if there was some sort of error
+uint8_t *read_binary_pbm(const char *fname, int *_w, int *_h, int *_row_size) {
+  // Read `fname`
+  FILE *f = fopen(fname, "rb");
+
+  // There was some sort of error
+  if (!f) {
+    perror("Error reading PBM file");
+    return NULL;
+  }
+
+  char magic[2];
+  uint32_t width, height;
+  if (fread(magic, 1, 2, f) != 2 || memcmp(magic, PBM_MAGIC, 2) ||
+      !read_header_field(f, &width) || !read_header_field(f, &height)) {
+    printf("Error reading PBM headers\n");
+    fclose(f);
+    return NULL;
+  }
+
+  // Rows are packed to whole bytes both in the file and in memory
+  const int row_size = bits_to_bytes(width);
+  const size_t image_size = (size_t)height * row_size;
+
+  uint8_t *ret_img = alloc_bit_matrix(image_size);
+  if (!ret_img) {
+    printf("Error: Image size is too large to fit in heap space!\n");
+    assert(false);
+  }
+
+  if (fread(ret_img, 1, image_size, f) != image_size) {
+    printf("Error: PBM file %s is truncated\n", fname);
+    free_bit_matrix(ret_img);
+    fclose(f);
+    return NULL;
+  }
+
+  fclose(f);
+
+  // Set the return dimension values
+  *_w = width;
+  *_h = height;
+  *_row_size = row_size;
+
+  return ret_img;
+}
+
+// Write the binary `image_data` encoding an image `N` by `N` bits to
+// `output_fname` as a binary PBM, with bits set to 1 black.
+//
+// The rows of `image_data` are the pixel data of the file as they are, so
+// they go out behind the header without being staged
+void write_binary_pbm(const char *output_fname, uint8_t *image_data,
+                      const uint32_t N) {
+  // Sanity check the input
+  assert(N > 0);
+
+  // Create a file `output_fname` if necessary
+  const int fd = open(output_fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+  // There was some sort of error
+  if (fd < 0) {
+    perror("Error writing PBM file");
+    return;
+  }
+
+  char header[32];
+  const int header_size =
+      snprintf(header, sizeof(header), PBM_MAGIC "\n%u %u\n", N, N);
+  const size_t image_size = (size_t)N * bits_to_bytes(N);
+
+  bool failed = write(fd, header, header_size) != header_size;
+
+  // `write` may stop short of large requests
+  for (size_t written = 0; !failed && written < image_size;) {
+    const ssize_t n = write(fd, image_data + written, image_size - written);
+    failed = n <= 0;
+    written += failed ? 0 : n;
+  }
+
+  if (failed) {
+    perror("Error writing PBM file");
+  }
+
+  // Close the file once finished!
+  close(fd);
+
+  return;
+}
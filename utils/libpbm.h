@@ -0,0 +1,44 @@
+/**
+ * Copyright (c) 2020 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef LIBPBM_H
+#define LIBPBM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// PBM standard read from:
+//  https://netpbm.sourceforge.net/doc/pbm.html
+//
+// A binary ("P4") PBM is a short text header followed by the rows top down,
+// each packed into whole bytes with the leftmost pixel in the most
+// significant bit and 1 for black. That is exactly the layout of our bit
+// matrices, so the pixels go to and from the file without being reordered
+
+bool is_binary_pbm(const char *fname);
+
+uint8_t *read_binary_pbm(const char *fname, int *_w, int *_h, int *_row_size);
+
+void write_binary_pbm(const char *output_fname, uint8_t *image_data,
+                      const uint32_t N);
+
+#endif  // LIBPBM_H
@@ -23,11 +23,16 @@
 #include <string.h>  // For `strcmp`
 #include <unistd.h>  // For `getopt`
 
+#include "../snailspeed/daemon.h"
+#include "../snailspeed/pipeline.h"
+#include "../snailspeed/rotate.h"
+#include "../snailspeed/rotate_file.h"
+#include "../snailspeed/stream.h"
+#include "../snailspeed/transpose.h"
+#include "./libg4.h"
 #include "./tester.h"
 #include "./utils.h"
 
-extern void rotate_bit_matrix(uint8_t *img, const bits_t N);
-
 const uint32_t TIER_TIMEOUT = 2000;
 const uint32_t TIMEOUT = 58000;
 const bits_t START_SIZE = 26624;
@@ -48,11 +53,16 @@ int main(int argc, char *argv[]) {
     TEST_FILE,
     TEST_GENERATED,
     TEST_CORRECTNESS,
-    TEST_TIERS
+    TEST_TIERS,
+    TEST_STREAM,
+    TEST_FUSED,
+    TEST_BATCH,
+    TEST_DAEMON
   };
   enum test_type_e test_type = TEST_NOT_SET;
 
-  // The flags for a `TEST_FILE` test type
+  // The flags for a `TEST_FILE`, `TEST_STREAM`, `TEST_FUSED`, `TEST_BATCH` or
+  // `TEST_DAEMON` test type
   char *fname = NULL;
   char *output_fname = NULL;
 
@@ -105,6 +115,35 @@ int main(int argc, char *argv[]) {
           SET_UNUSED(N);
           SET_UNUSED(max_tier);
 
+        } else if (!strcmp("stream", optarg)) {
+          test_type = TEST_STREAM;
+
+          // The fields that should be unused
+          SET_UNUSED(N);
+          SET_UNUSED(max_tier);
+
+        } else if (!strcmp("fused", optarg)) {
+          test_type = TEST_FUSED;
+
+          // The fields that should be unused
+          SET_UNUSED(N);
+          SET_UNUSED(max_tier);
+
+        } else if (!strcmp("batch", optarg)) {
+          test_type = TEST_BATCH;
+
+          // The fields that should be unused
+          SET_UNUSED(N);
+          SET_UNUSED(max_tier);
+
+        } else if (!strcmp("daemon", optarg)) {
+          test_type = TEST_DAEMON;
+
+          // The fields that should be unused
+          SET_UNUSED(fname);
+          SET_UNUSED(N);
+          SET_UNUSED(max_tier);
+
         } else if (!strcmp("tiers", optarg)) {
           test_type = TEST_TIERS;
 
@@ -256,6 +295,51 @@ int main(int argc, char *argv[]) {
 
       break;
     }
+    case TEST_STREAM: {
+      // Both file names are required, since the output never fits in memory
+      if (fname == NULL || output_fname == NULL) {
+        goto help;
+      }
+
+      // The batch size comes from SNAILSPEED_STREAM_STRIPS
+      bool result = run_stream_tester(
+          fname, output_fname,
+          is_g4_tiff(fname) ? rotate_tiff_stream : rotate_bmp_stream, 0);
+      printf("Result: %s\n", result ? PASS_STR : FAIL_STR);
+      break;
+    }
+    case TEST_FUSED: {
+      // The output is written straight from the input file
+      if (fname == NULL || output_fname == NULL) {
+        goto help;
+      }
+
+      bool result = run_file_transform_tester(fname, output_fname,
+                                              rotate_bmp_file, ORIENT_ROTATE_CW);
+      printf("Result: %s\n", result ? PASS_STR : FAIL_STR);
+      break;
+    }
+    case TEST_BATCH: {
+      // `fname` names the inputs and `output_fname` the output directory
+      if (fname == NULL || output_fname == NULL) {
+        goto help;
+      }
+
+      bool result = run_pipeline_tester(fname, output_fname, rotate_bmp_files);
+      printf("Result: %s\n", result ? PASS_STR : FAIL_STR);
+      break;
+    }
+    case TEST_DAEMON: {
+      // `output_fname` is the socket to listen on
+      if (output_fname == NULL) {
+        goto help;
+      }
+
+      // Only returns if the socket could not be set up
+      bool result = run_rotate_daemon(output_fname, 0);
+      printf("Result: %s\n", result ? PASS_STR : FAIL_STR);
+      break;
+    }
     case TEST_GENERATED: {
       // The `N` is a required argument
       if (N == 0) {
@@ -271,7 +355,39 @@ int main(int argc, char *argv[]) {
     case TEST_CORRECTNESS: {
       const bits_t START_SIZE = 64;
 
-      bool correctness = run_correctness_tester(rotate_bit_matrix, START_SIZE);
+      printf("Transpose kernel: %s\n", get_transpose_name());
+
+      bool correctness = run_transpose_correctness_tester();
+      correctness =
+          correctness && run_correctness_tester(rotate_bit_matrix, START_SIZE);
+      correctness =
+          correctness && run_modes_correctness_tester(rotate_bit_matrix);
+      correctness = correctness &&
+                    run_rect_correctness_tester(rotate_bit_matrix_rect,
+                                                rotate_bit_matrix_rect_inplace);
+      correctness =
+          correctness && run_transform_correctness_tester(transform_bit_matrix);
+      correctness = correctness &&
+                    run_batch_correctness_tester(rotate_bit_matrix_batch);
+      correctness = correctness &&
+                    run_fixed_correctness_tester(rotate_bit_matrix_fixed);
+      correctness = correctness && run_view_correctness_tester();
+      correctness = correctness && run_sequence_correctness_tester();
+      correctness = correctness && run_tiles_correctness_tester();
+      correctness = correctness && run_morton_correctness_tester();
+      correctness =
+          correctness && run_stream_correctness_tester(rotate_bmp_stream);
+      correctness = correctness && run_map_correctness_tester();
+      correctness = correctness && run_bmp_write_correctness_tester();
+      correctness = correctness && run_pbm_correctness_tester();
+      correctness =
+          correctness && run_pipeline_correctness_tester(rotate_bmp_files);
+      correctness =
+          correctness && run_g4_correctness_tester(rotate_tiff_stream);
+      correctness = correctness &&
+                    run_file_transform_correctness_tester(rotate_bmp_file);
+      correctness =
+          correctness && run_daemon_correctness_tester(run_rotate_daemon);
       if (correctness)
         printf(PASS_STR ": Congrats! You pass all correctness tests\n");
       else
@@ -313,13 +429,24 @@ help:
       "-t {file|generated|       \t Select a test type                    \t "
       "Required to select test type\n"
       "\t"
-      "    correctness|tiers}\n"
+      "    correctness|tiers|\n"
+      "\t"
+      "    stream|fused|batch|\n"
+      "\t"
+      "    daemon}\n"
       "\t"
       "-f file-name              \t Input file name                       \t "
-      "Required for \"file\" test type\n"
+      "Required for \"file\", \"stream\", \"fused\" and \"batch\"\n"
+      "\t"
+      "                          \t A directory or list file for batch   \t\n"
       "\t"
       "-o output-file-name       \t Output file name                      \t "
-      "Optional for \"file\" test type\n"
+      "Optional for \"file\", required for \"stream\", \"fused\", "
+      "\"batch\", \"daemon\"\n"
+      "\t"
+      "                          \t An output directory for batch        \t\n"
+      "\t"
+      "                          \t The socket to listen on for daemon   \t\n"
       "\t"
       "-N dimension              \t Generated image dimension             \t "
       "Required for \"generated\" test type\n"
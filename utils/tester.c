@@ -21,14 +21,29 @@
  **/
 #include "./tester.h"
 
+#include <dirent.h>
+#include <errno.h>
 #include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "./fasttime.h"
 #include "./libbmp.h"
+#include "./libg4.h"
+#include "./libpbm.h"
 #include "./utils.h"
+#include "../snailspeed/daemon.h"
+#include "../snailspeed/morton.h"
+#include "../snailspeed/pipeline.h"
+#include "../snailspeed/rotate.h"
+#include "../snailspeed/tile_layout.h"
+#include "../snailspeed/thread_pool.h"
+#include "../snailspeed/transpose.h"
+#include "../snailspeed/view.h"
 
 void exitfunc(int sig) {
   printf("End execution due to 58s timeout\n");
@@ -45,13 +60,14 @@ static uint32_t timed_eval(rotate_fn_t rotate_fn, uint8_t *const data,
 
 // Rotates a bit array clockwise 90 degrees.
 //
-// The bit array is of `N` by `N` bits where N is a multiple of 64 and N >= 64
+// The bit array is of `N` by `N` bits. For an odd N the top-left quadrant
+// includes the left half of the middle row, and the center bit stays put
 static void _rotate_bit_matrix(uint8_t *const bit_matrix, const bits_t N) {
   // Get the number of bytes per row in `bit_matrix`
   const uint32_t row_size = bits_to_bytes(N);
 
   uint32_t w, h, quadrant;
-  for (h = 0; h < N / 2; h++) {
+  for (h = 0; h < (N + 1) / 2; h++) {
     for (w = 0; w < N / 2; w++) {
       uint32_t i = w, j = h;
       uint8_t tmp_bit = get_bit(bit_matrix, row_size, i, j);
@@ -77,10 +93,113 @@ static void _rotate_bit_matrix(uint8_t *const bit_matrix, const bits_t N) {
   return;
 }
 
+// Rotates the `rows` by `cols` bit array `src` clockwise 90 degrees into the
+// `cols` by `rows` bit array `dst`, one bit at a time
+static void _rotate_bit_matrix_rect(uint8_t *const src, uint8_t *const dst,
+                                    const bits_t rows, const bits_t cols) {
+  const bytes_t src_row_size = bits_to_bytes(cols);
+  const bytes_t dst_row_size = bits_to_bytes(rows);
+
+  uint32_t i, j;
+  for (j = 0; j < cols; j++) {
+    for (i = 0; i < rows; i++) {
+      // Destination (i, j) comes from source row `rows - 1 - i`, column `j`
+      uint8_t bit = get_bit(src, src_row_size, j, rows - 1 - i);
+      set_bit(dst, dst_row_size, i, j, bit);
+    }
+  }
+
+  return;
+}
+
+// Applies `orientation` to the `N` by `N` bit array `src`, writing the
+// result to `dst`, one bit at a time
+static void _transform_bit_matrix(uint8_t *const src, uint8_t *const dst,
+                                  const bits_t N,
+                                  const enum orientation_e orientation) {
+  const bytes_t row_size = bits_to_bytes(N);
+
+  uint32_t i, j;
+  for (j = 0; j < N; j++) {
+    for (i = 0; i < N; i++) {
+      // Follow source row `j`, column `i` through the transpose and flips
+      uint32_t row = j, column = i;
+      if (orientation & ORIENT_TRANSPOSE_BIT) {
+        row = i;
+        column = j;
+      }
+      if (orientation & ORIENT_FLIP_VERTICAL_BIT) {
+        row = N - 1 - row;
+      }
+      if (orientation & ORIENT_FLIP_HORIZONTAL_BIT) {
+        column = N - 1 - column;
+      }
+
+      uint8_t bit = get_bit(src, row_size, i, j);
+      set_bit(dst, row_size, column, row, bit);
+    }
+  }
+
+  return;
+}
+
+// The image formats the file testers read and write
+enum image_format_e { FORMAT_BMP, FORMAT_PBM, FORMAT_G4_TIFF };
+
+// Tells the format of `fname` by its magic bytes, taking anything else for
+// a BMP
+static enum image_format_e image_format(const char *const fname) {
+  if (is_binary_pbm(fname)) {
+    return FORMAT_PBM;
+  }
+  if (is_g4_tiff(fname)) {
+    return FORMAT_G4_TIFF;
+  }
+  return FORMAT_BMP;
+}
+
+// Reads the image `fname` of the given `format` into a new bit matrix. PBMs
+// and TIFFs have no color tables, so `color_tables` gets white for 0 and
+// black for 1
+static uint8_t *read_image(const char *const fname,
+                           const enum image_format_e format, int *width,
+                           int *height, int *row_size,
+                           struct color_table_s color_tables[2]) {
+  if (format == FORMAT_BMP) {
+    return read_binary_bmp(fname, width, height, row_size, color_tables);
+  }
+
+  color_tables[0] = (struct color_table_s){255, 255, 255, 0};
+  color_tables[1] = (struct color_table_s){0, 0, 0, 0};
+  return format == FORMAT_PBM ? read_binary_pbm(fname, width, height, row_size)
+                              : read_g4_tiff(fname, width, height, row_size);
+}
+
+// Writes the `N` by `N` bit matrix `bit_matrix` to `output_fname` in the
+// format it was read from
+static void write_image(const char *const output_fname,
+                        const enum image_format_e format, uint8_t *bit_matrix,
+                        struct color_table_s color_tables[2], const bits_t N) {
+  switch (format) {
+    case FORMAT_PBM:
+      write_binary_pbm(output_fname, bit_matrix, N);
+      break;
+    case FORMAT_G4_TIFF:
+      write_g4_tiff(output_fname, bit_matrix, N);
+      break;
+    default:
+      write_binary_bmp(output_fname, bit_matrix, color_tables, N);
+      break;
+  }
+}
+
 // Runs the tester for the input file `fname`. Tests the
 // user supplied `rotate_fn` function against a working
 // stock rotation function.
 //
+// `fname` may be a binary BMP or PBM or a G4-compressed TIFF, told apart
+// by its magic bytes.
+//
 // Returns `true` if the tester passed
 bool run_tester(const char *const fname, const rotate_fn_t rotate_fn) {
   // Sanity check the input
@@ -89,28 +208,23 @@ bool run_tester(const char *const fname, const rotate_fn_t rotate_fn) {
 
   struct color_table_s color_tables[2];
   int width, height, row_size;
+  const enum image_format_e format = image_format(fname);
   uint8_t *bit_matrix =
-      read_binary_bmp(fname, &width, &height, &row_size, color_tables);
+      read_image(fname, format, &width, &height, &row_size, color_tables);
 
   // Check whether there was an error
   if (!bit_matrix) {
     return false;
   }
 
-  // Assert that the image is square, that the dimensions are >= 64
-  // bits and a multiple of 64.
-  //
-  // The condition for >= 32 is since the BMP pads the image with 0's
-  // to align each row to 4 bytes. If the image is a multiple of 64,
-  // then there will be no padding, only image.
+  // Assert that the image is square. Any dimension works since every format
+  // is read into rows of whole bytes only
   assert(width == height);
-  assert(width >= 64);
-  assert(width % 64 == 0);
-  assert(width == 8 * row_size);
+  assert(row_size == bits_to_bytes(width));
 
   // Make a copy of `bit_matrix` for the user function to rotate
   const bytes_t bit_matrix_size = height * row_size;
-  uint8_t *bit_matrix_copy = malloc(bit_matrix_size);
+  uint8_t *bit_matrix_copy = alloc_bit_matrix(bit_matrix_size);
   memcpy(bit_matrix_copy, bit_matrix, bit_matrix_size);
 
   // Call the user-defined `rotate_fn` and time it
@@ -123,11 +237,13 @@ bool run_tester(const char *const fname, const rotate_fn_t rotate_fn) {
   bool result = memcmp(bit_matrix, bit_matrix_copy, bit_matrix_size) == 0;
 
   // Clean up after ourselves!
-  free(bit_matrix_copy);
-  free(bit_matrix);
+  free_bit_matrix(bit_matrix_copy);
+  free_bit_matrix(bit_matrix);
 
   // Print the time taken to rotate the images using the
   // user-define `rotate_fn` and stock function
+  printf("Allocation strategy: %s\n", bit_matrix_alloc_name());
+  printf("Transpose kernel: %s\n", get_transpose_name());
   printf("Your time taken: %d ms\n", user_msec);
   printf("Stock time taken: %d ms\n", stock_msec);
 
@@ -139,7 +255,8 @@ bool run_tester(const char *const fname, const rotate_fn_t rotate_fn) {
 // a working stock rotation function.
 //
 // This function saves the user's output rotated image, regardless of
-// correctness, to `output_fname`.
+// correctness, to `output_fname`, in the format of `fname`: a binary BMP or
+// PBM or a G4-compressed TIFF, told apart by its magic bytes.
 //
 // If `correctness` is `false`, always returns `false`. Otherwise
 // returns `true` if the tester passed
@@ -154,24 +271,19 @@ bool run_tester_save_output(const char *const fname,
 
   struct color_table_s color_tables[2];
   int width, height, row_size;
+  const enum image_format_e format = image_format(fname);
   uint8_t *bit_matrix =
-      read_binary_bmp(fname, &width, &height, &row_size, color_tables);
+      read_image(fname, format, &width, &height, &row_size, color_tables);
 
   // Check whether there was an error
   if (!bit_matrix) {
     return false;
   }
 
-  // Assert that the image is square, that the dimensions are >= 64
-  // bits and a multiple of 64.
-  //
-  // The condition for >= 64 is since the BMP pads the image with 0's
-  // to align each row to 4 bytes. If the image is a multiple of 64,
-  // then there will be no padding, only image.
+  // Assert that the image is square. Any dimension works since every format
+  // is read into rows of whole bytes only
   assert(width == height);
-  assert(width >= 64);
-  assert(width % 64 == 0);
-  assert(width == 8 * row_size);
+  assert(row_size == bits_to_bytes(width));
 
   bool result = false;
   uint8_t *bit_matrix_copy = NULL;
@@ -179,14 +291,14 @@ bool run_tester_save_output(const char *const fname,
   if (correctness) {
     // Make a copy of `bit_matrix` for the stock function to rotate
     const bytes_t bit_matrix_size = height * row_size;
-    bit_matrix_copy = malloc(bit_matrix_size);
+    bit_matrix_copy = alloc_bit_matrix(bit_matrix_size);
     memcpy(bit_matrix_copy, bit_matrix, bit_matrix_size);
 
     // Call the user-defined `rotate_fn` and time it
     const uint32_t user_msec = timed_eval(rotate_fn, bit_matrix, width);
 
     // Write the rotated output to `output_fname`
-    write_binary_bmp(output_fname, bit_matrix, color_tables, width);
+    write_image(output_fname, format, bit_matrix, color_tables, width);
 
     // Call our stock rotation function on `bit_matrix`
     const uint32_t stock_msec =
@@ -196,6 +308,8 @@ bool run_tester_save_output(const char *const fname,
 
     // Print the time taken to rotate the images using the
     // user-define `rotate_fn` and stock function
+    printf("Allocation strategy: %s\n", bit_matrix_alloc_name());
+    printf("Transpose kernel: %s\n", get_transpose_name());
     printf("Your time taken: %d ms\n", user_msec);
     printf("Stock time taken: %d ms\n", stock_msec);
 
@@ -206,16 +320,18 @@ bool run_tester_save_output(const char *const fname,
     const uint32_t user_msec = timed_eval(rotate_fn, bit_matrix, width);
 
     // Write the rotated output to `output_fname`
-    write_binary_bmp(output_fname, bit_matrix, color_tables, width);
+    write_image(output_fname, format, bit_matrix, color_tables, width);
 
     // Print the time taken to rotate the image using the
     // user-define `rotate_fn`
+    printf("Allocation strategy: %s\n", bit_matrix_alloc_name());
+    printf("Transpose kernel: %s\n", get_transpose_name());
     printf("Your time taken: %d ms\n", user_msec);
   }
 
   // Clean up after ourselves!
-  free(bit_matrix_copy);
-  free(bit_matrix);
+  free_bit_matrix(bit_matrix_copy);
+  free_bit_matrix(bit_matrix);
 
   return result;
 }
@@ -260,9 +376,6 @@ bool run_tester_generated_bit_matrix(const rotate_fn_t rotate_fn,
   assert(rotate_fn);
   assert(N > 0);
 
-  // Checks whether `N` is a multiple of 64
-  assert(!(N % 64));
-
   const bytes_t row_size = bits_to_bytes(N);
 
   const bytes_t bit_matrix_size = N * row_size;
@@ -279,11 +392,13 @@ bool run_tester_generated_bit_matrix(const rotate_fn_t rotate_fn,
   bool result = memcmp(bit_matrix, bit_matrix_copy, bit_matrix_size) == 0;
 
   // Clean up after ourselves!
-  free(bit_matrix);
-  free(bit_matrix_copy);
+  free_bit_matrix(bit_matrix);
+  free_bit_matrix(bit_matrix_copy);
 
   // Print the time taken to rotate the images using the
   // user-define `rotate_fn` and stock function
+  printf("Allocation strategy: %s\n", bit_matrix_alloc_name());
+  printf("Transpose kernel: %s\n", get_transpose_name());
   printf("Your time taken: %d ms\n", user_msec);
   printf("Stock time taken: %d ms\n", stock_msec);
 
@@ -331,6 +446,8 @@ uint32_t run_tester_tiers(const rotate_fn_t rotate_fn,
   printf("Malloc %zux%zu matrix...\n", tier_sizes[highest_tier],
          tier_sizes[highest_tier]);
   uint8_t *bit_matrix = generate_bit_matrix(tier_sizes[highest_tier], true);
+  printf("Allocation strategy: %s\n", bit_matrix_alloc_name());
+  printf("Transpose kernel: %s\n", get_transpose_name());
 
   if (!bit_matrix) {
     fprintf(stderr,
@@ -416,7 +533,7 @@ uint32_t run_tester_tiers(const rotate_fn_t rotate_fn,
 
 finish:
   // Clean up after ourselves!
-  free(bit_matrix);
+  free_bit_matrix(bit_matrix);
 
   // Print update!
   if (highest_pass >= MAX_TIER + 1) {
@@ -436,56 +553,1920 @@ finish:
   return highest_pass;
 }
 
-// Runs the tester on generated bit matrices of increasing sizes (tiers).
-// Tests the user supplied `rotate_fn` function against a working stock
-// rotation function. The tester doubles the dimension of the bit matrix
-// until the `rotate_fn` cannot rotate it under (<) `timeout` ms
-// or returns an incorrect solution.
+// Rotates a generated `N` by `N` bit matrix three times with the user
+// supplied `rotate_fn`, checking it against the stock rotation function
+// after every turn. Numbers the tests starting at `*tier`
 //
-// Returns the tier number that `rotate_fn` got to
+// Returns `true` if every turn was correct
+static bool run_correctness_test(const rotate_fn_t rotate_fn, const bits_t N,
+                                 uint32_t *tier) {
+  uint8_t *bit_matrix = generate_bit_matrix(N, false);
+  uint8_t *bit_matrix_copy = copy_bit_matrix(bit_matrix, N);
+  const bytes_t row_size = bits_to_bytes(N);
+  const bytes_t bit_matrix_size = N * row_size;
+  bool correctness = true;
+
+  for (uint32_t i = 0; i < 3; i++, (*tier)++) {
+    // Call the user-defined `rotate_fn` and time it
+    const uint32_t user_msec = timed_eval(rotate_fn, bit_matrix, N);
+
+    // Checking correctness - Call our stock rotation function on bit_matrix
+    _rotate_bit_matrix(bit_matrix_copy, N);
+    correctness = memcmp(bit_matrix, bit_matrix_copy, bit_matrix_size) == 0;
+
+    if (!correctness) {  // The rotation was not correct
+      printf(FAIL_STR ": Test %d : Incorrectly rotated %zux%zu matrix\n",
+             *tier, N, N);
+      break;
+    }
+
+    // For some fun!
+    print_test_pass_message(*tier, N, user_msec);
+  }
+
+  // Clean up after ourselves!
+  free_bit_matrix(bit_matrix);
+  free_bit_matrix(bit_matrix_copy);
+
+  return correctness;
+}
+
+// Number of random blocks every transpose kernel is run on
+#define TRANSPOSE_TEST_BLOCKS 256
+
+// Returns `true` if the `n` by `n` block `transposed`, of rows `row_size`
+// bytes, is `block` mirrored about its anti-diagonal, which is what every
+// transpose kernel does to pixels packed most significant bit first
+static bool is_transposed_block(uint8_t *block, uint8_t *transposed,
+                                const uint32_t n, const bytes_t row_size) {
+  for (uint32_t j = 0; j < n; j++) {
+    for (uint32_t i = 0; i < n; i++) {
+      if (get_bit(transposed, row_size, n - 1 - j, n - 1 - i) !=
+          get_bit(block, row_size, i, j)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Runs every transpose kernel this CPU can run, scalar and AVX2 alike, on
+// the same random blocks, plus blank, full and single-bit ones. Tests each
+// result against a bit-by-bit transpose, the 4-block kernels on 4 blocks
+// interleaved, and `transpose_32` on the top left quarter of each block.
+//
+// Returns `true` if every test passed
+bool run_transpose_correctness_tester(void) {
+  const bool has_avx2 = __builtin_cpu_supports("avx2");
+  const struct {
+    const char *name;
+    transpose_fn_t fn;
+    bool needs_avx2;
+  } kernels[] = {{"scalar", transpose_64, false},
+                 {"avx2", transpose_64_avx2, true},
+                 {"movemask", transpose_64_movemask, true}};
+  const uint32_t nkernels = sizeof(kernels) / sizeof(kernels[0]);
+  const struct {
+    const char *name;
+    transpose_fn_t fn;
+    bool needs_avx2;
+  } x4_kernels[] = {{"scalar x4", transpose_64_x4, false},
+                    {"avx2 x4", transpose_64_x4_avx2, true}};
+  const uint32_t nx4_kernels = sizeof(x4_kernels) / sizeof(x4_kernels[0]);
+
+  // The first blocks are blank, full and a single bit, the rest random
+  ROW_TYPE *blocks = calloc(TRANSPOSE_TEST_BLOCKS * BASE, sizeof(ROW_TYPE));
+  assert(blocks);
+  for (uint32_t k = 0; k < BASE; k++) {
+    blocks[BASE + k] = ~(ROW_TYPE)0;
+  }
+  blocks[2 * BASE + 3] = (ROW_TYPE)1 << 42;
+  for (size_t k = 3 * BASE; k < TRANSPOSE_TEST_BLOCKS * BASE; k++) {
+    blocks[k] = (ROW_TYPE)rand() << 40 ^ (ROW_TYPE)rand() << 20 ^ rand();
+  }
+
+  ROW_TYPE block[BASE];
+  ROW_TYPE interleaved[4 * BASE] __attribute__((aligned(32)));
+  uint32_t half_block[BASE / 2];
+  uint32_t test = 0;
+  bool correctness = true;
+
+  for (uint32_t f = 0; f < nkernels && correctness; f++) {
+    if (kernels[f].needs_avx2 && !has_avx2) {
+      printf(PASS_STR ":\tTranspose test %u :\tSkipped %s kernel, which "
+             "this CPU cannot run\n", test++, kernels[f].name);
+      continue;
+    }
+
+    for (uint32_t b = 0; b < TRANSPOSE_TEST_BLOCKS && correctness; b++) {
+      memcpy(block, blocks + b * BASE, sizeof(block));
+      kernels[f].fn(block);
+      correctness = is_transposed_block((uint8_t *)(blocks + b * BASE),
+                                        (uint8_t *)block, BASE,
+                                        sizeof(ROW_TYPE));
+    }
+
+    if (correctness) {
+      printf(PASS_STR ":\tTranspose test %u :\t%s kernel on %d blocks\n",
+             test++, kernels[f].name, TRANSPOSE_TEST_BLOCKS);
+    } else {
+      printf(FAIL_STR ": Transpose test %u : %s kernel is incorrect\n",
+             test++, kernels[f].name);
+    }
+  }
+
+  for (uint32_t f = 0; f < nx4_kernels && correctness; f++) {
+    if (x4_kernels[f].needs_avx2 && !has_avx2) {
+      printf(PASS_STR ":\tTranspose test %u :\tSkipped %s kernel, which "
+             "this CPU cannot run\n", test++, x4_kernels[f].name);
+      continue;
+    }
+
+    for (uint32_t b = 0; b + 4 <= TRANSPOSE_TEST_BLOCKS && correctness;
+         b += 4) {
+      for (uint32_t k = 0; k < BASE; k++) {
+        for (uint32_t m = 0; m < 4; m++) {
+          interleaved[4 * k + m] = blocks[(b + m) * BASE + k];
+        }
+      }
+      x4_kernels[f].fn(interleaved);
+
+      for (uint32_t m = 0; m < 4 && correctness; m++) {
+        for (uint32_t k = 0; k < BASE; k++) {
+          block[k] = interleaved[4 * k + m];
+        }
+        correctness = is_transposed_block((uint8_t *)(blocks + (b + m) * BASE),
+                                          (uint8_t *)block, BASE,
+                                          sizeof(ROW_TYPE));
+      }
+    }
+
+    if (correctness) {
+      printf(PASS_STR ":\tTranspose test %u :\t%s kernel on %d blocks\n",
+             test++, x4_kernels[f].name, TRANSPOSE_TEST_BLOCKS);
+    } else {
+      printf(FAIL_STR ": Transpose test %u : %s kernel is incorrect\n",
+             test++, x4_kernels[f].name);
+    }
+  }
+
+  // The top left quarter of each block, as 32 rows of 32 bits
+  for (uint32_t b = 0; b < TRANSPOSE_TEST_BLOCKS && correctness; b++) {
+    uint32_t original[BASE / 2];
+    for (uint32_t k = 0; k < BASE / 2; k++) {
+      original[k] = blocks[b * BASE + k];
+    }
+    memcpy(half_block, original, sizeof(half_block));
+    transpose_32(half_block);
+    correctness = is_transposed_block((uint8_t *)original,
+                                      (uint8_t *)half_block, BASE / 2,
+                                      sizeof(uint32_t));
+  }
+  if (correctness) {
+    printf(PASS_STR ":\tTranspose test %u :\t32x32 kernel on %d blocks\n",
+           test, TRANSPOSE_TEST_BLOCKS);
+  } else {
+    printf(FAIL_STR ": Transpose test %u : 32x32 kernel is incorrect\n",
+           test);
+  }
+
+  free(blocks);
+
+  return correctness;
+}
+
+// Runs the tester on generated bit matrices of increasing sizes (tiers),
+// starting from multiples of 64 and finishing with a few sizes that are
+// not, first on one thread and then on a pool of four. Tests the user
+// supplied `rotate_fn` function against a working stock rotation function.
 //
+// Returns `true` if every test passed
 bool run_correctness_tester(const rotate_fn_t rotate_fn, const bits_t start_n) {
   // Sanity check the input
   assert(rotate_fn);
   assert(start_n % 64 == 0);
 
-  // Start rotating with start_nxstart_n bit matrices and increase N by
-  // SQRT_GOLDEN_RATIO the dimension when incrementing the `tier`
-  bits_t N = start_n;
+  const int thread_counts[] = {1, 4};
+  const uint32_t nthread_counts =
+      sizeof(thread_counts) / sizeof(thread_counts[0]);
+  const int saved_threads = get_num_threads();
+
+  uint32_t tier = 0;
+  bool correctness = true;
+  for (uint32_t t = 0; t < nthread_counts && correctness; t++) {
+    set_num_threads(thread_counts[t]);
+    printf("Rotating on %d thread(s)\n", thread_counts[t]);
+
+    // Start rotating with start_nxstart_n bit matrices and increase N by
+    // SQRT_GOLDEN_RATIO the dimension when incrementing the `tier`
+    const double SQRT_GOLDEN_RATIO = 1.2720196495141103;
+
+    // Be sure to increase the matrix dimension on every iteration
+    for (bits_t N = start_n; N < 10000 && correctness;
+         N = (uint64_t)ceil(N * SQRT_GOLDEN_RATIO / 64) * 64) {
+      correctness = run_correctness_test(rotate_fn, N, &tier);
+    }
+
+    // Sizes with partial bytes, partial words and odd centers, and a couple
+    // of real page sizes
+    const bits_t ragged_sizes[] = {1, 2, 7, 63, 65, 100, 129, 1700, 2550};
+    const uint32_t nragged_sizes =
+        sizeof(ragged_sizes) / sizeof(ragged_sizes[0]);
+
+    for (uint32_t i = 0; i < nragged_sizes && correctness; i++) {
+      correctness = run_correctness_test(rotate_fn, ragged_sizes[i], &tier);
+    }
+  }
+
+  set_num_threads(saved_threads);
+  return correctness;
+}
+
+// Runs the tester on generated bit matrices of a few multiples of 64 with
+// every combination of super-tiles and prefetching, on one thread and on
+// four. Sizes with a fixed kernel are among them, since either mode sends
+// those down the general path. Tests the user supplied `rotate_fn` function
+// against a working stock rotation function.
+//
+// Returns `true` if every test passed
+bool run_modes_correctness_tester(const rotate_fn_t rotate_fn) {
+  // Sanity check the input
+  assert(rotate_fn);
+
+  // Odd and even block counts, below and above one super-tile, and two
+  // sizes with fixed kernels
+  const bits_t sizes[] = {64, 192, 1024, 1472, 4096};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+  const struct {
+    bool super_tiles;
+    size_t prefetch_distance;
+  } modes[] = {{true, 0}, {false, 4}, {true, 4}};
+  const uint32_t nmodes = sizeof(modes) / sizeof(modes[0]);
+  const int thread_counts[] = {1, 4};
+  const uint32_t nthread_counts =
+      sizeof(thread_counts) / sizeof(thread_counts[0]);
+
+  const bool saved_super_tiles = get_super_tiles();
+  const size_t saved_prefetch_distance = get_prefetch_distance();
+  const int saved_threads = get_num_threads();
 
   uint32_t tier = 0;
-  bool correctness;
-  const double SQRT_GOLDEN_RATIO = 1.2720196495141103;
+  bool correctness = true;
+  for (uint32_t m = 0; m < nmodes && correctness; m++) {
+    for (uint32_t t = 0; t < nthread_counts && correctness; t++) {
+      set_super_tiles(modes[m].super_tiles);
+      set_prefetch_distance(modes[m].prefetch_distance);
+      set_num_threads(thread_counts[t]);
+      printf("Rotating with super-tiles %s, prefetching %zu ahead, on %d "
+             "thread(s)\n",
+             modes[m].super_tiles ? "on" : "off", modes[m].prefetch_distance,
+             thread_counts[t]);
+
+      for (uint32_t s = 0; s < nsizes && correctness; s++) {
+        correctness = run_correctness_test(rotate_fn, sizes[s], &tier);
+      }
+    }
+  }
 
-  // Be sure to increase the matrix dimension on every iteration
-  for (; N < 10000; N = (uint64_t)ceil(N * SQRT_GOLDEN_RATIO / 64) * 64) {
+  set_super_tiles(saved_super_tiles);
+  set_prefetch_distance(saved_prefetch_distance);
+  set_num_threads(saved_threads);
+  return correctness;
+}
+
+// Runs the tester on generated rectangular bit matrices of a few fixed
+// shapes. Tests the user supplied out-of-place `rotate_rect_fn` and in-place
+// `inplace_fn` functions against a working stock rotation function.
+//
+// Returns `true` if every test passed
+bool run_rect_correctness_tester(const rotate_rect_fn_t rotate_rect_fn,
+                                 const rotate_rect_inplace_fn_t inplace_fn) {
+  // Sanity check the input
+  assert(rotate_rect_fn);
+  assert(inplace_fn);
+
+  // Tall, wide, coprime block counts, one square shape and one large
+  // enough for streaming stores
+  const bits_t shapes[][2] = {{64, 128},   {128, 64},   {192, 640},
+                              {1024, 320}, {64, 2368},  {4096, 1472},
+                              {960, 960},  {4096, 8256}};
+  const uint32_t nshapes = sizeof(shapes) / sizeof(shapes[0]);
+
+  for (uint32_t tier = 0; tier < nshapes; tier++) {
+    const bits_t rows = shapes[tier][0];
+    const bits_t cols = shapes[tier][1];
+    const bytes_t bit_matrix_size = rows * bits_to_bytes(cols);
+
+    uint8_t *bit_matrix = alloc_bit_matrix(bit_matrix_size);
+    uint8_t *expected = alloc_bit_matrix(bit_matrix_size);
+    uint8_t *rotated = alloc_bit_matrix(bit_matrix_size);
+    if (!bit_matrix || !expected || !rotated) {
+      printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+      assert(false);
+    }
+
+    for (bytes_t i = 0; i < bit_matrix_size; i++) {
+      bit_matrix[i] = rand();
+    }
+
+    _rotate_bit_matrix_rect(bit_matrix, expected, rows, cols);
+
+    // Call the user-defined out-of-place `rotate_rect_fn` and time it
+    fasttime_t start = gettime();
+    rotate_rect_fn(bit_matrix, rotated, rows, cols);
+    const uint32_t user_msec = tdiff_msec(start, gettime());
+    bool correctness = memcmp(rotated, expected, bit_matrix_size) == 0;
+
+    // Then the user-defined in-place `inplace_fn`
+    if (correctness) {
+      inplace_fn(bit_matrix, rows, cols);
+      correctness = memcmp(bit_matrix, expected, bit_matrix_size) == 0;
+    }
+
+    free_bit_matrix(bit_matrix);
+    free_bit_matrix(expected);
+    free_bit_matrix(rotated);
+
+    if (!correctness) {  // The rotation was not correct
+      printf(FAIL_STR ": Rect test %d : Incorrectly rotated %zux%zu matrix\n",
+             tier, rows, cols);
+      return false;
+    }
+
+    printf(PASS_STR ":\tRect test %d :\tRotated %zux%zu\tmatrix in %d ms\n",
+           tier, rows, cols, user_msec);
+  }
+
+  return true;
+}
+
+// Runs the tester on generated bit matrices of a few sizes, applying every
+// orientation to each. Tests the user supplied `transform_fn` function
+// against a working stock transform function.
+//
+// Returns `true` if every test passed
+bool run_transform_correctness_tester(const transform_fn_t transform_fn) {
+  // Sanity check the input
+  assert(transform_fn);
+
+  // Odd and even numbers of blocks per side
+  const bits_t sizes[] = {64, 128, 192, 1024, 1472};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  uint32_t tier = 0;
+  for (uint32_t s = 0; s < nsizes; s++) {
+    const bits_t N = sizes[s];
+    const bytes_t bit_matrix_size = N * bits_to_bytes(N);
+
+    uint8_t *bit_matrix = generate_bit_matrix(N, false);
+    uint8_t *expected = alloc_bit_matrix(bit_matrix_size);
+    if (!expected) {
+      printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+      assert(false);
+    }
+
+    for (int orientation = 0; orientation < NORIENTATIONS;
+         orientation++, tier++) {
+      // Transform our own copy of the input first, since the user-defined
+      // `transform_fn` works in place
+      _transform_bit_matrix(bit_matrix, expected, N, orientation);
+
+      fasttime_t start = gettime();
+      transform_fn(bit_matrix, N, orientation);
+      const uint32_t user_msec = tdiff_msec(start, gettime());
+
+      if (memcmp(bit_matrix, expected, bit_matrix_size)) {
+        printf(FAIL_STR ": Transform test %d : Incorrect %s of %zux%zu matrix\n",
+               tier, get_orientation_name(orientation), N, N);
+        free_bit_matrix(bit_matrix);
+        free_bit_matrix(expected);
+        return false;
+      }
+
+      printf(PASS_STR ":\tTransform test %d :\t%s of %zux%zu\tmatrix in %d ms\n",
+             tier, get_orientation_name(orientation), N, N, user_msec);
+    }
+
+    free_bit_matrix(bit_matrix);
+    free_bit_matrix(expected);
+  }
+
+  return true;
+}
+
+// Runs the tester on batches of generated bit matrices of a few sizes and
+// counts, including counts that leave a short last group of lanes. Tests
+// the user supplied `rotate_batch_fn` function against a working stock
+// rotation function applied to every matrix.
+//
+// Returns `true` if every test passed
+bool run_batch_correctness_tester(const rotate_batch_fn_t rotate_batch_fn) {
+  // Sanity check the input
+  assert(rotate_batch_fn);
+
+  const bits_t sizes[] = {64, 128, 192, 512, 100};
+  const size_t counts[] = {1, 7, 64};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+  const uint32_t ncounts = sizeof(counts) / sizeof(counts[0]);
+
+  uint32_t tier = 0;
+  for (uint32_t s = 0; s < nsizes; s++) {
+    for (uint32_t c = 0; c < ncounts; c++, tier++) {
+      const bits_t N = sizes[s];
+      const size_t count = counts[c];
+      const bytes_t bit_matrix_size = N * bits_to_bytes(N);
+
+      uint8_t **bit_matrices = malloc(count * sizeof(*bit_matrices));
+      uint8_t **expected = malloc(count * sizeof(*expected));
+      assert(bit_matrices && expected);
+
+      for (size_t m = 0; m < count; m++) {
+        bit_matrices[m] = alloc_bit_matrix(bit_matrix_size);
+        expected[m] = alloc_bit_matrix(bit_matrix_size);
+        if (!bit_matrices[m] || !expected[m]) {
+          printf(
+              "Error: Run out of heap space! Please try smaller matrix "
+              "size.\n");
+          assert(false);
+        }
+
+        for (bytes_t i = 0; i < bit_matrix_size; i++) {
+          bit_matrices[m][i] = rand();
+        }
+        memcpy(expected[m], bit_matrices[m], bit_matrix_size);
+        _rotate_bit_matrix(expected[m], N);
+      }
+
+      // Call the user-defined `rotate_batch_fn` and time it
+      fasttime_t start = gettime();
+      rotate_batch_fn(bit_matrices, count, N);
+      const uint32_t user_msec = tdiff_msec(start, gettime());
+
+      bool correctness = true;
+      for (size_t m = 0; m < count; m++) {
+        correctness = correctness &&
+                      !memcmp(bit_matrices[m], expected[m], bit_matrix_size);
+        free_bit_matrix(bit_matrices[m]);
+        free_bit_matrix(expected[m]);
+      }
+      free(bit_matrices);
+      free(expected);
+
+      if (!correctness) {  // The rotation was not correct
+        printf(FAIL_STR ": Batch test %d : Incorrectly rotated %zu %zux%zu "
+               "matrices\n", tier, count, N, N);
+        return false;
+      }
+
+      printf(PASS_STR ":\tBatch test %d :\tRotated %zu %zux%zu\tmatrices "
+             "in %d ms\n", tier, count, N, N, user_msec);
+    }
+  }
+
+  return true;
+}
+
+// Runs the tester on generated bit matrices of every size and tile width
+// with a compiled kernel, calling the user supplied `rotate_fixed_fn` for
+// each one. Tests it against a working stock rotation function. Also checks
+// that `rotate_bit_matrix` picks a tile that keeps every thread busy on 1,
+// 4 and 32 threads, and that it rotates correctly with it on 1 and 4.
+//
+// Returns `true` if every test passed
+bool run_fixed_correctness_tester(const rotate_fixed_fn_t rotate_fixed_fn) {
+  // Sanity check the input
+  assert(rotate_fixed_fn);
+
+  const bits_t sizes[] = {1024, 2048, 4096, 8192};
+  const bits_t tiles[] = {32, 64, 128, 256};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+  const uint32_t ntiles = sizeof(tiles) / sizeof(tiles[0]);
+
+  uint32_t tier = 0;
+  for (uint32_t s = 0; s < nsizes; s++) {
+    const bits_t N = sizes[s];
+    const bytes_t bit_matrix_size = N * bits_to_bytes(N);
     uint8_t *bit_matrix = generate_bit_matrix(N, false);
-    uint8_t *bit_matrix_copy = copy_bit_matrix(bit_matrix, N);
+    uint8_t *expected = copy_bit_matrix(bit_matrix, N);
+
+    for (uint32_t t = 0; t < ntiles; t++, tier++) {
+      // Call the user-defined `rotate_fixed_fn` and time it
+      fasttime_t start = gettime();
+      bool correctness = rotate_fixed_fn(bit_matrix, N, tiles[t]);
+      const uint32_t user_msec = tdiff_msec(start, gettime());
+
+      _rotate_bit_matrix(expected, N);
+      correctness = correctness &&
+                    memcmp(bit_matrix, expected, bit_matrix_size) == 0;
+
+      if (!correctness) {  // The rotation was not correct
+        printf(FAIL_STR ": Fixed test %d : Incorrectly rotated %zux%zu "
+               "matrix with %zu-bit tiles\n", tier, N, N, tiles[t]);
+        free_bit_matrix(bit_matrix);
+        free_bit_matrix(expected);
+        return false;
+      }
+
+      printf(PASS_STR ":\tFixed test %d :\tRotated %zux%zu\tmatrix with "
+             "%zu-bit tiles in %d ms\n", tier, N, N, tiles[t], user_msec);
+    }
+
+    free_bit_matrix(bit_matrix);
+    free_bit_matrix(expected);
+  }
+
+  // `rotate_bit_matrix` picks a tile for these sizes that keeps every
+  // thread busy, or the narrowest vector one if none does
+  const size_t saved_threads = get_num_threads();
+  const size_t threads[] = {1, 4, 32};
+  const uint32_t nthreads = sizeof(threads) / sizeof(threads[0]);
+  for (uint32_t n = 0; n < nthreads; n++, tier++) {
+    set_num_threads(threads[n]);
+
+    bool correctness = true;
+    for (uint32_t s = 0; s < nsizes && correctness; s++) {
+      const bits_t N = sizes[s];
+      const bits_t tile = get_fixed_tile(N);
+      const size_t half = tile ? N / tile / 2 : 0;
+      correctness = tile == 64 || (tile && half * half >= threads[n]);
+
+      // Running on 32 threads would leave them all behind for the testers
+      // that follow, so that count only checks the pick
+      if (correctness && threads[n] <= 4) {
+        const bytes_t bit_matrix_size = N * bits_to_bytes(N);
+        uint8_t *bit_matrix = generate_bit_matrix(N, false);
+        uint8_t *expected = copy_bit_matrix(bit_matrix, N);
+        rotate_bit_matrix(bit_matrix, N);
+        _rotate_bit_matrix(expected, N);
+        correctness = memcmp(bit_matrix, expected, bit_matrix_size) == 0;
+        free_bit_matrix(bit_matrix);
+        free_bit_matrix(expected);
+      }
+
+      if (!correctness) {
+        printf(FAIL_STR ": Fixed test %d : Incorrectly rotated %zux%zu "
+               "matrix with %zu-bit tiles on %zu threads\n", tier, N, N,
+               tile, threads[n]);
+      }
+    }
+    if (!correctness) {
+      set_num_threads(saved_threads);
+      return false;
+    }
+
+    printf(PASS_STR ":\tFixed test %d :\tPicked tiles of %zu, %zu, %zu and "
+           "%zu bits on %zu threads\n", tier, get_fixed_tile(sizes[0]),
+           get_fixed_tile(sizes[1]), get_fixed_tile(sizes[2]),
+           get_fixed_tile(sizes[3]), threads[n]);
+  }
+  set_num_threads(saved_threads);
+
+  return true;
+}
+
+// Packs the 64 pixels of row `j` of `img` starting at column `i` into a row
+// word, one pixel at a time. Pixels past the right edge are 0
+static uint64_t _get_row(uint8_t *img, const bits_t N, uint32_t i,
+                         uint32_t j) {
+  uint8_t bytes[8] = {0};
+  for (uint32_t x = 0; x < 64 && i + x < N; x++) {
+    if (get_bit(img, bits_to_bytes(N), i + x, j)) {
+      bytes[x / 8] |= 0b10000000 >> (x % 8);
+    }
+  }
+
+  uint64_t word;
+  memcpy(&word, bytes, sizeof(word));
+  return word;
+}
+
+// Runs the tester on views of generated bit matrices of a few sizes under
+// every orientation. Checks single pixels, row spans at assorted offsets,
+// tiles, including those over the edges, and materialization, including
+// its cleared row padding, against a working stock transform function.
+//
+// Returns `true` if every test passed
+bool run_view_correctness_tester(void) {
+  const bits_t sizes[] = {64, 100, 192, 1000};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  uint32_t tier = 0;
+  for (uint32_t s = 0; s < nsizes; s++) {
+    const bits_t N = sizes[s];
     const bytes_t row_size = bits_to_bytes(N);
     const bytes_t bit_matrix_size = N * row_size;
 
-    for (uint32_t i = 0; i < 3; i++, tier++) {
-      // Call the user-defined `rotate_fn` and time it
-      const uint32_t user_msec = timed_eval(rotate_fn, bit_matrix, N);
+    for (int orientation = 0; orientation < NORIENTATIONS;
+         orientation++, tier++) {
+      uint8_t *bit_matrix = generate_bit_matrix(N, false);
+      uint8_t *expected = alloc_bit_matrix(bit_matrix_size);
+      if (!expected) {
+        printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+        assert(false);
+      }
+      memset(expected, 0, bit_matrix_size);
+      _transform_bit_matrix(bit_matrix, expected, N, orientation);
+
+      struct bit_view_s view = make_bit_view(bit_matrix, N, orientation);
+      bool correctness = true;
+
+      for (uint32_t j = 0; j < N && correctness; j++) {
+        for (uint32_t i = 0; i < N; i++) {
+          correctness = correctness && bit_view_get_bit(&view, i, j) ==
+                                           get_bit(expected, row_size, i, j);
+        }
+        for (uint32_t i = 0; i < N; i += 37) {
+          correctness = correctness && bit_view_get_row(&view, i, j) ==
+                                           _get_row(expected, N, i, j);
+        }
+      }
 
-      // Checking correctness - Call our stock rotation function on bit_matrix
-      _rotate_bit_matrix(bit_matrix_copy, N);
-      correctness = memcmp(bit_matrix, bit_matrix_copy, bit_matrix_size) == 0;
+      // Tiles over the right and bottom edges read 0 outside the matrix
+      uint64_t tile[64];
+      for (uint32_t j = 0; j < N && correctness; j += 50) {
+        for (uint32_t i = 0; i < N; i += 50) {
+          bit_view_get_tile(&view, i, j, tile);
+          for (uint32_t k = 0; k < 64; k++) {
+            const uint64_t row =
+                j + k < N ? _get_row(expected, N, i, j + k) : 0;
+            correctness = correctness && tile[k] == row;
+          }
+        }
+      }
 
-      if (!correctness) {  // The rotation was not correct
-        printf(FAIL_STR ": Test %d : Incorrectly rotated %zux%zu matrix\n",
-               tier, N, N);
+      // Then move the pixels and compare them one by one
+      if (correctness) {
+        fasttime_t start = gettime();
+        bit_view_materialize(&view);
+        const uint32_t user_msec = tdiff_msec(start, gettime());
+        correctness = view.orientation == ORIENT_IDENTITY;
+
+        // The padding bits at the end of each row come out clear once the
+        // pixels have moved
+        const uint8_t padding =
+            N % 8 && orientation != ORIENT_IDENTITY ? 0xFF >> (N % 8) : 0;
+        for (uint32_t j = 0; j < N && correctness; j++) {
+          for (uint32_t i = 0; i < N; i++) {
+            correctness = correctness && get_bit(bit_matrix, row_size, i, j) ==
+                                             get_bit(expected, row_size, i, j);
+          }
+          correctness = correctness &&
+                        !(bit_matrix[j * row_size + row_size - 1] & padding);
+        }
+
+        if (correctness) {
+          printf(PASS_STR ":\tView test %d :\t%s view of %zux%zu\tmatrix, "
+                 "materialized in %d ms\n", tier,
+                 get_orientation_name(orientation), N, N, user_msec);
+        }
+      }
+
+      free_bit_matrix(bit_matrix);
+      free_bit_matrix(expected);
+
+      if (!correctness) {  // The view was not correct
+        printf(FAIL_STR ": View test %d : Incorrect %s view of %zux%zu "
+               "matrix\n", tier, get_orientation_name(orientation), N, N);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Runs the tester on every pair of orientations, and on four clockwise
+// turns in a row, applied to generated bit matrices of a few sizes. Tests
+// the fused `transform_bit_matrix_sequence` against the stock transform
+// function applied once per orientation, and a ragged clockwise turn against
+// `rotate_bit_matrix`, printing the time each took.
+//
+// Returns `true` if every test passed
+bool run_sequence_correctness_tester(void) {
+  const bits_t sizes[] = {128, 100};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
 
-        // Exit!
+  uint32_t tier = 0;
+  for (uint32_t s = 0; s < nsizes; s++) {
+    const bits_t N = sizes[s];
+    const bytes_t row_size = bits_to_bytes(N);
+    const bytes_t bit_matrix_size = N * row_size;
+
+    uint8_t *bit_matrix = generate_bit_matrix(N, false);
+    uint8_t *expected = alloc_bit_matrix(bit_matrix_size);
+    uint8_t *scratch = alloc_bit_matrix(bit_matrix_size);
+    if (!expected || !scratch) {
+      printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+      assert(false);
+    }
+
+    // every pair of orientations, then four clockwise turns
+    for (int pair = 0; pair <= NORIENTATIONS * NORIENTATIONS; pair++, tier++) {
+      enum orientation_e orientations[4];
+      size_t count = 2;
+      if (pair < NORIENTATIONS * NORIENTATIONS) {
+        orientations[0] = pair / NORIENTATIONS;
+        orientations[1] = pair % NORIENTATIONS;
+      } else {
+        count = 4;
+        for (size_t k = 0; k < count; k++) {
+          orientations[k] = ORIENT_ROTATE_CW;
+        }
+      }
+
+      memcpy(expected, bit_matrix, bit_matrix_size);
+      for (size_t k = 0; k < count; k++) {
+        memset(scratch, 0, bit_matrix_size);
+        _transform_bit_matrix(expected, scratch, N, orientations[k]);
+        memcpy(expected, scratch, bit_matrix_size);
+      }
+
+      transform_bit_matrix_sequence(bit_matrix, N, orientations, count);
+
+      bool correctness = true;
+      for (uint32_t j = 0; j < N && correctness; j++) {
+        for (uint32_t i = 0; i < N; i++) {
+          correctness = correctness && get_bit(bit_matrix, row_size, i, j) ==
+                                           get_bit(expected, row_size, i, j);
+        }
+      }
+
+      if (!correctness) {  // The fused transform was not correct
+        printf(FAIL_STR ": Sequence test %d : Incorrect %s then %s of "
+               "%zux%zu matrix\n", tier, get_orientation_name(orientations[0]),
+               get_orientation_name(orientations[1]), N, N);
+        free_bit_matrix(bit_matrix);
+        free_bit_matrix(expected);
+        free_bit_matrix(scratch);
         return false;
       }
+    }
 
-      // For some fun!
-      print_test_pass_message(tier, N, user_msec);
+    printf(PASS_STR ":\tSequence tests :\tFused %d sequences on %zux%zu\t"
+           "matrix\n", NORIENTATIONS * NORIENTATIONS + 1, N, N);
+
+    free_bit_matrix(bit_matrix);
+    free_bit_matrix(expected);
+    free_bit_matrix(scratch);
+  }
+
+  // A sequence that reduces to one clockwise turn of a ragged matrix must
+  // match `rotate_bit_matrix`. Both are timed for the log, where a pass
+  // through single pixels would stand out
+  const bits_t N = 4099;
+  const bytes_t row_size = bits_to_bytes(N);
+  const enum orientation_e turn[] = {ORIENT_FLIP_VERTICAL, ORIENT_TRANSPOSE};
+  uint8_t *bit_matrix = generate_bit_matrix(N, false);
+  uint8_t *expected = copy_bit_matrix(bit_matrix, N);
+  assert(expected);
+
+  fasttime_t start = gettime();
+  rotate_bit_matrix(expected, N);
+  const uint64_t rotate_nsec = tdiff_nsec(start, gettime());
+  start = gettime();
+  transform_bit_matrix_sequence(bit_matrix, N, turn, 2);
+  const uint64_t sequence_nsec = tdiff_nsec(start, gettime());
+
+  bool correctness = true;
+  for (uint32_t j = 0; j < N && correctness; j++) {
+    for (uint32_t i = 0; i < N; i++) {
+      correctness = correctness && get_bit(bit_matrix, row_size, i, j) ==
+                                       get_bit(expected, row_size, i, j);
     }
-    // Clean up after ourselves!
-    free(bit_matrix);
-    free(bit_matrix_copy);
   }
+  free_bit_matrix(bit_matrix);
+  free_bit_matrix(expected);
+
+  if (!correctness) {
+    printf(FAIL_STR ": Sequence test %d : Incorrect %s then %s of %zux%zu "
+           "matrix\n", tier, get_orientation_name(turn[0]),
+           get_orientation_name(turn[1]), N, N);
+    return false;
+  }
+  printf(PASS_STR ":\tSequence test %d :\tFused a clockwise turn of "
+         "%zux%zu\tmatrix in %lu us, rotation in %lu us\n",
+         tier, N, N, sequence_nsec / 1000, rotate_nsec / 1000);
+
   return true;
 }
+
+// Runs the tester on generated bit matrices of a few sizes converted to
+// tile-major storage. Rotates each three times in that layout, converting
+// back after every turn, and tests it against a working stock rotation
+// function.
+//
+// Returns `true` if every test passed
+bool run_tiles_correctness_tester(void) {
+  // Odd and even numbers of tiles per side
+  const bits_t sizes[] = {64, 128, 192, 1024, 1472};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  uint32_t tier = 0;
+  for (uint32_t s = 0; s < nsizes; s++) {
+    const bits_t N = sizes[s];
+    const bytes_t bit_matrix_size = N * bits_to_bytes(N);
+
+    uint8_t *bit_matrix = generate_bit_matrix(N, false);
+    uint8_t *tiles = alloc_bit_matrix(bit_matrix_size);
+    uint8_t *rotated = alloc_bit_matrix(bit_matrix_size);
+    if (!tiles || !rotated) {
+      printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+      assert(false);
+    }
+
+    bit_matrix_to_tiles(bit_matrix, tiles, N);
+
+    bool correctness = true;
+    for (uint32_t i = 0; i < 3 && correctness; i++, tier++) {
+      fasttime_t start = gettime();
+      rotate_tiles(tiles, N);
+      const uint32_t user_msec = tdiff_msec(start, gettime());
+
+      _rotate_bit_matrix(bit_matrix, N);
+      tiles_to_bit_matrix(tiles, rotated, N);
+      correctness = memcmp(rotated, bit_matrix, bit_matrix_size) == 0;
+
+      if (correctness) {
+        printf(PASS_STR ":\tTiles test %d :\tRotated %zux%zu\ttile-major "
+               "matrix in %d ms\n", tier, N, N, user_msec);
+      } else {  // The rotation was not correct
+        printf(FAIL_STR ": Tiles test %d : Incorrectly rotated %zux%zu "
+               "tile-major matrix\n", tier, N, N);
+      }
+    }
+
+    free_bit_matrix(bit_matrix);
+    free_bit_matrix(tiles);
+    free_bit_matrix(rotated);
+
+    if (!correctness) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Runs the tester on generated bit matrices of a few sizes converted to
+// Morton order. Rotates each three times in that layout, converting back
+// after every turn, and tests it against a working stock rotation function.
+//
+// Returns `true` if every test passed
+bool run_morton_correctness_tester(void) {
+  // One tile, too few tiles for the vector conversions, and a few levels
+  const bits_t sizes[] = {64, 128, 512, 2048};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  uint32_t tier = 0;
+  for (uint32_t s = 0; s < nsizes; s++) {
+    const bits_t N = sizes[s];
+    const bytes_t bit_matrix_size = N * bits_to_bytes(N);
+
+    uint8_t *bit_matrix = generate_bit_matrix(N, false);
+    uint8_t *tiles = alloc_bit_matrix(bit_matrix_size);
+    uint8_t *rotated = alloc_bit_matrix(bit_matrix_size);
+    if (!tiles || !rotated) {
+      printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+      assert(false);
+    }
+
+    bit_matrix_to_morton(bit_matrix, tiles, N);
+
+    bool correctness = true;
+    for (uint32_t i = 0; i < 3 && correctness; i++, tier++) {
+      fasttime_t start = gettime();
+      rotate_morton(tiles, N);
+      const uint32_t user_msec = tdiff_msec(start, gettime());
+
+      _rotate_bit_matrix(bit_matrix, N);
+      morton_to_bit_matrix(tiles, rotated, N);
+      correctness = memcmp(rotated, bit_matrix, bit_matrix_size) == 0;
+
+      if (correctness) {
+        printf(PASS_STR ":\tMorton test %d :\tRotated %zux%zu\tZ-order "
+               "matrix in %d ms\n", tier, N, N, user_msec);
+      } else {  // The rotation was not correct
+        printf(FAIL_STR ": Morton test %d : Incorrectly rotated %zux%zu "
+               "Z-order matrix\n", tier, N, N);
+      }
+    }
+
+    free_bit_matrix(bit_matrix);
+    free_bit_matrix(tiles);
+    free_bit_matrix(rotated);
+
+    if (!correctness) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Streams the rotation of the input file `fname` into `output_fname` with
+// the user supplied `rotate_stream_fn`. Images small enough to load are then
+// read back and tested against a working stock rotation function. `fname`
+// may be a binary BMP or a G4-compressed TIFF, and the output is read back
+// in the same format.
+//
+// Returns `true` if the tester passed
+bool run_stream_tester(const char *const fname, const char *const output_fname,
+                       const rotate_stream_fn_t rotate_stream_fn,
+                       const size_t strips) {
+  // Sanity check the input
+  assert(fname);
+  assert(output_fname);
+  assert(rotate_stream_fn);
+
+  // The input is read first, since the output may replace it
+  const enum image_format_e format = image_format(fname);
+  struct color_table_s color_tables[2];
+  bits_t width, height;
+  if (format == FORMAT_G4_TIFF) {
+    struct g4_tiff_s tiff;
+    if (!open_g4_tiff(fname, &tiff)) {
+      return false;
+    }
+    width = tiff.width;
+    height = tiff.height;
+    close_g4_tiff(&tiff);
+  } else {
+    struct header_s header;
+    struct info_header_s info_header;
+    FILE *f = open_binary_bmp(fname, &header, &info_header, color_tables);
+    if (!f) {
+      return false;
+    }
+    fclose(f);
+    width = info_header.width;
+    height = info_header.height;
+  }
+
+  // Checking correctness needs both images and a copy in memory
+  const bool verify = width * height / 8 <= STREAM_VERIFY_MAX_BYTES;
+  int w, h, row_size, rotated_w, rotated_h, rotated_row_size;
+  uint8_t *bit_matrix =
+      verify ? read_image(fname, format, &w, &h, &row_size, color_tables)
+             : NULL;
+  if (verify && !bit_matrix) {
+    printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+    assert(false);
+  }
+
+  fasttime_t start = gettime();
+  if (!rotate_stream_fn(fname, output_fname, strips)) {
+    printf(FAIL_STR ": Could not stream %s\n", fname);
+    free_bit_matrix(bit_matrix);
+    return false;
+  }
+  const uint32_t user_msec = tdiff_msec(start, gettime());
+  printf("Streamed %zux%zu image in %d ms\n", width, height, user_msec);
+
+  if (!verify) {
+    printf("Image too large to check in memory, not verified\n");
+    return true;
+  }
+
+  uint8_t *rotated = read_image(output_fname, format, &rotated_w, &rotated_h,
+                                &rotated_row_size, color_tables);
+  uint8_t *expected = alloc_bit_matrix(rotated_h * rotated_row_size);
+  if (!rotated || !expected) {
+    printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+    assert(false);
+  }
+
+  // Compare pixels only, since the stock rotation leaves row padding alone
+  bool correctness = rotated_w == h && rotated_h == w;
+  if (correctness) {
+    _rotate_bit_matrix_rect(bit_matrix, expected, h, w);
+    for (uint32_t j = 0; j < (uint32_t)w && correctness; j++) {
+      for (uint32_t i = 0; i < (uint32_t)h; i++) {
+        correctness = correctness &&
+                      get_bit(rotated, rotated_row_size, i, j) ==
+                          get_bit(expected, rotated_row_size, i, j);
+      }
+    }
+  }
+
+  free_bit_matrix(bit_matrix);
+  free_bit_matrix(rotated);
+  free_bit_matrix(expected);
+
+  if (!correctness) {
+    printf(FAIL_STR ": Incorrectly streamed rotation of %s\n", fname);
+  }
+  return correctness;
+}
+
+// Runs the stream tester on generated bit matrices of a few sizes, written
+// to temporary BMP files, with batches of one strip, a few strips, and the
+// default.
+//
+// Returns `true` if every test passed
+bool run_stream_correctness_tester(const rotate_stream_fn_t rotate_stream_fn) {
+  // Sanity check the input
+  assert(rotate_stream_fn);
+
+  const bits_t sizes[] = {64, 100, 1000, 1472};
+  const size_t strips[] = {1, 3, 0};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+  const uint32_t nstrips = sizeof(strips) / sizeof(strips[0]);
+
+  struct color_table_s color_tables[2] = {{0, 0, 0, 0}, {255, 255, 255, 0}};
+  char fname[] = "/tmp/snailspeed_inXXXXXX";
+  char output_fname[] = "/tmp/snailspeed_outXXXXXX";
+  const int fd = mkstemp(fname);
+  const int output_fd = mkstemp(output_fname);
+  assert(fd >= 0 && output_fd >= 0);
+  close(fd);
+  close(output_fd);
+
+  bool correctness = true;
+  for (uint32_t s = 0; s < nsizes && correctness; s++) {
+    uint8_t *bit_matrix = generate_bit_matrix(sizes[s], false);
+    write_binary_bmp(fname, bit_matrix, color_tables, sizes[s]);
+    free_bit_matrix(bit_matrix);
+
+    for (uint32_t t = 0; t < nstrips && correctness; t++) {
+      correctness =
+          run_stream_tester(fname, output_fname, rotate_stream_fn, strips[t]);
+    }
+
+    // A file streamed onto itself must be read before it is replaced
+    correctness = correctness &&
+                  run_stream_tester(fname, fname, rotate_stream_fn, 0);
+  }
+
+  unlink(fname);
+  unlink(output_fname);
+
+  return correctness;
+}
+
+// Runs the tester on generated bit matrices of a few sizes, written to a
+// temporary BMP file and mapped back into memory. Checks the mapped rows in
+// both orders against `read_binary_bmp`, and that a width with padded rows
+// is refused.
+//
+// Returns `true` if every test passed
+bool run_map_correctness_tester(void) {
+  const bits_t sizes[] = {64, 96, 1024, 100};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  struct color_table_s color_tables[2] = {{0, 0, 0, 0}, {255, 255, 255, 0}};
+  char fname[] = "/tmp/snailspeed_mapXXXXXX";
+  const int fd = mkstemp(fname);
+  assert(fd >= 0);
+  close(fd);
+
+  bool correctness = true;
+  for (uint32_t s = 0; s < nsizes && correctness; s++) {
+    const bits_t N = sizes[s];
+    uint8_t *bit_matrix = generate_bit_matrix(N, false);
+    write_binary_bmp(fname, bit_matrix, color_tables, N);
+    free_bit_matrix(bit_matrix);
+
+    int width, height, row_size;
+    struct color_table_s read_color_tables[2];
+    fasttime_t start = gettime();
+    bit_matrix =
+        read_binary_bmp(fname, &width, &height, &row_size, read_color_tables);
+    const uint32_t read_msec = tdiff_msec(start, gettime());
+
+    struct bmp_map_s bmp;
+    start = gettime();
+    const bool mapped = map_binary_bmp(fname, &bmp);
+    const uint32_t map_msec = tdiff_msec(start, gettime());
+
+    if (N % 32) {
+      correctness = !mapped;
+    } else {
+      correctness = mapped && bmp.width == width && bmp.height == height &&
+                    bmp.row_size == row_size && bmp.bottom_up;
+
+      // Bottom up, the first mapped row is the last one read
+      for (int j = 0; j < height && correctness; j++) {
+        correctness = !memcmp(bmp.pixels + j * row_size,
+                              bit_matrix + (height - 1 - j) * row_size,
+                              row_size);
+      }
+
+      if (correctness) {
+        flip_binary_bmp_rows(&bmp);
+        correctness = !bmp.bottom_up &&
+                      !memcmp(bmp.pixels, bit_matrix, height * row_size);
+      }
+
+      if (mapped) {
+        unmap_binary_bmp(&bmp);
+      }
+    }
+    free_bit_matrix(bit_matrix);
+
+    if (correctness) {
+      printf(PASS_STR ":\tMap test %d :\t%s %zux%zu\timage, read in %d ms, "
+             "mapped in %d ms\n", s, N % 32 ? "Refused" : "Mapped", N, N,
+             read_msec, map_msec);
+    } else {
+      printf(FAIL_STR ": Map test %d : Incorrectly mapped %zux%zu image\n", s,
+             N, N);
+    }
+  }
+
+  unlink(fname);
+
+  return correctness;
+}
+
+// Runs the tester on random images of a few shapes written by
+// `write_binary_bmp_rect` to the same temporary file, each smaller than the
+// last, on 1 and 4 threads. The shapes span several staging buffers with a
+// partial one at the end, and rows wider than a whole buffer. Checks the
+// file size and every file row against the image, padding included. Also
+// checks that a file that cannot be sized is reported as failed.
+//
+// Returns `true` if every test passed
+bool run_bmp_write_correctness_tester(void) {
+  const uint32_t shapes[][2] = {
+      {9000000, 3}, {8200, 2500}, {33, 300000}, {100, 36}, {1, 7}};
+  const uint32_t nshapes = sizeof(shapes) / sizeof(shapes[0]);
+  const size_t threads[] = {1, 4};
+  const size_t nthreads = sizeof(threads) / sizeof(threads[0]);
+
+  struct color_table_s color_tables[2] = {{0, 0, 0, 0}, {255, 255, 255, 0}};
+  char fname[] = "/tmp/snailspeed_writeXXXXXX";
+  const int fd = mkstemp(fname);
+  assert(fd >= 0);
+  close(fd);
+
+  const size_t saved_threads = get_num_threads();
+  bool correctness = true;
+  for (size_t t = 0; t < nthreads && correctness; t++) {
+    set_num_threads(threads[t]);
+
+    for (uint32_t s = 0; s < nshapes && correctness; s++) {
+      const uint32_t width = shapes[s][0];
+      const uint32_t height = shapes[s][1];
+      const size_t row_size = bits_to_bytes(width);
+      const size_t file_row_size = ((width + 31) / 32) * 4;
+
+      uint8_t *image = malloc((size_t)height * row_size);
+      uint8_t *file_row = malloc(file_row_size);
+      assert(image && file_row);
+      for (size_t i = 0; i < (size_t)height * row_size; i++) {
+        image[i] = rand();
+      }
+
+      const fasttime_t start = gettime();
+      correctness =
+          write_binary_bmp_rect(fname, image, color_tables, width, height,
+                                parallel_for);
+      const uint32_t write_msec = tdiff_msec(start, gettime());
+
+      struct stat st;
+      const size_t data_offset = 62;
+      correctness = correctness && !stat(fname, &st) &&
+                    (size_t)st.st_size ==
+                        data_offset + (size_t)height * file_row_size;
+
+      FILE *f = fopen(fname, "rb");
+      correctness = correctness && f && !fseek(f, data_offset, SEEK_SET);
+      for (uint32_t r = 0; r < height && correctness; r++) {
+        correctness =
+            fread(file_row, 1, file_row_size, f) == file_row_size &&
+            !memcmp(file_row, image + (size_t)(height - 1 - r) * row_size,
+                    row_size);
+        for (size_t b = row_size; b < file_row_size && correctness; b++) {
+          correctness = file_row[b] == 0;
+        }
+      }
+      if (f) {
+        fclose(f);
+      }
+      free(file_row);
+      free(image);
+
+      if (correctness) {
+        printf(PASS_STR ":\tBMP write test %u :\t%ux%u\timage on %zu "
+               "threads, written in %d ms\n", s, width, height, threads[t],
+               write_msec);
+      } else {
+        printf(FAIL_STR ": BMP write test %u : Incorrectly wrote %ux%u "
+               "image on %zu threads\n", s, width, height, threads[t]);
+      }
+    }
+  }
+  set_num_threads(saved_threads);
+  unlink(fname);
+
+  // A device can be opened but neither sized nor written
+  if (correctness) {
+    uint8_t image[4] = {0};
+    correctness =
+        !write_binary_bmp_rect("/dev/full", image, color_tables, 8, 4, NULL);
+    if (correctness) {
+      printf(PASS_STR ":\tBMP write test %u :\tReported a file that cannot "
+             "be sized\n", nshapes);
+    } else {
+      printf(FAIL_STR ": BMP write test %u : Wrote to a file that cannot be "
+             "sized\n", nshapes);
+    }
+  }
+
+  return correctness;
+}
+
+// Runs the tester on generated bit matrices of a few sizes, written to a
+// temporary binary PBM and read back. Checks that the file is the header
+// followed by the matrix as it is in memory, that it round trips, and that
+// a rotation written and read back matches a working stock rotation
+// function. Also checks that a header with a comment is parsed, and that a
+// BMP is not taken for a PBM.
+//
+// Returns `true` if every test passed
+bool run_pbm_correctness_tester(void) {
+  const bits_t sizes[] = {8, 64, 100, 1024};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  char fname[] = "/tmp/snailspeed_pbmXXXXXX";
+  const int fd = mkstemp(fname);
+  assert(fd >= 0);
+  close(fd);
+
+  bool correctness = true;
+  for (uint32_t s = 0; s < nsizes && correctness; s++) {
+    const bits_t N = sizes[s];
+    const bytes_t bit_matrix_size = N * bits_to_bytes(N);
+    uint8_t *bit_matrix = generate_bit_matrix(N, false);
+
+    fasttime_t start = gettime();
+    write_binary_pbm(fname, bit_matrix, N);
+    const uint32_t write_msec = tdiff_msec(start, gettime());
+
+    // The pixel data is the last `bit_matrix_size` bytes of the file
+    FILE *f = fopen(fname, "rb");
+    assert(f);
+    uint8_t *file_pixels = malloc(bit_matrix_size);
+    assert(file_pixels);
+    fseek(f, -(long)bit_matrix_size, SEEK_END);
+    correctness = is_binary_pbm(fname) &&
+                  fread(file_pixels, 1, bit_matrix_size, f) == bit_matrix_size &&
+                  !memcmp(file_pixels, bit_matrix, bit_matrix_size);
+    free(file_pixels);
+    fclose(f);
+
+    int width, height, row_size;
+    start = gettime();
+    uint8_t *read_matrix = read_binary_pbm(fname, &width, &height, &row_size);
+    const uint32_t read_msec = tdiff_msec(start, gettime());
+
+    correctness = correctness && read_matrix && width == (int)N &&
+                  height == (int)N && row_size == (int)bits_to_bytes(N) &&
+                  !memcmp(read_matrix, bit_matrix, bit_matrix_size);
+
+    if (correctness) {
+      rotate_bit_matrix(read_matrix, N);
+      write_binary_pbm(fname, read_matrix, N);
+      free_bit_matrix(read_matrix);
+
+      _rotate_bit_matrix(bit_matrix, N);
+      read_matrix = read_binary_pbm(fname, &width, &height, &row_size);
+      correctness = read_matrix &&
+                    !memcmp(read_matrix, bit_matrix, bit_matrix_size);
+    }
+
+    free_bit_matrix(read_matrix);
+    free_bit_matrix(bit_matrix);
+
+    if (correctness) {
+      printf(PASS_STR ":\tPBM test %d :\tRound trip of %zux%zu\timage, "
+             "written in %d ms, read in %d ms\n", s, N, N, write_msec,
+             read_msec);
+    } else {
+      printf(FAIL_STR ": PBM test %d : Incorrect round trip of %zux%zu "
+             "image\n", s, N, N);
+    }
+  }
+
+  if (correctness) {
+    // Comments may sit between the header fields
+    const uint8_t pixels[2] = {0xA5, 0x3C};
+    FILE *f = fopen(fname, "wb");
+    assert(f);
+    fputs("P4\n# 8 by 2\n8 # width\n2\n", f);
+    fwrite(pixels, 1, sizeof(pixels), f);
+    fclose(f);
+
+    int width, height, row_size;
+    uint8_t *read_matrix = read_binary_pbm(fname, &width, &height, &row_size);
+    correctness = read_matrix && width == 8 && height == 2 && row_size == 1 &&
+                  !memcmp(read_matrix, pixels, sizeof(pixels));
+    free_bit_matrix(read_matrix);
+
+    // A BMP starts with "BM" instead
+    struct color_table_s color_tables[2] = {{0, 0, 0, 0}, {255, 255, 255, 0}};
+    uint8_t *bit_matrix = generate_bit_matrix(64, false);
+    write_binary_bmp(fname, bit_matrix, color_tables, 64);
+    free_bit_matrix(bit_matrix);
+    correctness = correctness && !is_binary_pbm(fname);
+
+    if (correctness) {
+      printf(PASS_STR ":\tPBM test %d :\tParsed a commented header and told "
+             "a BMP apart\n", nsizes);
+    } else {
+      printf(FAIL_STR ": PBM test %d : Misread a commented header or a BMP\n",
+             nsizes);
+    }
+  }
+
+  unlink(fname);
+
+  return correctness;
+}
+
+// Runs the tester on bit matrices of a few sizes, written to a temporary
+// G4-compressed TIFF and read back, then streamed with the user supplied
+// `rotate_stream_fn` in batches of one band, a few bands, and the default.
+// Random matrices go through every short run code, and a sparse one
+// through the long runs that take several make-up codes. Some images are
+// wider than they are high.
+//
+// Returns `true` if every test passed
+bool run_g4_correctness_tester(const rotate_stream_fn_t rotate_stream_fn) {
+  // Sanity check the input
+  assert(rotate_stream_fn);
+
+  const bits_t sizes[][2] = {{64, 64}, {100, 37}, {1000, 1000},
+                             {1472, 300}, {6000, 6000}};
+  const size_t strips[] = {1, 3, 0};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+  const uint32_t nstrips = sizeof(strips) / sizeof(strips[0]);
+
+  char fname[] = "/tmp/snailspeed_g4XXXXXX";
+  char output_fname[] = "/tmp/snailspeed_g4_outXXXXXX";
+  const int fd = mkstemp(fname);
+  const int output_fd = mkstemp(output_fname);
+  assert(fd >= 0 && output_fd >= 0);
+  close(fd);
+  close(output_fd);
+
+  bool correctness = true;
+  for (uint32_t s = 0; s < nsizes && correctness; s++) {
+    const bits_t width = sizes[s][0];
+    const bits_t height = sizes[s][1];
+    const bytes_t row_size = bits_to_bytes(width);
+    uint8_t *bit_matrix = generate_bit_matrix(width, false);
+
+    // Rows are read back with their padding bits clear
+    for (uint32_t j = 0; j < height && width % 8; j++) {
+      bit_matrix[j * row_size + row_size - 1] &= 0xFF << (8 - width % 8);
+    }
+
+    // The largest image is left blank but for its diagonals
+    const bool sparse = s == nsizes - 1;
+    if (sparse) {
+      memset(bit_matrix, 0, height * row_size);
+      for (uint32_t j = 0; j < height; j++) {
+        set_bit(bit_matrix, row_size, j, j, 1);
+        set_bit(bit_matrix, row_size, width - 1 - j, j, 1);
+      }
+    }
+
+    struct g4_tiff_writer_s writer;
+    fasttime_t start = gettime();
+    correctness = create_g4_tiff(fname, &writer, width, height);
+    for (uint32_t j = 0; j < height && correctness; j++) {
+      correctness = write_g4_tiff_row(&writer, bit_matrix + j * row_size);
+    }
+    correctness = correctness && finish_g4_tiff(&writer);
+    const uint32_t write_msec = tdiff_msec(start, gettime());
+
+    int w, h, read_row_size;
+    start = gettime();
+    uint8_t *read_matrix = read_g4_tiff(fname, &w, &h, &read_row_size);
+    const uint32_t read_msec = tdiff_msec(start, gettime());
+
+    correctness = correctness && read_matrix && w == (int)width &&
+                  h == (int)height && read_row_size == (int)row_size &&
+                  !memcmp(read_matrix, bit_matrix, height * row_size);
+    free_bit_matrix(read_matrix);
+    free_bit_matrix(bit_matrix);
+
+    if (correctness) {
+      printf(PASS_STR ":\tG4 test %d :\tRound trip of %s %zux%zu\timage, "
+             "written in %d ms, read in %d ms\n", s,
+             sparse ? "sparse" : "random", width, height, write_msec,
+             read_msec);
+    } else {
+      printf(FAIL_STR ": G4 test %d : Incorrect round trip of %zux%zu "
+             "image\n", s, width, height);
+    }
+
+    for (uint32_t t = 0; t < nstrips && correctness; t++) {
+      correctness =
+          run_stream_tester(fname, output_fname, rotate_stream_fn, strips[t]);
+    }
+  }
+
+  unlink(fname);
+  unlink(output_fname);
+
+  return correctness;
+}
+
+// Appends a copy of `fname` to the list `*fnames` of `*count` names
+static void add_fname(char ***fnames, size_t *count, const char *fname) {
+  *fnames = realloc(*fnames, (*count + 1) * sizeof(**fnames));
+  if (!*fnames || !((*fnames)[*count] = strdup(fname))) {
+    printf("Error: Run out of heap space!\n");
+    assert(false);
+  }
+  (*count)++;
+}
+
+static int compare_fnames(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Lists the files named by `input`: the `.bmp` files of a directory, in
+// name order, or else the lines of a list file.
+//
+// Returns the names, or NULL if `input` could not be read
+static char **list_files(const char *const input, size_t *count) {
+  char **fnames = NULL;
+  *count = 0;
+
+  struct stat st;
+  if (stat(input, &st)) {
+    perror("Error reading batch input");
+    return NULL;
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    DIR *dir = opendir(input);
+    if (!dir) {
+      perror("Error reading batch directory");
+      return NULL;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+      const size_t length = strlen(entry->d_name);
+      if (length > 4 && !strcasecmp(entry->d_name + length - 4, ".bmp")) {
+        char fname[PATH_MAX];
+        snprintf(fname, sizeof(fname), "%s/%s", input, entry->d_name);
+        add_fname(&fnames, count, fname);
+      }
+    }
+    closedir(dir);
+
+    if (*count) {
+      qsort(fnames, *count, sizeof(*fnames), compare_fnames);
+    }
+  } else {
+    FILE *f = fopen(input, "r");
+    if (!f) {
+      perror("Error reading batch list");
+      return NULL;
+    }
+
+    // One name per line, skipping blank lines
+    char line[PATH_MAX];
+    while (fgets(line, sizeof(line), f)) {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (line[0]) {
+        add_fname(&fnames, count, line);
+      }
+    }
+    fclose(f);
+  }
+
+  // An empty batch still gets a list to free
+  return fnames ? fnames : calloc(1, sizeof(*fnames));
+}
+
+static void free_fnames(char **fnames, const size_t count) {
+  for (size_t f = 0; f < count; f++) {
+    free(fnames[f]);
+  }
+  free(fnames);
+}
+
+// Runs the user supplied `rotate_files_fn` on the BMPs named by `input`, a
+// directory or a list file with one name per line, writing the rotations to
+// `output_dir`. Prints the throughput in files and in megabytes of pixels
+// per second.
+//
+// Returns `true` if every file was rotated
+bool run_pipeline_tester(const char *const input,
+                         const char *const output_dir,
+                         const rotate_files_fn_t rotate_files_fn) {
+  // Sanity check the input
+  assert(input);
+  assert(output_dir);
+  assert(rotate_files_fn);
+
+  size_t count;
+  char **fnames = list_files(input, &count);
+  if (!fnames) {
+    return false;
+  }
+
+  struct pipeline_stats_s stats;
+  const bool result = rotate_files_fn((const char *const *)fnames, count,
+                                      output_dir, &stats);
+  free_fnames(fnames, count);
+
+  printf("Rotated %zu of %zu files in %.3f s: %.1f files/s, %.1f MB/s\n",
+         stats.nfiles - stats.nfailed, stats.nfiles, stats.seconds,
+         stats.seconds > 0 ? stats.nfiles / stats.seconds : 0.0,
+         stats.seconds > 0 ? stats.nbytes / stats.seconds / 1e6 : 0.0);
+
+  return result;
+}
+
+// Runs the user supplied `rotate_files_fn` on a temporary directory of
+// generated BMPs, squares of a few sizes and rectangles, given both as the
+// directory and as a list file, and tests every output against a working
+// stock rotation function. Also checks that a file that cannot be rotated
+// is counted as failed without holding up the rest.
+//
+// Returns `true` if every test passed
+bool run_pipeline_correctness_tester(const rotate_files_fn_t rotate_files_fn) {
+  // Sanity check the input
+  assert(rotate_files_fn);
+
+  const bits_t sizes[][2] = {{64, 64},   {100, 100}, {1024, 1024}, {128, 64},
+                             {64, 320},  {7, 7},     {512, 512},   {96, 96},
+                             {192, 128}, {1, 1},     {256, 256},   {1000, 1000}};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  struct color_table_s color_tables[2] = {{0, 0, 0, 0}, {255, 255, 255, 0}};
+  char input_dir[] = "/tmp/snailspeed_batch_inXXXXXX";
+  char output_dir[] = "/tmp/snailspeed_batch_outXXXXXX";
+  char list_fname[] = "/tmp/snailspeed_batch_listXXXXXX";
+  const int list_fd = mkstemp(list_fname);
+  const bool made_dirs = mkdtemp(input_dir) && mkdtemp(output_dir);
+  assert(made_dirs && list_fd >= 0);
+  FILE *list = fdopen(list_fd, "w");
+  assert(list);
+
+  char fname[PATH_MAX];
+  for (uint32_t s = 0; s < nsizes; s++) {
+    const bits_t width = sizes[s][0];
+    const bits_t height = sizes[s][1];
+    uint8_t *bit_matrix = generate_bit_matrix(width > height ? width : height,
+                                              false);
+    snprintf(fname, sizeof(fname), "%s/scan%02u.bmp", input_dir, s);
+    write_binary_bmp_rect(fname, bit_matrix, color_tables, width, height,
+                          NULL);
+    fprintf(list, "%s\n", fname);
+    free_bit_matrix(bit_matrix);
+  }
+
+  // A rectangle that is not in whole blocks cannot be rotated
+  uint8_t *bit_matrix = generate_bit_matrix(100, false);
+  snprintf(fname, sizeof(fname), "%s/ragged.bmp", input_dir);
+  write_binary_bmp_rect(fname, bit_matrix, color_tables, 100, 36, NULL);
+  free_bit_matrix(bit_matrix);
+  fclose(list);
+
+  bool correctness = true;
+  const char *const inputs[] = {input_dir, list_fname};
+  for (uint32_t i = 0; i < 2 && correctness; i++) {
+    size_t count;
+    char **fnames = list_files(inputs[i], &count);
+    assert(fnames);
+    struct pipeline_stats_s stats;
+    const bool result = rotate_files_fn((const char *const *)fnames, count,
+                                        output_dir, &stats);
+    free_fnames(fnames, count);
+
+    // Only the directory has the ragged file
+    const size_t nfailed = i == 0 ? 1 : 0;
+    correctness = result == !nfailed &&
+                  stats.nfiles == nsizes + nfailed &&
+                  stats.nfailed == nfailed;
+
+    for (uint32_t s = 0; s < nsizes && correctness; s++) {
+      int w, h, row_size, rotated_w, rotated_h, rotated_row_size;
+      snprintf(fname, sizeof(fname), "%s/scan%02u.bmp", input_dir, s);
+      uint8_t *image =
+          read_binary_bmp(fname, &w, &h, &row_size, color_tables);
+      snprintf(fname, sizeof(fname), "%s/scan%02u.bmp", output_dir, s);
+      uint8_t *rotated = read_binary_bmp(fname, &rotated_w, &rotated_h,
+                                         &rotated_row_size, color_tables);
+      uint8_t *expected = alloc_bit_matrix(rotated_h * rotated_row_size);
+      assert(image && rotated && expected);
+
+      correctness = rotated_w == h && rotated_h == w;
+      if (correctness) {
+        _rotate_bit_matrix_rect(image, expected, h, w);
+        for (uint32_t j = 0; j < (uint32_t)w && correctness; j++) {
+          for (uint32_t k = 0; k < (uint32_t)h; k++) {
+            correctness = correctness &&
+                          get_bit(rotated, rotated_row_size, k, j) ==
+                              get_bit(expected, rotated_row_size, k, j);
+          }
+        }
+      }
+
+      free_bit_matrix(image);
+      free_bit_matrix(rotated);
+      free_bit_matrix(expected);
+      unlink(fname);
+    }
+
+    if (correctness) {
+      printf(PASS_STR ":\tPipeline test %d :\tRotated %zu files from a %s in "
+             "%.1f ms\n", i, stats.nfiles - stats.nfailed,
+             i == 0 ? "directory" : "list file", stats.seconds * 1e3);
+    } else {
+      printf(FAIL_STR ": Pipeline test %d : Incorrectly rotated files from a "
+             "%s\n", i, i == 0 ? "directory" : "list file");
+    }
+  }
+
+  for (uint32_t s = 0; s < nsizes; s++) {
+    snprintf(fname, sizeof(fname), "%s/scan%02u.bmp", input_dir, s);
+    unlink(fname);
+  }
+  snprintf(fname, sizeof(fname), "%s/ragged.bmp", input_dir);
+  unlink(fname);
+  unlink(list_fname);
+  rmdir(input_dir);
+  rmdir(output_dir);
+
+  return correctness;
+}
+
+// Transforms the input file `fname` into `output_fname` with the user
+// supplied `rotate_file_fn`, then reads both back and tests the result
+// against a working stock transform function.
+//
+// Returns `true` if the tester passed
+bool run_file_transform_tester(const char *const fname,
+                               const char *const output_fname,
+                               const rotate_file_fn_t rotate_file_fn,
+                               const enum orientation_e orientation) {
+  // Sanity check the input
+  assert(fname);
+  assert(output_fname);
+  assert(rotate_file_fn);
+
+  // The input is read first, since the output may replace it
+  struct color_table_s color_tables[2];
+  int width, height, row_size, output_width, output_height, output_row_size;
+  uint8_t *bit_matrix =
+      read_binary_bmp(fname, &width, &height, &row_size, color_tables);
+  if (!bit_matrix) {
+    printf(FAIL_STR ": Could not read %s\n", fname);
+    return false;
+  }
+
+  fasttime_t start = gettime();
+  if (!rotate_file_fn(fname, output_fname, orientation)) {
+    printf(FAIL_STR ": Could not transform %s\n", fname);
+    free_bit_matrix(bit_matrix);
+    return false;
+  }
+  const uint32_t user_msec = tdiff_msec(start, gettime());
+
+  uint8_t *output = read_binary_bmp(output_fname, &output_width,
+                                    &output_height, &output_row_size,
+                                    color_tables);
+  uint8_t *expected = alloc_bit_matrix(height * row_size);
+  if (!output || !expected) {
+    printf("Error: Run out of heap space! Please try smaller matrix size.\n");
+    assert(false);
+  }
+
+  // Compare pixels only, since the stock transform leaves row padding alone
+  bool correctness = output_width == width && output_height == height;
+  if (correctness) {
+    _transform_bit_matrix(bit_matrix, expected, width, orientation);
+    for (uint32_t j = 0; j < (uint32_t)height && correctness; j++) {
+      for (uint32_t i = 0; i < (uint32_t)width; i++) {
+        correctness = correctness && get_bit(output, row_size, i, j) ==
+                                         get_bit(expected, row_size, i, j);
+      }
+    }
+  }
+
+  free_bit_matrix(bit_matrix);
+  free_bit_matrix(output);
+  free_bit_matrix(expected);
+
+  if (!correctness) {
+    printf(FAIL_STR ": Incorrect %s of %s\n", get_orientation_name(orientation),
+           fname);
+    return false;
+  }
+
+  printf(PASS_STR ":\t%s of %dx%d\timage file in %d ms\n",
+         get_orientation_name(orientation), width, height, user_msec);
+  return true;
+}
+
+// Runs the file transform tester on generated bit matrices of a few sizes,
+// written to a temporary BMP file, under every orientation.
+//
+// Returns `true` if every test passed
+bool run_file_transform_correctness_tester(
+    const rotate_file_fn_t rotate_file_fn) {
+  // Sanity check the input
+  assert(rotate_file_fn);
+
+  // One pass for multiples of 64, separate passes for the others
+  const bits_t sizes[] = {64, 1024, 100};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  struct color_table_s color_tables[2] = {{0, 0, 0, 0}, {255, 255, 255, 0}};
+  char fname[] = "/tmp/snailspeed_inXXXXXX";
+  char output_fname[] = "/tmp/snailspeed_outXXXXXX";
+  const int fd = mkstemp(fname);
+  const int output_fd = mkstemp(output_fname);
+  assert(fd >= 0 && output_fd >= 0);
+  close(fd);
+  close(output_fd);
+
+  bool correctness = true;
+  for (uint32_t s = 0; s < nsizes && correctness; s++) {
+    uint8_t *bit_matrix = generate_bit_matrix(sizes[s], false);
+    write_binary_bmp(fname, bit_matrix, color_tables, sizes[s]);
+    free_bit_matrix(bit_matrix);
+
+    for (int orientation = 0; orientation < NORIENTATIONS && correctness;
+         orientation++) {
+      correctness = run_file_transform_tester(fname, output_fname,
+                                              rotate_file_fn, orientation);
+    }
+
+    // A file transformed onto itself must be read before it is replaced
+    correctness = correctness && run_file_transform_tester(fname, fname,
+                                                           rotate_file_fn,
+                                                           ORIENT_ROTATE_CW);
+  }
+
+  unlink(fname);
+  unlink(output_fname);
+
+  return correctness;
+}
+
+// A daemon run by the daemon tester on a thread of its own
+struct daemon_thread_s {
+  rotate_daemon_fn_t rotate_daemon_fn;
+  const char *socket_path;
+  bool result;
+};
+
+static void *run_daemon_thread(void *arg) {
+  struct daemon_thread_s *daemon = arg;
+  daemon->result = daemon->rotate_daemon_fn(daemon->socket_path, 1);
+  return NULL;
+}
+
+// Runs the tester on a daemon started with the user supplied
+// `rotate_daemon_fn` on a temporary socket, serving a single connection.
+// Sends it generated bit matrices of a few sizes in shared memory, once in
+// every orientation, and tests each result against the stock transform
+// function. Also checks that a job bigger than its memory and memory that
+// is not sealed against shrinking are turned away with EINVAL.
+//
+// Returns `true` if every test passed
+bool run_daemon_correctness_tester(const rotate_daemon_fn_t rotate_daemon_fn) {
+  // Sanity check the input
+  assert(rotate_daemon_fn);
+
+  // A small and a large multiple of 64, and one that is not
+  const bits_t sizes[] = {64, 100, 1024};
+  const uint32_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  char socket_dir[] = "/tmp/snailspeed_daemonXXXXXX";
+  const char *made_dir = mkdtemp(socket_dir);
+  assert(made_dir);
+  char socket_path[PATH_MAX];
+  snprintf(socket_path, sizeof(socket_path), "%s/socket", socket_dir);
+
+  // The daemon serves one connection and returns
+  struct daemon_thread_s daemon = {rotate_daemon_fn, socket_path, false};
+  pthread_t thread;
+  const int created =
+      pthread_create(&thread, NULL, run_daemon_thread, &daemon);
+  assert(!created);
+
+  // The socket path appears once the daemon is listening
+  struct stat st;
+  for (int tries = 0; stat(socket_path, &st) && tries < 1000; tries++) {
+    usleep(1000);
+  }
+  const int sock = connect_rotate_daemon(socket_path);
+  if (sock < 0) {
+    printf(FAIL_STR ": Daemon test 0 : Could not connect to the daemon\n");
+
+    // A daemon that is listening waits in `accept` for the connection it was
+    // told to serve, so hand it one to let it return. One that cannot be
+    // reached is left behind rather than waited for
+    const int throwaway = connect_rotate_daemon(socket_path);
+    if (throwaway < 0) {
+      pthread_detach(thread);
+      return false;
+    }
+    close(throwaway);
+  }
+
+  bool correctness = sock >= 0;
+  for (uint32_t s = 0; s < nsizes && correctness; s++) {
+    const bits_t N = sizes[s];
+    const bytes_t row_size = bits_to_bytes(N);
+    const size_t size = N * row_size;
+
+    // Every orientation of a size goes through the same memory, which the
+    // daemon keeps mapped
+    const int fd = create_rotate_job_memory(size);
+    assert(fd >= 0);
+    uint8_t *img =
+        mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    assert(img != MAP_FAILED);
+
+    uint8_t *bit_matrix = generate_bit_matrix(N, false);
+    uint8_t *expected = alloc_bit_matrix(size);
+    assert(bit_matrix && expected);
+
+    uint64_t job_nsec = 0;
+    for (int orientation = 0; orientation < NORIENTATIONS && correctness;
+         orientation++) {
+      memcpy(img, bit_matrix, size);
+      _transform_bit_matrix(bit_matrix, expected, N, orientation);
+
+      struct rotate_reply_s reply;
+      correctness = submit_rotate_job(sock, fd, N, orientation, &reply);
+      job_nsec += reply.job_nsec;
+      for (uint32_t j = 0; j < N && correctness; j++) {
+        for (uint32_t i = 0; i < N; i++) {
+          correctness = correctness && get_bit(img, row_size, i, j) ==
+                                           get_bit(expected, row_size, i, j);
+        }
+      }
+    }
+
+    // A job bigger than its memory is turned away
+    struct rotate_reply_s reply;
+    correctness = correctness &&
+                  !submit_rotate_job(sock, fd, N + 64, ORIENT_ROTATE_CW,
+                                     &reply) &&
+                  reply.status == EINVAL;
+
+    if (correctness) {
+      printf(PASS_STR ":\tDaemon test %d :\tTransformed %zux%zu\tshared "
+             "memory %d ways in %lu us of jobs\n",
+             s, N, N, NORIENTATIONS, job_nsec / 1000);
+    } else {
+      printf(FAIL_STR ": Daemon test %d : Incorrectly transformed %zux%zu "
+             "shared memory\n",
+             s, N, N);
+    }
+
+    munmap(img, size);
+    close(fd);
+    free_bit_matrix(bit_matrix);
+    free_bit_matrix(expected);
+  }
+
+  // Memory that could shrink under the daemon is turned away, since
+  // truncating it mid-transform would kill the daemon with SIGBUS
+  if (correctness) {
+    char fname[] = "/tmp/snailspeed_unsealedXXXXXX";
+    const int fd = mkstemp(fname);
+    assert(fd >= 0);
+    unlink(fname);
+    const int truncated = ftruncate(fd, 64 * bits_to_bytes(64));
+    assert(!truncated);
+
+    struct rotate_reply_s reply;
+    correctness = !submit_rotate_job(sock, fd, 64, ORIENT_ROTATE_CW, &reply) &&
+                  reply.status == EINVAL;
+    close(fd);
+
+    if (correctness) {
+      printf(PASS_STR ":\tDaemon test %d :\tTurned away memory that is not "
+             "sealed against shrinking\n",
+             nsizes);
+    } else {
+      printf(FAIL_STR ": Daemon test %d : Accepted memory that is not sealed "
+             "against shrinking\n",
+             nsizes);
+    }
+  }
+
+  if (sock >= 0) {
+    close(sock);
+  }
+  pthread_join(thread, NULL);
+  correctness = correctness && daemon.result;
+  rmdir(socket_dir);
+
+  return correctness;
+}
@@ -35,8 +35,35 @@
 #define PASS_STR COLOR_GREEN "PASS" COLOR_DEFAULT
 #define FAIL_STR COLOR_RED "FAIL" COLOR_DEFAULT
 
+struct pipeline_stats_s;
+
 typedef void (*rotate_fn_t)(uint8_t*, const bits_t);
 
+typedef void (*rotate_rect_fn_t)(const uint8_t*, uint8_t*, const bits_t,
+                                 const bits_t);
+
+typedef void (*rotate_rect_inplace_fn_t)(uint8_t*, const bits_t, const bits_t);
+
+typedef void (*rotate_batch_fn_t)(uint8_t**, const size_t, const bits_t);
+
+typedef bool (*rotate_fixed_fn_t)(uint8_t*, const bits_t, bits_t);
+
+typedef bool (*rotate_stream_fn_t)(const char*, const char*, size_t);
+
+typedef bool (*rotate_file_fn_t)(const char*, const char*,
+                                 const enum orientation_e);
+
+typedef bool (*rotate_files_fn_t)(const char* const*, const size_t,
+                                  const char*, struct pipeline_stats_s*);
+
+typedef bool (*rotate_daemon_fn_t)(const char*, const size_t);
+
+// The largest image, in bytes, that the stream tester reads back to check
+#define STREAM_VERIFY_MAX_BYTES (1UL << 30)
+
+typedef void (*transform_fn_t)(uint8_t*, const bits_t,
+                               const enum orientation_e);
+
 void exitfunc(int sig);
 
 bool run_tester(const char* const fname, const rotate_fn_t rotate_fn);
@@ -55,6 +82,56 @@ uint32_t run_tester_tiers(const rotate_fn_t rotate_fn,
                           const int start_tier, const int highest_tier,
                           const int linear_tiers, unsigned blowthroughs);
 
+bool run_transpose_correctness_tester(void);
+
 bool run_correctness_tester(const rotate_fn_t rotate_fn, const bits_t start_n);
 
+bool run_modes_correctness_tester(const rotate_fn_t rotate_fn);
+
+bool run_rect_correctness_tester(const rotate_rect_fn_t rotate_rect_fn,
+                                 const rotate_rect_inplace_fn_t inplace_fn);
+
+bool run_transform_correctness_tester(const transform_fn_t transform_fn);
+
+bool run_batch_correctness_tester(const rotate_batch_fn_t rotate_batch_fn);
+
+bool run_fixed_correctness_tester(const rotate_fixed_fn_t rotate_fixed_fn);
+
+bool run_view_correctness_tester(void);
+
+bool run_sequence_correctness_tester(void);
+
+bool run_tiles_correctness_tester(void);
+
+bool run_morton_correctness_tester(void);
+
+bool run_stream_tester(const char* const fname, const char* const output_fname,
+                       const rotate_stream_fn_t rotate_stream_fn,
+                       const size_t strips);
+
+bool run_stream_correctness_tester(const rotate_stream_fn_t rotate_stream_fn);
+
+bool run_map_correctness_tester(void);
+
+bool run_bmp_write_correctness_tester(void);
+
+bool run_pbm_correctness_tester(void);
+
+bool run_g4_correctness_tester(const rotate_stream_fn_t rotate_stream_fn);
+
+bool run_pipeline_tester(const char* const input, const char* const output_dir,
+                         const rotate_files_fn_t rotate_files_fn);
+
+bool run_pipeline_correctness_tester(const rotate_files_fn_t rotate_files_fn);
+
+bool run_file_transform_tester(const char* const fname,
+                               const char* const output_fname,
+                               const rotate_file_fn_t rotate_file_fn,
+                               const enum orientation_e orientation);
+
+bool run_file_transform_correctness_tester(
+    const rotate_file_fn_t rotate_file_fn);
+
+bool run_daemon_correctness_tester(const rotate_daemon_fn_t rotate_daemon_fn);
+
 #endif  // TESTER_H
@@ -22,7 +22,36 @@
 
 #include "./utils.h"
 
+#include <pthread.h>
+#include <stddef.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define SMALL_PAGE_SIZE 4096
+#define CACHE_LINE_SIZE 64
+
+enum alloc_strategy_e { ALLOC_MALLOC, ALLOC_THP, ALLOC_HUGETLB };
+
+// set from SNAILSPEED_ALLOC at startup, before any thread can allocate
+static enum alloc_strategy_e alloc_strategy = ALLOC_MALLOC;
+
+// Set once a `hugetlb` allocation had to settle for transparent huge pages.
+// Allocating threads race to set it, so it is only touched atomically
+static bool hugetlb_fell_back = false;
+
+// Every live mapping made by `alloc_bit_matrix`, so `free_bit_matrix` can
+// tell them apart from `malloc` buffers and knows what to unmap
+struct mapping_s {
+  uint8_t *bit_matrix;
+  void *base;
+  size_t length;
+  struct mapping_s *next;
+};
+
+static struct mapping_s *mappings = NULL;
+static pthread_mutex_t mappings_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // Calculates the number of bytes required to hold `nbits` bits
 inline bytes_t bits_to_bytes(bits_t nbits) { return (nbits + 7) / 8; }
@@ -83,15 +112,147 @@ void print_bit_matrix(uint8_t *bit_matrix, const bits_t N, int32_t ncolumns) {
   return;
 }
 
+__attribute__((constructor)) static void read_alloc_settings(void) {
+  const char *requested = getenv("SNAILSPEED_ALLOC");
+
+  if (requested && !strcmp(requested, "thp")) {
+    alloc_strategy = ALLOC_THP;
+  } else if (requested && !strcmp(requested, "hugetlb")) {
+    alloc_strategy = ALLOC_HUGETLB;
+  } else if (requested && strcmp(requested, "malloc")) {
+    fprintf(stderr, "Unknown SNAILSPEED_ALLOC \"%s\", using malloc\n",
+            requested);
+  }
+}
+
+const char *bit_matrix_alloc_name(void) {
+  switch (alloc_strategy) {
+    case ALLOC_THP:
+      return "thp (2 MB aligned, MADV_HUGEPAGE, prefaulted)";
+    case ALLOC_HUGETLB:
+      return __atomic_load_n(&hugetlb_fell_back, __ATOMIC_RELAXED)
+                 ? "hugetlb (pool exhausted, fell back to thp, prefaulted)"
+                 : "hugetlb (MAP_HUGETLB 2 MB pages, prefaulted)";
+    default:
+      return "malloc";
+  }
+}
+
+// Remembers a mapping so that `free_bit_matrix` can unmap it
+static uint8_t *track_mapping(uint8_t *bit_matrix, void *base,
+                              size_t length) {
+  struct mapping_s *mapping = malloc(sizeof(*mapping));
+  if (!mapping) {
+    munmap(base, length);
+    return NULL;
+  }
+
+  mapping->bit_matrix = bit_matrix;
+  mapping->base = base;
+  mapping->length = length;
+
+  pthread_mutex_lock(&mappings_lock);
+  mapping->next = mappings;
+  mappings = mapping;
+  pthread_mutex_unlock(&mappings_lock);
+
+  return bit_matrix;
+}
+
+// Maps explicit huge pages. Fails if the hugetlbfs pool is too small
+static uint8_t *alloc_hugetlb(const bytes_t nbytes) {
+  const size_t length =
+      (nbytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+  void *base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                    -1, 0);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+
+  return track_mapping(base, base, length);
+}
+
+// Maps a 2 MB aligned region and asks for transparent huge pages before
+// touching it, so the first fault of every 2 MB can be served with one
+static uint8_t *alloc_thp(const bytes_t nbytes) {
+  const size_t length =
+      (nbytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE +
+      HUGE_PAGE_SIZE;
+
+  void *base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+
+  uint8_t *aligned =
+      (uint8_t *)(((uintptr_t)base + HUGE_PAGE_SIZE - 1) &
+                  ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+  madvise(aligned, length - HUGE_PAGE_SIZE, MADV_HUGEPAGE);
+
+  // Prefault now so that no page fault lands in a timed rotation
+  for (size_t offset = 0; offset < nbytes; offset += SMALL_PAGE_SIZE) {
+    aligned[offset] = 0;
+  }
+
+  return track_mapping(aligned, base, length);
+}
+
+uint8_t *alloc_bit_matrix(const bytes_t nbytes) {
+  switch (alloc_strategy) {
+    case ALLOC_HUGETLB: {
+      uint8_t *ret = alloc_hugetlb(nbytes);
+      if (ret) {
+        return ret;
+      }
+      // Not enough reserved huge pages, so settle for transparent ones
+      __atomic_store_n(&hugetlb_fell_back, true, __ATOMIC_RELAXED);
+      return alloc_thp(nbytes);
+    }
+    case ALLOC_THP:
+      return alloc_thp(nbytes);
+    default: {
+      // Line aligned, so whole rows of blocks can be streamed out
+      void *ret = NULL;
+      return posix_memalign(&ret, CACHE_LINE_SIZE, nbytes) ? NULL : ret;
+    }
+  }
+}
+
+void free_bit_matrix(uint8_t *bit_matrix) {
+  if (!bit_matrix) {
+    return;
+  }
+
+  pthread_mutex_lock(&mappings_lock);
+  struct mapping_s **link = &mappings;
+  while (*link && (*link)->bit_matrix != bit_matrix) {
+    link = &(*link)->next;
+  }
+  struct mapping_s *mapping = *link;
+  if (mapping) {
+    *link = mapping->next;
+  }
+  pthread_mutex_unlock(&mappings_lock);
+
+  if (mapping) {
+    munmap(mapping->base, mapping->length);
+    free(mapping);
+  } else {
+    free(bit_matrix);
+  }
+}
+
 uint8_t *generate_bit_matrix(const bits_t N, bool suppress_error) {
   // Sanity check the input
   assert(N > 0);
-  assert(!(N % 64));
 
   bytes_t nbytes = bits_to_bytes(N);
 
   uint8_t *ret;
-  ret = malloc(nbytes * N);
+  ret = alloc_bit_matrix(nbytes * N);
   if (!ret) {
     if (!suppress_error)
       printf("Error: Run out of heap space! Please try smaller matrix size.\n");
@@ -111,18 +272,20 @@ uint8_t *generate_bit_matrix(const bits_t N, bool suppress_error) {
     scrambled = (scrambled << 32) | (scrambled >> 32);
   }
 
+  // The last few bytes if the matrix is not a whole number of words
+  memcpy(pt + i, &scrambled, nbytes * N % 8);
+
   return ret;
 }
 
 uint8_t *copy_bit_matrix(uint8_t *bit_matrix, const bits_t N) {
   // Sanity check the input
   assert(N > 0);
-  assert(!(N % 64));
 
   bytes_t nbytes = bits_to_bytes(N);
 
   uint8_t *ret;
-  ret = malloc(nbytes * N);
+  ret = alloc_bit_matrix(nbytes * N);
   if (!ret) {
     printf("Error: Run out of heap space! Please try smaller matrix size.\n");
     assert(false);
@@ -133,3 +296,37 @@ uint8_t *copy_bit_matrix(uint8_t *bit_matrix, const bits_t N) {
 
   return ret;
 }
+
+// The scratch buffer of each thread, with its size in front
+struct thread_scratch_s {
+  size_t nbytes;
+  max_align_t data[];
+};
+
+static pthread_key_t thread_scratch_key;
+
+__attribute__((constructor)) static void create_thread_scratch_key(void) {
+  pthread_key_create(&thread_scratch_key, free);
+}
+
+void *get_thread_scratch(const size_t nbytes) {
+  struct thread_scratch_s *scratch = pthread_getspecific(thread_scratch_key);
+  if (!scratch || scratch->nbytes < nbytes) {
+    free(scratch);
+    scratch = malloc(sizeof(*scratch) + nbytes);
+    if (!scratch) {
+      printf("Error: Run out of heap space!\n");
+      assert(false);
+    }
+    scratch->nbytes = nbytes;
+    pthread_setspecific(thread_scratch_key, scratch);
+  }
+
+  return scratch->data;
+}
+
+bool is_same_file(const char *fname, const char *other_fname) {
+  struct stat st, other_st;
+  return !stat(fname, &st) && !stat(other_fname, &other_st) &&
+         st.st_dev == other_st.st_dev && st.st_ino == other_st.st_ino;
+}
@@ -34,6 +34,29 @@
 typedef size_t bits_t;
 typedef size_t bytes_t;
 
+// Flags that make up an orientation. An orientation transposes the matrix
+// (if ORIENT_TRANSPOSE_BIT is set), then reverses the order of its rows (if
+// ORIENT_FLIP_VERTICAL_BIT is set), then reverses the order of its columns
+// (if ORIENT_FLIP_HORIZONTAL_BIT is set)
+#define ORIENT_TRANSPOSE_BIT 1
+#define ORIENT_FLIP_VERTICAL_BIT 2
+#define ORIENT_FLIP_HORIZONTAL_BIT 4
+
+// The eight symmetries of a square
+enum orientation_e {
+  ORIENT_IDENTITY = 0,
+  ORIENT_TRANSPOSE = ORIENT_TRANSPOSE_BIT,
+  ORIENT_FLIP_VERTICAL = ORIENT_FLIP_VERTICAL_BIT,
+  ORIENT_ROTATE_CCW = ORIENT_TRANSPOSE_BIT | ORIENT_FLIP_VERTICAL_BIT,
+  ORIENT_FLIP_HORIZONTAL = ORIENT_FLIP_HORIZONTAL_BIT,
+  ORIENT_ROTATE_CW = ORIENT_TRANSPOSE_BIT | ORIENT_FLIP_HORIZONTAL_BIT,
+  ORIENT_ROTATE_180 = ORIENT_FLIP_VERTICAL_BIT | ORIENT_FLIP_HORIZONTAL_BIT,
+  ORIENT_ANTI_TRANSPOSE = ORIENT_TRANSPOSE_BIT | ORIENT_FLIP_VERTICAL_BIT |
+                          ORIENT_FLIP_HORIZONTAL_BIT,
+};
+
+#define NORIENTATIONS 8
+
 size_t bits_to_bytes(bits_t nbits);
 
 uint8_t get_bit(uint8_t *img, const bytes_t row_size, uint32_t i, uint32_t j);
@@ -43,8 +66,31 @@ void set_bit(uint8_t *img, const bytes_t row_size, uint32_t i, uint32_t j,
 
 void print_bit_matrix(uint8_t *bit_matrix, const bits_t N, int32_t subportion);
 
+// Allocates `nbytes` for a bit matrix with the strategy picked from the
+// SNAILSPEED_ALLOC environment variable: `malloc` (default, 64-byte
+// aligned), `thp` (2 MB aligned and advised for transparent huge pages) or
+// `hugetlb` (explicit 2 MB pages, falling back to `thp`). The page-backed
+// strategies prefault the buffer. Returns NULL if the allocation failed
+uint8_t *alloc_bit_matrix(const bytes_t nbytes);
+
+// Frees a buffer returned by `alloc_bit_matrix`
+void free_bit_matrix(uint8_t *bit_matrix);
+
+// Describes the allocation strategy `alloc_bit_matrix` uses
+const char *bit_matrix_alloc_name(void);
+
 uint8_t *generate_bit_matrix(const bits_t N, bool suppress_error);
 
 uint8_t *copy_bit_matrix(uint8_t *bit_matrix, const bits_t N);
 
+// Returns a buffer of at least `nbytes` that belongs to the calling thread.
+// Later calls on the same thread reuse it, growing it if need be, so the
+// contents only last until the next call. It is freed when the thread exits.
+// Meant for the many small ranges a `parallel_for` worker runs
+void *get_thread_scratch(const size_t nbytes);
+
+// Returns `true` if `fname` and `other_fname` name the same existing file,
+// through the same path, a link or otherwise
+bool is_same_file(const char *fname, const char *other_fname);
+
 #endif  // UTILS_H